@@ -0,0 +1,243 @@
+#pragma once
+
+#include "interval.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Active sets hold the segments whose x-interval is open at the current sweep
+// position. They all share the same small interface so that the sweep can be
+// instantiated with any of them:
+//  - reset(yInts, yRange, yStep): prepare for a new query, where yInts holds
+//    the (tolerance-padded) y-extent of every segment, indexed by segment
+//  - insert(id) / erase(id)
+//  - for_each_ovlp(id, f): call f(other) for the actives that may overlap
+//    segment id along y
+//  - size()
+// Between queries, reset keeps the memory of the set, so that a query on no
+// more segments than before does not allocate (see sweep_workspace.h).
+
+// returns every active segment, regardless of its y-extent; the segments are
+// kept in a dense array, with the position of each one for erase (it was a
+// hash set, hence the name)
+struct hash_active_set
+{
+  vector<uint32_t> ids;
+  vector<uint32_t> pos; // position in ids of each active segment
+
+  void reset(const vector<intvl> &yIntervals, const intvl &, double)
+  {
+    ids.clear();
+    pos.resize(yIntervals.size());
+  }
+  void clear() { ids.clear(); }
+  void insert(uint32_t id)
+  {
+    pos[id] = (uint32_t)ids.size();
+    ids.push_back(id);
+  }
+  // the last segment takes the place of the erased one
+  void erase(uint32_t id)
+  {
+    uint32_t k = pos[id];
+    if (k >= ids.size() || ids[k] != id)
+      return;
+    ids[k] = ids.back();
+    pos[ids[k]] = k;
+    ids.pop_back();
+  }
+  size_t size() const { return ids.size(); }
+
+  template <class F> void for_each_ovlp(uint32_t, F &&f) const
+  {
+    for (auto id : ids)
+    {
+      f(id);
+    }
+  }
+};
+
+// The y-range of the input is cut into buckets of (roughly) the mean segment
+// height and each active segment is listed in every bucket its y-extent
+// touches. A query only visits the buckets of the new segment, and reports a
+// pair in the first bucket shared by both segments, so no pair is reported
+// twice. Erased segments are only flagged and get removed from their buckets
+// the next time those are visited. Only the first nBuckets buckets are in
+// use; the others keep their memory for the next queries.
+struct ybucket_active_set
+{
+  const vector<intvl> *yInts = nullptr;
+  double y0 = 0., invStep = 1.;
+  int nBuckets = 1;
+  vector<vector<uint32_t>> buckets;
+  vector<char> active;
+  size_t nActive = 0;
+
+  static const int maxBuckets = 1 << 16;
+
+  void reset(const vector<intvl> &yIntervals, const intvl &yRange,
+             double yStep)
+  {
+    // the buckets of the last query are emptied before nBuckets changes
+    clear();
+    yInts = &yIntervals;
+    y0 = yRange.ends[0];
+    double height = yRange.ends[1] - yRange.ends[0];
+    nBuckets = yStep > 0. ? (int)min(height / yStep + 1., (double)maxBuckets)
+                          : 1;
+    nBuckets = max(nBuckets, 1);
+    invStep = height > 0. ? nBuckets / height : 0.;
+    if (buckets.size() < (size_t)nBuckets)
+      buckets.resize(nBuckets);
+    active.assign(yIntervals.size(), 0);
+  }
+
+  void clear()
+  {
+    int nUsed = min(nBuckets, (int)buckets.size());
+    for (int ib = 0; ib < nUsed; ++ib)
+    {
+      auto &bucket = buckets[ib];
+      for (auto id : bucket)
+      {
+        active[id] = 0;
+      }
+      bucket.clear();
+    }
+    nActive = 0;
+  }
+
+  int bucket_of(double y) const
+  {
+    int ib = (int)((y - y0) * invStep);
+    return min(max(ib, 0), nBuckets - 1);
+  }
+
+  void insert(uint32_t id)
+  {
+    const intvl &yInt = (*yInts)[id];
+    int ib1 = bucket_of(yInt.ends[1]);
+    for (int ib = bucket_of(yInt.ends[0]); ib <= ib1; ++ib)
+    {
+      buckets[ib].push_back(id);
+    }
+    active[id] = 1;
+    ++nActive;
+  }
+
+  void erase(uint32_t id)
+  {
+    active[id] = 0;
+    --nActive;
+  }
+
+  size_t size() const { return nActive; }
+
+  template <class F> void for_each_ovlp(uint32_t id, F &&f)
+  {
+    const intvl &yInt = (*yInts)[id];
+    int ib0 = bucket_of(yInt.ends[0]), ib1 = bucket_of(yInt.ends[1]);
+    for (int ib = ib0; ib <= ib1; ++ib)
+    {
+      auto &bucket = buckets[ib];
+      for (size_t k = 0; k < bucket.size();)
+      {
+        uint32_t other = bucket[k];
+        if (!active[other])
+        {
+          bucket[k] = bucket.back();
+          bucket.pop_back();
+          continue;
+        }
+        ++k;
+        const intvl &oInt = (*yInts)[other];
+        if (max(bucket_of(oInt.ends[0]), ib0) == ib &&
+            intvl::intvl_ovlp(oInt, yInt))
+        {
+          f(other);
+        }
+      }
+    }
+  }
+};
+
+// One active set per group of segments, for the group modes of
+// LsegIntersector: a query only visits the sets of the groups that its own
+// group is tested against, so intra-group pairs of a bichromatic query are
+// never even listed.
+template <class ActiveSet> struct grouped_active_set
+{
+  const vector<uint8_t> *groups = nullptr;
+  const uint64_t *masks = nullptr; // groups tested against each group
+  vector<ActiveSet> sets;
+
+  void set_groups(const vector<uint8_t> &segGroups, const uint64_t *groupMasks,
+                  int nGroups)
+  {
+    groups = &segGroups;
+    masks = groupMasks;
+    sets.resize(nGroups);
+  }
+
+  void reset(const vector<intvl> &yIntervals, const intvl &yRange,
+             double yStep)
+  {
+    for (auto &set : sets)
+    {
+      set.reset(yIntervals, yRange, yStep);
+    }
+  }
+
+  void clear()
+  {
+    for (auto &set : sets)
+    {
+      set.clear();
+    }
+  }
+
+  void insert(uint32_t id) { sets[(*groups)[id]].insert(id); }
+  void erase(uint32_t id) { sets[(*groups)[id]].erase(id); }
+
+  size_t size() const
+  {
+    size_t n = 0;
+    for (const auto &set : sets)
+    {
+      n += set.size();
+    }
+    return n;
+  }
+
+  template <class F> void for_each_ovlp(uint32_t id, F &&f)
+  {
+    uint64_t mask = masks[(*groups)[id]];
+    for (size_t g = 0; g < sets.size(); ++g)
+    {
+      if ((mask >> g) & 1)
+        sets[g].for_each_ovlp(id, f);
+    }
+  }
+};
+
+// prepares an active set for a query; the group arguments are only used by
+// grouped_active_set
+template <class ActiveSet>
+void init_active_set(ActiveSet &active, const vector<intvl> &yInts,
+                     const intvl &yRange, double yStep,
+                     const vector<uint8_t> &, const uint64_t *, int)
+{
+  active.reset(yInts, yRange, yStep);
+}
+
+template <class ActiveSet>
+void init_active_set(grouped_active_set<ActiveSet> &active,
+                     const vector<intvl> &yInts, const intvl &yRange,
+                     double yStep, const vector<uint8_t> &groups,
+                     const uint64_t *groupMasks, int nGroups)
+{
+  active.set_groups(groups, groupMasks, nGroups);
+  active.reset(yInts, yRange, yStep);
+}
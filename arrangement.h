@@ -0,0 +1,34 @@
+#pragma once
+
+#include "lseg.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Planar arrangement of a set of segments (LsegIntersector::nodeSegs): every
+// segment split at the points where it meets the others, as a table of
+// vertices and the edges between them. Points closer than the merge
+// distance share a vertex, and an edge common to overlapping segments is
+// kept once, so two edges only meet at a vertex they share.
+
+// piece of segment is (its index in the intersector), from v0 to v1 in the
+// direction of the segment
+struct arrangement_edge
+{
+  uint32_t v0, v1;
+  uint32_t is;
+};
+
+struct arrangement
+{
+  vector<Pnt2> vertices;
+  vector<arrangement_edge> edges;
+  int nIntx = 0; // intersecting pairs, as numIntx counts them
+
+  Lineseg edge_seg(size_t k) const
+  {
+    return Lineseg(vertices[edges[k].v0], vertices[edges[k].v1],
+                   (uint32_t)k);
+  }
+};
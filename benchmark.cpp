@@ -0,0 +1,458 @@
+#include "event_sort.h"
+#include "intx_batch.h"
+#include "intx_stats.h"
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include "workloads.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+/*
+ * Benchmark suite: runs the engines of LsegIntersector on the seeded
+ * workloads of workloads.h and writes the results as JSON, for regression
+ * tracking. For each (workload, n), the run lists the time to generate and
+ * load the segments, then for each engine the best time over the repeats,
+ * the throughput in segments and candidate pairs (pairs passed to the pair
+ * kernel) per second, and the peak resident memory during the run. When
+ * built with LSEG_STATS, the statistics of the engine (see intx_stats.h) are
+ * added: time per stage, active-set sizes, pairs by result and the sweep
+ * axis with the estimates it was chosen from.
+ *
+ * lineseg_bench [--workload name|all]... [--n 1000,100000] [--seed 1]
+ *               [--len 0] [--engines sweep,grid,auto,bo,bf] [--threads 1]
+ *               [--kdop 4,8,16] [--axis automatic] [--repeat 1]
+ *               [--bf-max 20000] [--event-sort radix]
+ *               [--sorts std,std_parallel,radix]
+ *               [--out results.json]
+ *
+ * With several --kdop values, each (workload, n) is run once per number of
+ * filter directions, to compare the candidate pairs and times.
+ *
+ * --event-sort sets the sort of the sweep events used by the engines. With
+ * --sorts, the engines are not run: the given event sorts are timed instead,
+ * on the interval ends of the workload along x, n being the number of ends
+ * (n / 2 segments), on --threads threads.
+ */
+
+namespace {
+
+struct bench_options {
+  vector<Workload> workloads;
+  vector<int> sizes = {100000};
+  uint64_t seed = 1;
+  double len = 0.;
+  vector<string> engines = {"sweep", "grid", "bo", "bf"};
+  int nThreads = 1;
+  vector<int> kdops = {8};
+  SweepAxis axis = SweepAxis::automatic;
+  int repeat = 1;
+  int bfMax = 20000;
+  EventSort eventSort = EventSort::radix;
+  vector<EventSort> sorts; // sort benchmark when not empty
+  string out;
+};
+
+struct engine_result {
+  string engine;
+  double ms = 0.;
+  int nIntx = 0;
+  double nCandidates = 0.;
+  long peakKb = -1;
+  intx_stats stats;
+};
+
+// peak resident set size of the process, in kB; -1 where unknown
+long peak_rss_kb() {
+#ifdef __linux__
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0)
+      return atol(line.c_str() + 6);
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return -1;
+}
+
+// restarts the peak from the current resident size, so that it can be
+// measured per engine (Linux only; elsewhere the peak is the process one)
+void reset_peak_rss() {
+#ifdef __linux__
+  ofstream clear("/proc/self/clear_refs");
+  clear << "5";
+#endif
+}
+
+double elapsed_ms(chrono::high_resolution_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::high_resolution_clock::now() -
+                                         start)
+      .count();
+}
+
+// runs engine on SI; false for an unknown engine
+bool run_engine(const string &engine, LsegIntersector &SI, size_t n,
+                engine_result &res) {
+  int nFiltered = -1;
+  function<int()> count;
+  if (engine == "sweep") {
+    count = [&] { return SI.numIntx_sweep(&nFiltered); };
+  } else if (engine == "grid") {
+    count = [&] { return SI.numIntx_grid(&nFiltered); };
+  } else if (engine == "auto") {
+    count = [&] {
+      SI.setEngine(EngineType::automatic);
+      return SI.numIntx(&nFiltered);
+    };
+  } else if (engine == "bo") {
+    count = [&] { return SI.numIntx_BO(&nFiltered); };
+  } else if (engine == "bf") {
+    count = [&] { return SI.numIntx_BF(); };
+  } else {
+    return false;
+  }
+  reset_peak_rss();
+  auto start = chrono::high_resolution_clock::now();
+  res.nIntx = count();
+  res.ms = elapsed_ms(start);
+  res.peakKb = peak_rss_kb();
+  res.stats = SI.stats();
+  res.nCandidates =
+      engine == "bf" ? 0.5 * (double)n * (double)(n - 1) : (double)nFiltered;
+  return true;
+}
+
+// times the event sorts of opts on the interval ends along x of n / 2
+// segments of workload, and adds a run to json; false if a sort gives a
+// wrong order
+bool bench_event_sorts(Workload workload, int n, const bench_options &opts,
+                       ostringstream &json, const char *&runSep) {
+  int nSegs = max(n / 2, 1);
+  double len = opts.len > 0. ? opts.len : workload_default_len(nSegs);
+  auto start = chrono::high_resolution_clock::now();
+  vector<intvl_end> sides;
+  uint64_t checksum = 0;
+  {
+    vector<Lineseg> segs = generate_workload(workload, nSegs, opts.seed, len);
+    sides.reserve(2 * segs.size());
+    for (uint32_t is = 0; is < (uint32_t)segs.size(); ++is) {
+      intvl proj = sweep_frame().along(segs[is], 1.e-12, is);
+      sides.push_back(intvl_end{proj.ends[0], is, 0});
+      sides.push_back(intvl_end{proj.ends[1], is, 1});
+      checksum += 4 * (uint64_t)is + 1;
+    }
+  }
+  double generateMs = elapsed_ms(start);
+
+  bool consistent = true;
+  vector<pair<EventSort, double>> times;
+  for (auto method : opts.sorts) {
+    double best = 0.;
+    for (int r = 0; r < opts.repeat; ++r) {
+      vector<intvl_end> sorted = sides;
+      start = chrono::high_resolution_clock::now();
+      sort_events(sorted, method, opts.nThreads);
+      double ms = elapsed_ms(start);
+      best = r == 0 ? ms : min(best, ms);
+      uint64_t sum = 0;
+      for (const auto &side : sorted) {
+        sum += 2 * (uint64_t)side.id + side.iend;
+      }
+      consistent &= sum == checksum &&
+                    is_sorted(sorted.begin(), sorted.end(), customComp());
+    }
+    times.emplace_back(method, best);
+    cerr << workload_name(workload) << " events=" << sides.size() << " "
+         << event_sort_name(method) << ": " << best << " ms\n";
+  }
+
+  json << runSep << "    {\n"
+       << "      \"workload\": \"" << workload_name(workload) << "\",\n"
+       << "      \"events\": " << sides.size() << ",\n"
+       << "      \"seed\": " << opts.seed << ",\n"
+       << "      \"threads\": " << opts.nThreads << ",\n"
+       << "      \"generate_ms\": " << generateMs << ",\n"
+       << "      \"consistent\": " << (consistent ? "true" : "false")
+       << ",\n      \"sorts\": [";
+  const char *sortSep = "\n";
+  for (const auto &[method, ms] : times) {
+    json << sortSep << "        {\"sort\": \"" << event_sort_name(method)
+         << "\", \"ms\": " << ms
+         << ", \"events_per_s\": " << sides.size() / (ms * 1.e-3) << "}";
+    sortSep = ",\n";
+  }
+  json << "\n      ]\n    }";
+  runSep = ",\n";
+  return consistent;
+}
+
+vector<string> split(const string &list) {
+  vector<string> items;
+  stringstream ss(list);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (!item.empty())
+      items.push_back(item);
+  }
+  return items;
+}
+
+void usage() {
+  cout << "usage: lineseg_bench [--workload name|all]... [--n n1,n2,...]\n"
+          "                     [--seed s] [--len l] [--engines e1,e2,...]\n"
+          "                     [--threads t] [--kdop k1,k2,...]\n"
+          "                     [--axis a] [--repeat r] [--bf-max n]\n"
+          "                     [--event-sort s] [--sorts s1,s2,...]\n"
+          "                     [--out file.json]\n"
+          "workloads:";
+  for (auto w : allWorkloads) {
+    cout << ' ' << workload_name(w);
+  }
+  cout << "\nengines: sweep grid auto bo bf\naxes:";
+  for (int a = 0; a <= nSweepAxes; ++a) {
+    cout << ' ' << sweep_axis_name((SweepAxis)a);
+  }
+  cout << "\nevent sorts:";
+  for (int s = 0; s < nEventSorts; ++s) {
+    cout << ' ' << event_sort_name((EventSort)s);
+  }
+  cout << endl;
+}
+
+bool event_sort_from_name(const string &name, EventSort &method) {
+  for (int s = 0; s < nEventSorts; ++s) {
+    if (name == event_sort_name((EventSort)s)) {
+      method = (EventSort)s;
+      return true;
+    }
+  }
+  cout << "unknown event sort " << name << endl;
+  return false;
+}
+
+bool parse_options(int argc, char *argv[], bench_options &opts) {
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--help" || i + 1 == argc)
+      return false;
+    string val = argv[++i];
+    if (arg == "--workload") {
+      for (const auto &name : split(val)) {
+        Workload w;
+        if (name == "all") {
+          opts.workloads.assign(begin(allWorkloads), end(allWorkloads));
+        } else if (workload_from_name(name, w)) {
+          opts.workloads.push_back(w);
+        } else {
+          cout << "unknown workload " << name << endl;
+          return false;
+        }
+      }
+    } else if (arg == "--n") {
+      opts.sizes.clear();
+      for (const auto &n : split(val)) {
+        opts.sizes.push_back(atoi(n.c_str()));
+      }
+    } else if (arg == "--seed") {
+      opts.seed = strtoull(val.c_str(), nullptr, 10);
+    } else if (arg == "--len") {
+      opts.len = atof(val.c_str());
+    } else if (arg == "--engines") {
+      opts.engines = split(val);
+    } else if (arg == "--threads") {
+      opts.nThreads = atoi(val.c_str());
+    } else if (arg == "--kdop") {
+      opts.kdops.clear();
+      for (const auto &k : split(val)) {
+        opts.kdops.push_back(kdop_directions(atoi(k.c_str())));
+      }
+    } else if (arg == "--axis") {
+      int a = 0;
+      while (a <= nSweepAxes && val != sweep_axis_name((SweepAxis)a))
+        ++a;
+      if (a > nSweepAxes) {
+        cout << "unknown axis " << val << endl;
+        return false;
+      }
+      opts.axis = (SweepAxis)a;
+    } else if (arg == "--repeat") {
+      opts.repeat = max(atoi(val.c_str()), 1);
+    } else if (arg == "--bf-max") {
+      opts.bfMax = atoi(val.c_str());
+    } else if (arg == "--event-sort") {
+      if (!event_sort_from_name(val, opts.eventSort))
+        return false;
+    } else if (arg == "--sorts") {
+      for (const auto &name : split(val)) {
+        EventSort method;
+        if (!event_sort_from_name(name, method))
+          return false;
+        opts.sorts.push_back(method);
+      }
+    } else if (arg == "--out") {
+      opts.out = val;
+    } else {
+      cout << "unknown option " << arg << endl;
+      return false;
+    }
+  }
+  if (opts.workloads.empty())
+    opts.workloads.assign(begin(allWorkloads), end(allWorkloads));
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bench_options opts;
+  if (!parse_options(argc, argv, opts)) {
+    usage();
+    return 1;
+  }
+
+  ostringstream json;
+  json << setprecision(10);
+  json << "{\n  \"benchmark\": \"lineseg\",\n"
+       << "  \"hardware_threads\": " << thread::hardware_concurrency()
+       << ",\n  \"pair_kernel\": \""
+       << intx_batch_isa_name(intx_batch_best_isa()) << "\",\n"
+       << "  \"runs\": [";
+  bool allConsistent = true;
+  const char *runSep = "\n";
+  for (auto workload : opts.workloads) {
+    for (int n : opts.sizes) {
+      if (!opts.sorts.empty()) {
+        allConsistent &= bench_event_sorts(workload, n, opts, json, runSep);
+        continue;
+      }
+      double len = opts.len > 0. ? opts.len : workload_default_len(n);
+      auto start = chrono::high_resolution_clock::now();
+      vector<Lineseg> segs = generate_workload(workload, n, opts.seed, len);
+      double generateMs = elapsed_ms(start);
+      start = chrono::high_resolution_clock::now();
+      LsegIntersector SI;
+      SI.setNumThreads(opts.nThreads);
+      SI.setSweepAxis(opts.axis);
+      SI.setEventSort(opts.eventSort);
+      for (const auto &seg : segs) {
+        SI.addSeg(seg);
+      }
+      double loadMs = elapsed_ms(start);
+
+      for (int kdop : opts.kdops) {
+        SI.setFilterDirections(kdop);
+        vector<engine_result> results;
+        for (const auto &engine : opts.engines) {
+          if (engine == "bf" && n > opts.bfMax)
+            continue;
+          engine_result best;
+          for (int r = 0; r < opts.repeat; ++r) {
+            engine_result res;
+            res.engine = engine;
+            if (!run_engine(engine, SI, segs.size(), res)) {
+              cout << "unknown engine " << engine << endl;
+              usage();
+              return 1;
+            }
+            if (r == 0 || res.ms < best.ms)
+              best = res;
+          }
+          results.push_back(best);
+          cerr << workload_name(workload) << " n=" << n << " " << engine
+               << " kdop=" << kdop << ": " << best.ms << " ms, " << best.nIntx
+               << " intersections\n";
+        }
+        bool consistent = true;
+        for (const auto &res : results) {
+          consistent &= res.nIntx == results[0].nIntx;
+        }
+        allConsistent &= consistent;
+
+        json << runSep << "    {\n"
+             << "      \"workload\": \"" << workload_name(workload) << "\",\n"
+             << "      \"n\": " << n << ",\n"
+             << "      \"seed\": " << opts.seed << ",\n"
+             << "      \"len\": " << len << ",\n"
+             << "      \"threads\": " << opts.nThreads << ",\n"
+             << "      \"kdop\": " << kdop << ",\n"
+             << "      \"event_sort\": \"" << event_sort_name(opts.eventSort)
+             << "\",\n"
+             << "      \"generate_ms\": " << generateMs << ",\n"
+             << "      \"load_ms\": " << loadMs << ",\n"
+             << "      \"consistent\": " << (consistent ? "true" : "false")
+             << ",\n      \"engines\": [";
+        const char *engineSep = "\n";
+        for (const auto &res : results) {
+          double seconds = res.ms * 1.e-3;
+          json << engineSep << "        {\"engine\": \"" << res.engine
+               << "\", \"ms\": " << res.ms
+               << ", \"intersections\": " << res.nIntx
+               << ", \"candidate_pairs\": " << res.nCandidates
+               << ", \"segments_per_s\": " << n / seconds
+               << ", \"candidate_pairs_per_s\": " << res.nCandidates / seconds
+               << ", \"peak_rss_kb\": " << res.peakKb;
+          if constexpr (intx_stats::enabled) {
+            const auto &st = res.stats;
+            json << ", \"stages_ms\": {";
+            for (int s = 0; s < nIntxStages; ++s) {
+              json << (s > 0 ? ", \"" : "\"") << intx_stage_name((IntxStage)s)
+                   << "\": " << st.stageMs[s];
+            }
+            // candidate_pairs above are the ones that passed the filter
+            json << "}, \"events\": " << st.nEvents
+                 << ", \"broad_phase_pairs\": " << st.nCandidates
+                 << ", \"touch_or_overlap\": " << st.nByResult[1]
+                 << ", \"transverse\": " << st.nByResult[2]
+                 << ", \"max_active\": " << st.maxActive
+                 << ", \"mean_active\": " << st.meanActive();
+            if (res.engine == "sweep" || res.engine == "auto") {
+              json << ", \"sweep_axis\": \"" << sweep_axis_name(st.sweepAxis)
+                   << "\", \"axis_estimates\": {";
+              for (int a = 0; a < nSweepAxes; ++a) {
+                json << (a > 0 ? ", \"" : "\"")
+                     << sweep_axis_name((SweepAxis)a)
+                     << "\": " << st.axisEstimates[a];
+              }
+              json << "}";
+            }
+          }
+          json << "}";
+          engineSep = ",\n";
+        }
+        json << "\n      ]\n    }";
+        runSep = ",\n";
+      }
+    }
+  }
+  json << "\n  ]\n}\n";
+
+  if (opts.out.empty()) {
+    cout << json.str();
+  } else {
+    ofstream out(opts.out);
+    out << json.str();
+    if (!out) {
+      cout << "!!!!! unable to write " << opts.out << " !!!!!\n";
+      return 1;
+    }
+  }
+  // engines disagreeing on a workload is a regression too
+  return allConsistent ? 0 : 2;
+}
@@ -0,0 +1,174 @@
+#include "case_batch.h"
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include "seg_io.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// parsed cases waiting for a worker, per worker
+const size_t casesAheadPerWorker = 2;
+
+struct case_result {
+  bool done = false;
+  long nSegs = -1;
+  int nIntx = -1, nFiltered = -1;
+  double readMs = 0., countMs = 0.;
+};
+
+struct parsed_case {
+  size_t index;
+  shared_ptr<vector<Lineseg>> segs;
+  double readMs;
+};
+
+double elapsed_ms(chrono::high_resolution_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::high_resolution_clock::now() -
+                                         start)
+      .count();
+}
+
+} // namespace
+
+vector<string> expand_case_patterns(const vector<string> &patterns) {
+  vector<string> cases;
+  for (const auto &pattern : patterns) {
+#ifndef _WIN32
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+      // glob sorts its matches
+      for (size_t k = 0; k < matches.gl_pathc; ++k) {
+        cases.push_back(matches.gl_pathv[k]);
+      }
+      globfree(&matches);
+      continue;
+    }
+    globfree(&matches);
+#endif
+    cases.push_back(pattern);
+  }
+  return cases;
+}
+
+bool read_case_list(const string &listFile, vector<string> &patterns) {
+  ifstream in(listFile);
+  if (!in.is_open()) {
+    cout << "!!!!! unable to open " << listFile << " !!!!!\n";
+    return false;
+  }
+  string line;
+  while (getline(in, line)) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+      line.pop_back();
+    if (!line.empty() && line[0] != '#')
+      patterns.push_back(line);
+  }
+  return true;
+}
+
+int run_case_batch(const vector<string> &cases, int nThreads, ostream &out) {
+  if (nThreads <= 0)
+    nThreads = (int)thread::hardware_concurrency();
+  nThreads = max(1, min(nThreads, (int)cases.size()));
+  const size_t maxAhead = casesAheadPerWorker * nThreads;
+
+  mutex lock;
+  condition_variable parsed, taken;
+  deque<parsed_case> queue;
+  bool allParsed = false;
+  vector<case_result> results(cases.size());
+  size_t nPrinted = 0;
+  int nFailed = 0;
+
+  out << "# case segments intersections filtered_pairs read_ms count_ms\n";
+  auto batchStart = chrono::high_resolution_clock::now();
+
+  // parses the cases in order, staying at most maxAhead cases ahead
+  thread reader([&] {
+    for (size_t ic = 0; ic < cases.size(); ++ic) {
+      auto start = chrono::high_resolution_clock::now();
+      auto segs = read_segments_from_file(cases[ic]);
+      double readMs = elapsed_ms(start);
+      unique_lock<mutex> guard(lock);
+      taken.wait(guard, [&] { return queue.size() < maxAhead; });
+      queue.push_back(parsed_case{ic, std::move(segs), readMs});
+      parsed.notify_one();
+    }
+    lock_guard<mutex> guard(lock);
+    allParsed = true;
+    parsed.notify_all();
+  });
+
+  auto work = [&] {
+    while (true) {
+      parsed_case pc;
+      {
+        unique_lock<mutex> guard(lock);
+        parsed.wait(guard, [&] { return !queue.empty() || allParsed; });
+        if (queue.empty())
+          return;
+        pc = std::move(queue.front());
+        queue.pop_front();
+        taken.notify_one();
+      }
+
+      case_result res;
+      res.readMs = pc.readMs;
+      if (pc.segs != nullptr) {
+        // the cases run side by side, each on one thread
+        LsegIntersector SI;
+        SI.setNumThreads(1);
+        for (const auto &seg : *pc.segs) {
+          SI.addSeg(seg);
+        }
+        res.nSegs = (long)pc.segs->size();
+        pc.segs.reset();
+        auto start = chrono::high_resolution_clock::now();
+        res.nIntx = SI.numIntx(&res.nFiltered);
+        res.countMs = elapsed_ms(start);
+      }
+      res.done = true;
+
+      // the lines come out in the order of the cases
+      lock_guard<mutex> guard(lock);
+      results[pc.index] = res;
+      for (; nPrinted < cases.size() && results[nPrinted].done; ++nPrinted) {
+        const auto &r = results[nPrinted];
+        out << cases[nPrinted] << ' ' << r.nSegs << ' ' << r.nIntx << ' '
+            << r.nFiltered << ' ' << r.readMs << ' ' << r.countMs << '\n';
+        nFailed += r.nSegs < 0;
+      }
+      out.flush();
+    }
+  };
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  reader.join();
+
+  out << "# " << cases.size() << " cases, " << nFailed << " unreadable, "
+      << nThreads << " workers, " << elapsed_ms(batchStart) << " ms\n";
+  return nFailed;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Batch mode of the lineseg executable (lineseg --batch): runs numIntx on
+// many segment files in one process. A reader thread parses the files
+// ahead of the workers, up to a few cases per worker, and the workers count
+// the intersections of one case each, so parsing overlaps counting. One
+// line per case goes to out, in the order of the cases:
+//   case segments intersections filtered_pairs read_ms count_ms
+// with -1 counts for a file that cannot be read.
+
+// the files matching each pattern (a path, or a glob such as "cases/*.txt"),
+// sorted per pattern; a pattern that matches nothing is kept as is, so that
+// its case reports the missing file
+vector<string> expand_case_patterns(const vector<string> &patterns);
+
+// patterns read from a list file, one per line, blank lines and lines
+// starting with '#' skipped; false if the file cannot be read
+bool read_case_list(const string &listFile, vector<string> &patterns);
+
+// runs the cases on nThreads workers (0: all available cores) and returns
+// the number of cases that could not be read
+int run_case_batch(const vector<string> &cases, int nThreads, ostream &out);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "intx_batch.h"
+#include "lseg_exact.h"
+#include "sweep_workspace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Persistent index of LsegIntersector::numIntx_dynamic (lseg_grid.cpp): the
+// segments as of the last dynamic query, binned in a uniform grid laid out
+// when the index was built, with the number of intersections among them.
+// The segments added, removed or updated since are listed in changed. The
+// count and its updates both come from the pair kernel on soa, with the
+// predicates (soa.exact) and padding (soa.tol) numIntx would use.
+struct dynamic_index
+{
+  bool built = false;
+  int nIntx = 0;
+  size_t nBuilt = 0; // number of segments when the grid was laid out
+
+  // with exact predicates, the number of segments (removed ones included,
+  // as exact_coords_of counts them) whose coordinates need each type
+  size_t nCoords[3] = {0, 0, 0};
+
+  double x0 = 0., y0 = 0., step = 1.;
+  int nx = 1, ny = 1;
+  vector<vector<uint32_t>> cells;
+  seg_soa soa;             // indexed geometry
+  vector<uint8_t> indexed; // whether each segment is in the grid
+
+  vector<uint32_t> changed;
+  vector<uint8_t> isChanged;
+
+  // pairs of the segment being counted, kept across queries so that a
+  // stream of small updates does not allocate
+  candidate_batch cands;
+
+  // segments outside of the initial layout go to the border cells
+  int cell_x(double x) const
+  {
+    return min(max((int)floor((x - x0) / step), 0), nx - 1);
+  }
+  int cell_y(double y) const
+  {
+    return min(max((int)floor((y - y0) / step), 0), ny - 1);
+  }
+
+  // indexed geometry of segment is, growing the arrays for new segments
+  void set_geometry(uint32_t is, const Lineseg &seg)
+  {
+    if (is >= soa.size())
+      soa.resize(is + 1);
+    soa.set(is, seg.S.x, seg.S.y, seg.E.x, seg.E.y);
+  }
+
+  // type of the exact predicates for the counts of nCoords
+  ExactCoords exact_coords() const
+  {
+    if (nCoords[(int)ExactCoords::none] > 0)
+      return ExactCoords::none;
+    return nCoords[(int)ExactCoords::int64] > 0 ? ExactCoords::int64
+                                                : ExactCoords::int32;
+  }
+
+  void note_change(uint32_t is)
+  {
+    if (!built)
+      return;
+    if (is >= isChanged.size())
+      isChanged.resize(is + 1, 0);
+    if (!isChanged[is])
+    {
+      isChanged[is] = 1;
+      changed.push_back(is);
+    }
+  }
+};
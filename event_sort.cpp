@@ -0,0 +1,263 @@
+#include "event_sort.h"
+#include "interval.h"
+#include <algorithm>
+#include <barrier>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+// below this, std::sort beats the fixed cost of the radix passes
+const size_t minRadixEvents = 1024;
+// a thread is only started for this many ends
+const size_t minEventsPerThread = (size_t)1 << 15;
+
+// 11-bit digits: the first one holds the 10 low bits of the key and the
+// end/start flag, the next five the other 54 bits
+const int radixBits = 11;
+const size_t nRadixBuckets = (size_t)1 << radixBits;
+const int nRadixPasses = 6;
+
+// during the sort, val holds the bits of event_key(val)
+uint32_t radix_digit(const intvl_end &side, int pass)
+{
+  uint64_t key = bit_cast<uint64_t>(side.val);
+  if (pass == 0)
+    return (uint32_t)((key & (nRadixBuckets / 2 - 1)) << 1) |
+           (side.iend == 0 ? 1u : 0u);
+  int shift = radixBits - 1 + radixBits * (pass - 1);
+  return (uint32_t)(key >> shift) & (uint32_t)(nRadixBuckets - 1);
+}
+
+int clamp_threads(int nThreads, size_t n)
+{
+  if (nThreads <= 0)
+    nThreads = (int)thread::hardware_concurrency();
+  return max(1, min(nThreads, (int)(n / minEventsPerThread)));
+}
+
+// runs f(it) for it in [0, nThreads), on the calling thread and nThreads - 1
+// others
+template <class F> void run_threads(int nThreads, F &&f)
+{
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it)
+  {
+    workers.emplace_back(f, it);
+  }
+  f(0);
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void parallel_comparison_sort(vector<intvl_end> &sides, int nThreads,
+                              event_sort_scratch &scratch)
+{
+  size_t n = sides.size();
+  nThreads = clamp_threads(nThreads, n);
+  if (nThreads <= 1)
+  {
+    sort(sides.begin(), sides.end(), customComp());
+    return;
+  }
+  auto &bounds = scratch.bounds;
+  bounds.resize(nThreads + 1);
+  for (int ib = 0; ib <= nThreads; ++ib)
+  {
+    bounds[ib] = n * ib / nThreads;
+  }
+  run_threads(nThreads, [&](int it) {
+    sort(sides.begin() + bounds[it], sides.begin() + bounds[it + 1],
+         customComp());
+  });
+
+  // rounds of merges of neighbouring blocks, from sides to buf and back
+  auto &buf = scratch.buf;
+  buf.resize(n);
+  vector<intvl_end> *src = &sides, *dst = &buf;
+  for (int width = 1; width < nThreads; width *= 2)
+  {
+    int nMerges = (nThreads + 2 * width - 1) / (2 * width);
+    run_threads(nMerges, [&](int im) {
+      size_t lo = bounds[2 * width * im];
+      size_t mid = bounds[min(2 * width * im + width, nThreads)];
+      size_t hi = bounds[min(2 * width * (im + 1), nThreads)];
+      merge(src->begin() + lo, src->begin() + mid, src->begin() + mid,
+            src->begin() + hi, dst->begin() + lo, customComp());
+    });
+    swap(src, dst);
+  }
+  if (src != &sides)
+    sides.swap(buf);
+}
+
+// Each thread owns a block of the array. A pass counts the digits of each
+// block, turns the counts into the position of the first end of each
+// (digit, block), then each thread scatters its block; a barrier separates
+// the steps, and its completion step, run by one thread, computes the
+// positions after the counts and swaps the arrays after the scatter. On one
+// thread the step is called directly: neither a barrier nor a thread is
+// created, and the sort only allocates if the scratch buffers must grow.
+void radix_sort(vector<intvl_end> &sides, int nThreads,
+                event_sort_scratch &scratch)
+{
+  size_t n = sides.size();
+  nThreads = clamp_threads(nThreads, n);
+  auto &bounds = scratch.bounds;
+  bounds.resize(nThreads + 1);
+  for (int ib = 0; ib <= nThreads; ++ib)
+  {
+    bounds[ib] = n * ib / nThreads;
+  }
+  // counts[(it * nRadixPasses + pass) * nRadixBuckets + digit]
+  auto &counts = scratch.counts;
+  counts.assign((size_t)nThreads * nRadixPasses * nRadixBuckets, 0);
+  auto count_of = [&](int it, int pass) {
+    return counts.data() + ((size_t)it * nRadixPasses + pass) * nRadixBuckets;
+  };
+
+  auto &buf = scratch.buf;
+  buf.resize(n);
+  vector<intvl_end> *src = &sides, *dst = &buf;
+  int passes[nRadixPasses]; // passes with more than one digit value
+  int nPasses = -1;         // not known before the first counts
+  int iPass = 0;
+  bool countsDone = false;
+  auto step = [&]() noexcept {
+    if (!countsDone)
+    {
+      if (nPasses < 0)
+      {
+        nPasses = 0;
+        for (int pass = 0; pass < nRadixPasses; ++pass)
+        {
+          size_t maxCount = 0;
+          for (size_t d = 0; d < nRadixBuckets; ++d)
+          {
+            size_t total = 0;
+            for (int it = 0; it < nThreads; ++it)
+            {
+              total += count_of(it, pass)[d];
+            }
+            maxCount = max(maxCount, total);
+          }
+          if (maxCount < n)
+            passes[nPasses++] = pass;
+        }
+      }
+      if (iPass < nPasses)
+      {
+        size_t pos = 0;
+        for (size_t d = 0; d < nRadixBuckets; ++d)
+        {
+          for (int it = 0; it < nThreads; ++it)
+          {
+            size_t count = count_of(it, passes[iPass])[d];
+            count_of(it, passes[iPass])[d] = pos;
+            pos += count;
+          }
+        }
+      }
+      countsDone = true;
+    }
+    else
+    {
+      swap(src, dst);
+      ++iPass;
+      countsDone = false;
+    }
+  };
+
+  // wait() is the barrier between the steps
+  auto sort_block = [&](int it, auto &&wait) {
+    // keys in place of the values, and the digits of every pass at once,
+    // for the passes that can be skipped
+    for (size_t k = bounds[it]; k < bounds[it + 1]; ++k)
+    {
+      sides[k].val = bit_cast<double>(event_key(sides[k].val));
+      for (int pass = 0; pass < nRadixPasses; ++pass)
+      {
+        ++count_of(it, pass)[radix_digit(sides[k], pass)];
+      }
+    }
+    wait();
+    while (iPass < nPasses)
+    {
+      int pass = passes[iPass];
+      size_t *pos = count_of(it, pass);
+      const auto &from = *src;
+      auto &to = *dst;
+      for (size_t k = bounds[it]; k < bounds[it + 1]; ++k)
+      {
+        to[pos[radix_digit(from[k], pass)]++] = from[k];
+      }
+      wait();
+      if (iPass < nPasses)
+      {
+        pass = passes[iPass];
+        pos = count_of(it, pass);
+        fill(pos, pos + nRadixBuckets, 0);
+        for (size_t k = bounds[it]; k < bounds[it + 1]; ++k)
+        {
+          ++pos[radix_digit((*src)[k], pass)];
+        }
+      }
+      wait();
+    }
+    for (size_t k = bounds[it]; k < bounds[it + 1]; ++k)
+    {
+      auto &side = (*src)[k];
+      side.val = event_value(bit_cast<uint64_t>(side.val));
+    }
+  };
+  if (nThreads == 1)
+  {
+    sort_block(0, step);
+  }
+  else
+  {
+    barrier sync(nThreads, step);
+    run_threads(nThreads, [&](int it) {
+      sort_block(it, [&] { sync.arrive_and_wait(); });
+    });
+  }
+  if (src != &sides)
+    sides.swap(buf);
+}
+
+} // namespace
+
+const char *event_sort_name(EventSort method)
+{
+  switch (method)
+  {
+  case EventSort::parallel_comparison:
+    return "std_parallel";
+  case EventSort::radix:
+    return "radix";
+  case EventSort::comparison:
+  default:
+    return "std";
+  }
+}
+
+void sort_events(vector<intvl_end> &sides, EventSort method, int nThreads,
+                 event_sort_scratch *scratch)
+{
+  event_sort_scratch local;
+  if (scratch == nullptr)
+    scratch = &local;
+  if (method == EventSort::radix && sides.size() >= minRadixEvents)
+    radix_sort(sides, nThreads, *scratch);
+  else if (method == EventSort::parallel_comparison)
+    parallel_comparison_sort(sides, nThreads, *scratch);
+  else
+    sort(sides.begin(), sides.end(), customComp());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "interval.h"
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Sorts of the interval ends of the sweep (LsegIntersector::setEventSort).
+// The order is by value, ends before starts at equal values (customComp),
+// so that intervals that only touch at a padded bound are not reported.
+//  - comparison: std::sort with customComp
+//  - parallel_comparison: blocks sorted by std::sort on each thread, then
+//    merged in pairs, the merges of a round running in parallel
+//  - radix: LSD radix sort of the ends on integer keys that order as the
+//    doubles do, 11 bits per pass, with the end/start flag in the first
+//    pass; each pass counts and scatters blocks of the array in parallel,
+//    and passes whose digit is the same for all the ends are skipped
+
+// used to sort interval endpoints in increasing order
+struct customComp
+{
+  bool operator()(const intvl_end &i1, const intvl_end &i2) const
+  {
+    return (i1.val < i2.val) || (i1.val == i2.val && i1.iend > i2.iend);
+  }
+};
+
+enum class EventSort
+{
+  comparison,
+  parallel_comparison,
+  radix
+};
+
+const int nEventSorts = 3;
+
+const char *event_sort_name(EventSort method);
+
+// unsigned key with the order of the doubles: the sign bit is flipped for
+// positive values and all the bits for negative ones; -0 is folded into +0,
+// which compares equal to it (NaNs are not supported)
+inline uint64_t event_key(double val)
+{
+  uint64_t bits = bit_cast<uint64_t>(val + 0.);
+  return (bits >> 63) ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+// value of a key; -0 comes back as +0
+inline double event_value(uint64_t key)
+{
+  return bit_cast<double>((key >> 63) ? key & ~((uint64_t)1 << 63) : ~key);
+}
+
+// buffers of the sorts, kept by the caller across sorts so that a serial
+// sort of no more ends than before does not allocate
+struct event_sort_scratch
+{
+  vector<intvl_end> buf;
+  vector<size_t> bounds, counts;
+};
+
+// sorts the ends in the order of customComp, on nThreads threads (0: all
+// available cores); ends with equal values and sides may come in any order.
+// Without scratch, the buffers are allocated for the call.
+void sort_events(vector<intvl_end> &sides, EventSort method, int nThreads,
+                 event_sort_scratch *scratch = nullptr);
@@ -1,7 +1,6 @@
 #include "interval.h"
 #include <cstdint>
 #include <iostream>
-#include <memory>
 #include <utility>
 #include <vector>
 
@@ -10,22 +9,11 @@ struct customComp
 {
   bool operator()(const intvl_end &i1, const intvl_end &i2) const
   {
-    return (i1.pI->ends[i1.iend] < i2.pI->ends[i2.iend]) ||
-           ((i1.pI->ends[i1.iend] == i2.pI->ends[i2.iend] &&
-             i1.iend > i2.iend));
+    return (i1.val < i2.val) || (i1.val == i2.val && i1.iend > i2.iend);
   }
 };
 
 // debug code below
-static void print_ends(vector<intvl_end> &vends)
-{
-  for (auto end : vends)
-  {
-    cout << "id = " << end.pI->id << ", side = " << end.iend
-         << " , value = " << end.pI->ends[end.iend] << endl;
-  }
-}
-
 void print_ovlp_pairs(vector<pair<uint32_t, uint32_t>> &pairs)
 {
   cout << "number of pairs = " << pairs.size() << endl;
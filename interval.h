@@ -3,7 +3,6 @@
 #include <array>
 #include <cstdint>
 #include <functional>
-#include <memory>
 #include <utility>
 
 using namespace std;
@@ -23,11 +22,13 @@ struct intvl
 };
 
 // this struct helps to isolate each interval endpoint
-// without losing track of its id
+// without losing track of its id; the endpoint value is stored inline
+// so that a flat array of these can be sorted without chasing pointers
 struct intvl_end
 {
-  shared_ptr<intvl> pI;
-  int iend;
+  double val;
+  uint32_t id;   // index of the owning segment
+  uint32_t iend; // 0 = start, 1 = end
 };
 
 struct pair_hash
@@ -0,0 +1,508 @@
+#include "intx_batch.h"
+#include "kdop.h"
+#include "lseg.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// the vector kernels are compiled with per-function target attributes, so
+// the rest of the program does not need -mavx2 and still runs on older cpus
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define LSEG_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define LSEG_X86_KERNELS 0
+#endif
+
+void seg_soa::init(size_t n, double padding, int directions)
+{
+  tol = padding;
+  nDirs = kdop_directions(directions);
+  sx.assign(n, 0.);
+  sy.assign(n, 0.);
+  ex.assign(n, 0.);
+  ey.assign(n, 0.);
+  bounds.assign(n * nDirs, 0.);
+}
+
+void seg_soa::assign(const vector<Lineseg> &segs, double padding,
+                     int directions)
+{
+  init(segs.size(), padding, directions);
+  for (size_t is = 0; is < segs.size(); ++is)
+  {
+    const auto &seg = segs[is];
+    set((uint32_t)is, seg.S.x, seg.S.y, seg.E.x, seg.E.y);
+  }
+}
+
+void seg_soa::resize(size_t n)
+{
+  sx.resize(n);
+  sy.resize(n);
+  ex.resize(n);
+  ey.resize(n);
+  bounds.resize(n * nDirs);
+}
+
+void seg_soa::set(uint32_t id, double Sx, double Sy, double Ex, double Ey)
+{
+  sx[id] = Sx;
+  sy[id] = Sy;
+  ex[id] = Ex;
+  ey[id] = Ey;
+  double *b = bounds.data() + (size_t)nDirs * id;
+  switch (nDirs)
+  {
+  case 4:
+    kdop_bounds<4>(Sx, Sy, Ex, Ey, tol, b);
+    break;
+  case 16:
+    kdop_bounds<16>(Sx, Sy, Ex, Ey, tol, b);
+    break;
+  default:
+    kdop_bounds<8>(Sx, Sy, Ex, Ey, tol, b);
+    break;
+  }
+}
+
+template <int K>
+static void intx_batch_scalar(const seg_soa &soa, uint32_t q,
+                              const uint32_t *ids, size_t n, int8_t *res)
+{
+  Lineseg lq = soa.seg(q);
+  const double *bq = soa.kdop(q);
+  for (size_t k = 0; k < n; ++k)
+  {
+    res[k] = kdop_overlap<K>(soa.kdop(ids[k]), bq)
+                 ? (int8_t)Lineseg::intx<intx_type>(soa.seg(ids[k]), lq, nullptr)
+                 : (int8_t)-1;
+  }
+}
+
+// exact predicates on integer coordinates (soa.exact): the pairs are few
+// once filtered, and the integer determinants do not vectorize, so this one
+// is scalar whatever the isa
+template <int K, class Coord>
+static void intx_batch_exact(const seg_soa &soa, uint32_t q,
+                             const uint32_t *ids, size_t n, int8_t *res)
+{
+  auto int_seg = [&](uint32_t id) {
+    return IntLineseg<Coord>{{(Coord)soa.sx[id], (Coord)soa.sy[id]},
+                             {(Coord)soa.ex[id], (Coord)soa.ey[id]},
+                             id};
+  };
+  IntLineseg<Coord> lq = int_seg(q);
+  const double *bq = soa.kdop(q);
+  for (size_t k = 0; k < n; ++k)
+  {
+    res[k] = kdop_overlap<K>(soa.kdop(ids[k]), bq)
+                 ? (int8_t)IntLineseg<Coord>::intx(int_seg(ids[k]), lq)
+                 : (int8_t)-1;
+  }
+}
+
+// squared distance from (px, py) to the segment from (sx, sy) along (vx, vy)
+static inline double point_seg_dist_sq(double px, double py, double sx,
+                                       double sy, double vx, double vy,
+                                       double lenSq)
+{
+  double t = lenSq > 0. ? ((px - sx) * vx + (py - sy) * vy) / lenSq : 0.;
+  t = min(max(t, 0.), 1.);
+  double dx = sx + t * vx - px, dy = sy + t * vy - py;
+  return dx * dx + dy * dy;
+}
+
+// Proximity join (soa.clearance): the pairs that pass the filter are tested
+// with cheap bounds first. The gap between the boxes is a lower bound of the
+// distance, which rules out most of the pairs the padded k-DOP lets by at
+// its corners, and an endpoint closer than the clearance to the other
+// segment settles the pair. Only the pairs left need the crossing test:
+// without a crossing, the distance is that of the closest endpoint. It
+// gives the answer of Lineseg::dist(L) < clearance, and is scalar whatever
+// the isa, the pairs being few once filtered.
+template <int K>
+static void intx_batch_near(const seg_soa &soa, uint32_t q,
+                            const uint32_t *ids, size_t n, int8_t *res)
+{
+  double dSq = soa.clearance * soa.clearance;
+  double qsx = soa.sx[q], qsy = soa.sy[q], qex = soa.ex[q], qey = soa.ey[q];
+  double qvx = qex - qsx, qvy = qey - qsy, qLenSq = qvx * qvx + qvy * qvy;
+  const double *bq = soa.kdop(q);
+  for (size_t k = 0; k < n; ++k)
+  {
+    uint32_t id = ids[k];
+    if (!kdop_overlap<K>(soa.kdop(id), bq))
+    {
+      res[k] = -1;
+      continue;
+    }
+    double sx = soa.sx[id], sy = soa.sy[id], ex = soa.ex[id], ey = soa.ey[id];
+    // gaps between the boxes along x and y (negative when they overlap)
+    double gx = max(min(sx, ex) - max(qsx, qex), min(qsx, qex) - max(sx, ex));
+    double gy = max(min(sy, ey) - max(qsy, qey), min(qsy, qey) - max(sy, ey));
+    gx = max(gx, 0.);
+    gy = max(gy, 0.);
+    if (gx * gx + gy * gy >= dSq)
+    {
+      res[k] = 0;
+      continue;
+    }
+    double vx = ex - sx, vy = ey - sy, lenSq = vx * vx + vy * vy;
+    if (point_seg_dist_sq(qsx, qsy, sx, sy, vx, vy, lenSq) < dSq ||
+        point_seg_dist_sq(qex, qey, sx, sy, vx, vy, lenSq) < dSq ||
+        point_seg_dist_sq(sx, sy, qsx, qsy, qvx, qvy, qLenSq) < dSq ||
+        point_seg_dist_sq(ex, ey, qsx, qsy, qvx, qvy, qLenSq) < dSq)
+    {
+      res[k] = 1;
+      continue;
+    }
+    // no endpoint within reach: near only if they cross
+    double o1 = vx * (qsy - sy) - vy * (qsx - sx);
+    double o2 = vx * (qey - sy) - vy * (qex - sx);
+    double o3 = qvx * (sy - qsy) - qvy * (sx - qsx);
+    double o4 = qvx * (ey - qsy) - qvy * (ex - qsx);
+    res[k] = (o1 < 0.) != (o2 < 0.) && (o3 < 0.) != (o4 < 0.) ? 2 : 0;
+  }
+}
+
+#if LSEG_X86_KERNELS
+
+// direction of the new segment, shared by all lanes
+struct query_seg
+{
+  double vx, vy, lenSq, len;
+
+  query_seg(const seg_soa &soa, uint32_t q)
+  {
+    vx = soa.ex[q] - soa.sx[q];
+    vy = soa.ey[q] - soa.sy[q];
+    lenSq = soa.seg(q).lenSq();
+    len = soa.seg(q).len();
+  }
+};
+
+// Lineseg::dist(P) of the segment (S, E), with v = E - S, its squared
+// length lenSq and length len
+__attribute__((target("avx2"))) static inline __m256d
+dist_avx2(__m256d Sx, __m256d Sy, __m256d Ex, __m256d Ey, __m256d vx,
+          __m256d vy, __m256d lenSq, __m256d len, __m256d Px, __m256d Py)
+{
+  const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(~(1LL << 63)));
+  __m256d dx = _mm256_sub_pd(Sx, Px), dy = _mm256_sub_pd(Sy, Py);
+  __m256d distSsq = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+  dx = _mm256_sub_pd(Ex, Px);
+  dy = _mm256_sub_pd(Ey, Py);
+  __m256d distEsq = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+  __m256d minEnds = _mm256_sqrt_pd(_mm256_min_pd(distSsq, distEsq));
+  __m256d cross = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(Px, Sx), vy),
+                                _mm256_mul_pd(_mm256_sub_pd(Py, Sy), vx));
+  __m256d lineDist = _mm256_div_pd(_mm256_and_pd(cross, absMask), len);
+  __m256d proj = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(Px, Sx), vx),
+                               _mm256_mul_pd(_mm256_sub_pd(Py, Sy), vy));
+  __m256d endsOnly = _mm256_or_pd(
+      _mm256_cmp_pd(len, _mm256_set1_pd(eps), _CMP_LT_OQ),
+      _mm256_or_pd(_mm256_cmp_pd(proj, _mm256_setzero_pd(), _CMP_LT_OQ),
+                   _mm256_cmp_pd(proj, lenSq, _CMP_GT_OQ)));
+  return _mm256_blendv_pd(_mm256_min_pd(lineDist, minEnds), minEnds, endsOnly);
+}
+
+// k-DOP filter of one candidate, with bounds c, against the bounds q of the
+// new segment: the bounds of a segment are contiguous, so they are loaded
+// and compared by whole vectors rather than gathered axis by axis
+template <int K>
+__attribute__((target("avx2"))) static inline bool
+kdop_overlap_avx2(const double *c, const double *q)
+{
+  constexpr int nAxes = kdop_axes<K>::nAxes;
+  if constexpr (nAxes == 2)
+  {
+    __m128d lo = _mm_loadu_pd(c), hi = _mm_loadu_pd(c + 2);
+    return (_mm_movemask_pd(_mm_cmplt_pd(lo, _mm_loadu_pd(q + 2))) &
+            _mm_movemask_pd(_mm_cmpgt_pd(hi, _mm_loadu_pd(q)))) == 3;
+  }
+  else
+  {
+    int bits = 0xf;
+    for (int j = 0; j < nAxes; j += 4)
+    {
+      bits &= _mm256_movemask_pd(_mm256_cmp_pd(
+          _mm256_loadu_pd(c + j), _mm256_loadu_pd(q + nAxes + j), _CMP_LT_OQ));
+      bits &= _mm256_movemask_pd(_mm256_cmp_pd(
+          _mm256_loadu_pd(c + nAxes + j), _mm256_loadu_pd(q + j), _CMP_GT_OQ));
+    }
+    return bits == 0xf;
+  }
+}
+
+// lane mask of the candidates ids[0, nLanes) that pass the k-DOP filter
+template <int K, int nLanes>
+__attribute__((target("avx2"))) static inline int
+kdop_filter_avx2(const seg_soa &soa, const uint32_t *ids, const double *bq)
+{
+  int bits = 0;
+  for (int lane = 0; lane < nLanes; ++lane)
+  {
+    bits |= (int)kdop_overlap_avx2<K>(soa.kdop(ids[lane]), bq) << lane;
+  }
+  return bits;
+}
+
+template <int K>
+__attribute__((target("avx2"))) static void
+intx_batch_avx2(const seg_soa &soa, uint32_t q, const uint32_t *ids, size_t n,
+                int8_t *res)
+{
+  const query_seg qs(soa, q);
+  const double *bq = soa.kdop(q);
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.);
+  const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(~(1LL << 63)));
+  const __m256d s2x = _mm256_set1_pd(soa.sx[q]), s2y = _mm256_set1_pd(soa.sy[q]);
+  const __m256d e2x = _mm256_set1_pd(soa.ex[q]), e2y = _mm256_set1_pd(soa.ey[q]);
+  const __m256d v2x = _mm256_set1_pd(qs.vx), v2y = _mm256_set1_pd(qs.vy);
+  const __m256d lenSq2 = _mm256_set1_pd(qs.lenSq), len2 = _mm256_set1_pd(qs.len);
+
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4)
+  {
+    // filter on the precomputed bounds, before loading the coordinates
+    int filtBits = kdop_filter_avx2<K, 4>(soa, ids + k, bq);
+    if (filtBits == 0)
+    {
+      res[k] = res[k + 1] = res[k + 2] = res[k + 3] = -1;
+      continue;
+    }
+    __m128i vi = _mm_loadu_si128((const __m128i *)(ids + k));
+    __m256d s1x = _mm256_i32gather_pd(soa.sx.data(), vi, 8);
+    __m256d s1y = _mm256_i32gather_pd(soa.sy.data(), vi, 8);
+    __m256d e1x = _mm256_i32gather_pd(soa.ex.data(), vi, 8);
+    __m256d e1y = _mm256_i32gather_pd(soa.ey.data(), vi, 8);
+
+    // transverse case
+    __m256d v1x = _mm256_sub_pd(e1x, s1x), v1y = _mm256_sub_pd(e1y, s1y);
+    __m256d lenSq1 =
+        _mm256_add_pd(_mm256_mul_pd(v1x, v1x), _mm256_mul_pd(v1y, v1y));
+    __m256d len1 = _mm256_sqrt_pd(lenSq1);
+    __m256d D = _mm256_sub_pd(_mm256_mul_pd(v1x, v2y), _mm256_mul_pd(v1y, v2x));
+    __m256d nonPar = _mm256_cmp_pd(
+        _mm256_and_pd(D, absMask),
+        _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(eps), len1), len2),
+        _CMP_GT_OQ);
+    __m256d ppx = _mm256_sub_pd(s2x, s1x), ppy = _mm256_sub_pd(s2y, s1y);
+    __m256d alfa = _mm256_div_pd(
+        _mm256_sub_pd(_mm256_mul_pd(ppx, v2y), _mm256_mul_pd(ppy, v2x)), D);
+    __m256d beta = _mm256_div_pd(
+        _mm256_sub_pd(_mm256_mul_pd(ppx, v1y), _mm256_mul_pd(ppy, v1x)), D);
+    __m256d inBounds = _mm256_and_pd(
+        _mm256_and_pd(nonPar, _mm256_and_pd(_mm256_cmp_pd(alfa, zero, _CMP_GT_OQ),
+                                            _mm256_cmp_pd(alfa, one, _CMP_LT_OQ))),
+        _mm256_and_pd(_mm256_cmp_pd(beta, zero, _CMP_GT_OQ),
+                      _mm256_cmp_pd(beta, one, _CMP_LT_OQ)));
+    int inBits = _mm256_movemask_pd(inBounds);
+
+    // all other cases: min distance between endpoints and the other segment
+    int touchBits = 0;
+    if ((filtBits & ~inBits) != 0)
+    {
+      __m256d l1l2S = dist_avx2(s1x, s1y, e1x, e1y, v1x, v1y, lenSq1, len1, s2x, s2y);
+      __m256d l1l2E = dist_avx2(s1x, s1y, e1x, e1y, v1x, v1y, lenSq1, len1, e2x, e2y);
+      __m256d l2l1S = dist_avx2(s2x, s2y, e2x, e2y, v2x, v2y, lenSq2, len2, s1x, s1y);
+      __m256d l2l1E = dist_avx2(s2x, s2y, e2x, e2y, v2x, v2y, lenSq2, len2, e1x, e1y);
+      __m256d minEnds = _mm256_min_pd(_mm256_min_pd(l1l2E, l1l2S),
+                                      _mm256_min_pd(l2l1E, l2l1S));
+      touchBits = _mm256_movemask_pd(
+          _mm256_cmp_pd(minEnds, _mm256_set1_pd(eps), _CMP_LT_OQ));
+    }
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      int bit = 1 << lane;
+      res[k + lane] = !(filtBits & bit) ? -1
+                      : (inBits & bit)  ? 2
+                      : (touchBits & bit) ? 1
+                                          : 0;
+    }
+  }
+  intx_batch_scalar<K>(soa, q, ids + k, n - k, res + k);
+}
+
+__attribute__((target("avx512f"))) static inline __m512d
+dist_avx512(__m512d Sx, __m512d Sy, __m512d Ex, __m512d Ey, __m512d vx,
+            __m512d vy, __m512d lenSq, __m512d len, __m512d Px, __m512d Py)
+{
+  __m512d dx = _mm512_sub_pd(Sx, Px), dy = _mm512_sub_pd(Sy, Py);
+  __m512d distSsq = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+  dx = _mm512_sub_pd(Ex, Px);
+  dy = _mm512_sub_pd(Ey, Py);
+  __m512d distEsq = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+  __m512d minEnds = _mm512_sqrt_pd(_mm512_min_pd(distSsq, distEsq));
+  __m512d cross = _mm512_sub_pd(_mm512_mul_pd(_mm512_sub_pd(Px, Sx), vy),
+                                _mm512_mul_pd(_mm512_sub_pd(Py, Sy), vx));
+  __m512d lineDist = _mm512_div_pd(_mm512_abs_pd(cross), len);
+  __m512d proj = _mm512_add_pd(_mm512_mul_pd(_mm512_sub_pd(Px, Sx), vx),
+                               _mm512_mul_pd(_mm512_sub_pd(Py, Sy), vy));
+  __mmask8 endsOnly =
+      _mm512_cmp_pd_mask(len, _mm512_set1_pd(eps), _CMP_LT_OQ) |
+      _mm512_cmp_pd_mask(proj, _mm512_setzero_pd(), _CMP_LT_OQ) |
+      _mm512_cmp_pd_mask(proj, lenSq, _CMP_GT_OQ);
+  return _mm512_mask_blend_pd(endsOnly, _mm512_min_pd(lineDist, minEnds),
+                              minEnds);
+}
+
+template <int K>
+__attribute__((target("avx512f"))) static void
+intx_batch_avx512(const seg_soa &soa, uint32_t q, const uint32_t *ids,
+                  size_t n, int8_t *res)
+{
+  const query_seg qs(soa, q);
+  const double *bq = soa.kdop(q);
+  const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1.);
+  const __m512d s2x = _mm512_set1_pd(soa.sx[q]), s2y = _mm512_set1_pd(soa.sy[q]);
+  const __m512d e2x = _mm512_set1_pd(soa.ex[q]), e2y = _mm512_set1_pd(soa.ey[q]);
+  const __m512d v2x = _mm512_set1_pd(qs.vx), v2y = _mm512_set1_pd(qs.vy);
+  const __m512d lenSq2 = _mm512_set1_pd(qs.lenSq), len2 = _mm512_set1_pd(qs.len);
+
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8)
+  {
+    // filter on the precomputed bounds, before loading the coordinates
+    __mmask8 filt = (__mmask8)kdop_filter_avx2<K, 8>(soa, ids + k, bq);
+    if (filt == 0)
+    {
+      for (int lane = 0; lane < 8; ++lane)
+      {
+        res[k + lane] = -1;
+      }
+      continue;
+    }
+    __m256i vi = _mm256_loadu_si256((const __m256i *)(ids + k));
+    __m512d s1x = _mm512_i32gather_pd(vi, soa.sx.data(), 8);
+    __m512d s1y = _mm512_i32gather_pd(vi, soa.sy.data(), 8);
+    __m512d e1x = _mm512_i32gather_pd(vi, soa.ex.data(), 8);
+    __m512d e1y = _mm512_i32gather_pd(vi, soa.ey.data(), 8);
+
+    // transverse case
+    __m512d v1x = _mm512_sub_pd(e1x, s1x), v1y = _mm512_sub_pd(e1y, s1y);
+    __m512d lenSq1 =
+        _mm512_add_pd(_mm512_mul_pd(v1x, v1x), _mm512_mul_pd(v1y, v1y));
+    __m512d len1 = _mm512_sqrt_pd(lenSq1);
+    __m512d D = _mm512_sub_pd(_mm512_mul_pd(v1x, v2y), _mm512_mul_pd(v1y, v2x));
+    __mmask8 inBounds = _mm512_mask_cmp_pd_mask(
+        filt, _mm512_abs_pd(D),
+        _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(eps), len1), len2),
+        _CMP_GT_OQ);
+    __m512d ppx = _mm512_sub_pd(s2x, s1x), ppy = _mm512_sub_pd(s2y, s1y);
+    __m512d alfa = _mm512_div_pd(
+        _mm512_sub_pd(_mm512_mul_pd(ppx, v2y), _mm512_mul_pd(ppy, v2x)), D);
+    __m512d beta = _mm512_div_pd(
+        _mm512_sub_pd(_mm512_mul_pd(ppx, v1y), _mm512_mul_pd(ppy, v1x)), D);
+    inBounds = _mm512_mask_cmp_pd_mask(inBounds, alfa, zero, _CMP_GT_OQ);
+    inBounds = _mm512_mask_cmp_pd_mask(inBounds, alfa, one, _CMP_LT_OQ);
+    inBounds = _mm512_mask_cmp_pd_mask(inBounds, beta, zero, _CMP_GT_OQ);
+    inBounds = _mm512_mask_cmp_pd_mask(inBounds, beta, one, _CMP_LT_OQ);
+
+    // all other cases: min distance between endpoints and the other segment
+    __mmask8 touch = 0;
+    if ((filt & ~inBounds) != 0)
+    {
+      __m512d l1l2S = dist_avx512(s1x, s1y, e1x, e1y, v1x, v1y, lenSq1, len1, s2x, s2y);
+      __m512d l1l2E = dist_avx512(s1x, s1y, e1x, e1y, v1x, v1y, lenSq1, len1, e2x, e2y);
+      __m512d l2l1S = dist_avx512(s2x, s2y, e2x, e2y, v2x, v2y, lenSq2, len2, s1x, s1y);
+      __m512d l2l1E = dist_avx512(s2x, s2y, e2x, e2y, v2x, v2y, lenSq2, len2, e1x, e1y);
+      __m512d minEnds = _mm512_min_pd(_mm512_min_pd(l1l2E, l1l2S),
+                                      _mm512_min_pd(l2l1E, l2l1S));
+      touch = _mm512_cmp_pd_mask(minEnds, _mm512_set1_pd(eps), _CMP_LT_OQ);
+    }
+    for (int lane = 0; lane < 8; ++lane)
+    {
+      int bit = 1 << lane;
+      res[k + lane] = !(filt & bit)     ? -1
+                      : (inBounds & bit) ? 2
+                      : (touch & bit)    ? 1
+                                         : 0;
+    }
+  }
+  intx_batch_scalar<K>(soa, q, ids + k, n - k, res + k);
+}
+
+#endif
+
+BatchIsa intx_batch_best_isa()
+{
+#if LSEG_X86_KERNELS
+  static const BatchIsa best = __builtin_cpu_supports("avx512f") ? BatchIsa::avx512
+                               : __builtin_cpu_supports("avx2")  ? BatchIsa::avx2
+                                                                 : BatchIsa::scalar;
+  return best;
+#else
+  return BatchIsa::scalar;
+#endif
+}
+
+const char *intx_batch_isa_name(BatchIsa isa)
+{
+  switch (isa)
+  {
+  case BatchIsa::avx512:
+    return "avx512";
+  case BatchIsa::avx2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+template <int K>
+static void intx_batch_dirs(const seg_soa &soa, uint32_t q,
+                            const uint32_t *ids, size_t n, int8_t *res,
+                            BatchIsa isa)
+{
+  if (soa.clearance > 0.)
+  {
+    intx_batch_near<K>(soa, q, ids, n, res);
+    return;
+  }
+  if (soa.exact == ExactCoords::int32)
+  {
+    intx_batch_exact<K, int32_t>(soa, q, ids, n, res);
+    return;
+  }
+  if (soa.exact == ExactCoords::int64)
+  {
+    intx_batch_exact<K, int64_t>(soa, q, ids, n, res);
+    return;
+  }
+#if LSEG_X86_KERNELS
+  if (isa == BatchIsa::avx512)
+  {
+    intx_batch_avx512<K>(soa, q, ids, n, res);
+    return;
+  }
+  if (isa == BatchIsa::avx2)
+  {
+    intx_batch_avx2<K>(soa, q, ids, n, res);
+    return;
+  }
+#endif
+  intx_batch_scalar<K>(soa, q, ids, n, res);
+}
+
+void intx_batch(const seg_soa &soa, uint32_t q, const uint32_t *ids, size_t n,
+                int8_t *res, BatchIsa isa)
+{
+  // never run instructions the cpu does not have
+  isa = min(isa, intx_batch_best_isa());
+  switch (soa.nDirs)
+  {
+  case 4:
+    intx_batch_dirs<4>(soa, q, ids, n, res, isa);
+    break;
+  case 16:
+    intx_batch_dirs<16>(soa, q, ids, n, res, isa);
+    break;
+  default:
+    intx_batch_dirs<8>(soa, q, ids, n, res, isa);
+    break;
+  }
+}
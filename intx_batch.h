@@ -0,0 +1,68 @@
+#pragma once
+
+#include "lseg.h"
+#include "lseg_exact.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Batched version of the pair test used by the sweep: one new segment is
+// tested against many active segments. For each pair, the k-DOP filter (see
+// kdop.h) is applied first, and the pairs that pass it are classified
+// exactly like Lineseg::intx(active, new) (same operations in the same
+// order, so the results are bit-for-bit identical).
+
+// structure-of-arrays copy of the segment coordinates, with the k-DOP
+// bounds of each segment, computed once per query
+struct seg_soa
+{
+  vector<double> sx, sy, ex, ey;
+  double tol = 0.; // padding of the bounds
+  int nDirs = 8;   // k-DOP directions: 4, 8 or 16
+  vector<double> bounds; // nDirs per segment
+  // when the coordinates are integers of this type, the pairs that pass the
+  // filter are classified by the exact predicates of lseg_exact.h
+  ExactCoords exact = ExactCoords::none;
+  // when > 0, the pairs that pass the filter are tested for distance
+  // instead (proximity join): res is 2 if they cross, 1 if they are closer
+  // than the clearance, 0 otherwise
+  double clearance = 0.;
+
+  void assign(const vector<Lineseg> &segs, double tol, int nDirs = 8);
+  // n segments (zeros), with the padding and directions of the bounds
+  void init(size_t n, double tol, int nDirs);
+  // keeps the existing segments
+  void resize(size_t n);
+  void set(uint32_t id, double Sx, double Sy, double Ex, double Ey);
+
+  size_t size() const { return sx.size(); }
+  Lineseg seg(uint32_t id) const
+  {
+    return Lineseg(Pnt2(sx[id], sy[id]), Pnt2(ex[id], ey[id]), id);
+  }
+  const double *kdop(uint32_t id) const
+  {
+    return bounds.data() + (size_t)nDirs * id;
+  }
+};
+
+// instruction sets the kernel is available for
+enum class BatchIsa
+{
+  scalar,
+  avx2,
+  avx512
+};
+
+// best instruction set supported by the running cpu
+BatchIsa intx_batch_best_isa();
+const char *intx_batch_isa_name(BatchIsa isa);
+
+// res[k] = -1 if the pair (ids[k], q) is filtered out, otherwise the result of
+// Lineseg::intx(seg(ids[k]), seg(q)), or of IntLineseg::intx with
+// soa.exact, or the distance test of soa.clearance; the filter padding is
+// soa.tol
+void intx_batch(const seg_soa &soa, uint32_t q, const uint32_t *ids, size_t n,
+                int8_t *res, BatchIsa isa);
@@ -0,0 +1,444 @@
+#pragma once
+
+#include "lseg.h"
+#include "lseg_exact.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Streaming output of LsegIntersector::reportIntx: the engines hand every
+// intersecting pair to a reporter, which classifies it and buffers the record
+// until a chunk is full. The count-only engines use no_reporter, which
+// compiles to nothing, anyIntersection any_reporter, which stops the query
+// at the first pair (reporters with stops check done() as they go),
+// nodeSegs node_reporter, which keeps the split points of each segment, and
+// the workers of numIntx_tiled tile_reporter, which only counts the pairs of
+// their tile.
+
+// the kinds of contact between two segments
+enum class IntxType : uint8_t
+{
+  transverse,
+  touch,  // single point, at an endpoint of one of the segments
+  overlap // collinear segments sharing a length > eps
+};
+
+// One intersection; id1 and id2 are the Lineseg ids, id1 belonging to the
+// segment added first. alfa and beta are the parameters of the intersection
+// point along each segment (0 at S, 1 at E); for touches and overlaps, that
+// is the contact point closest to S of the first segment.
+struct IntxRecord
+{
+  uint32_t id1, id2;
+  IntxType type;
+  double alfa, beta;
+};
+
+// receives the records by chunks; thread is the index of the calling thread
+using IntxSink =
+    function<void(const IntxRecord *records, size_t n, int thread)>;
+
+// One pair of a proximity join (LsegIntersector::proximityJoin): the ids as
+// in IntxRecord, their distance, and the parameters of a pair of closest
+// points, alfa along id1 and beta along id2.
+struct NearRecord
+{
+  uint32_t id1, id2;
+  double dist, alfa, beta;
+};
+
+using NearSink =
+    function<void(const NearRecord *records, size_t n, int thread)>;
+
+// Predicates the reporters classify a pair with: those of the pair kernel
+// that found it (see intx_batch.h), so that every pair it counts gives a
+// record or split points. With exact, the exact tests of lseg_exact.h on
+// integer coordinates; otherwise Lineseg::intx, endpoints within tol of the
+// other segment being contacts.
+struct pair_predicates
+{
+  ExactCoords exact = ExactCoords::none;
+  double tol = eps;
+};
+
+// Lineseg::intx<intx_full>(l1, l2, params) with these predicates
+inline int pair_intx(const Lineseg &l1, const Lineseg &l2,
+                     const pair_predicates &preds, double params[2])
+{
+  if (preds.exact == ExactCoords::none)
+    return Lineseg::intx<intx_full>(l1, l2, params, preds.tol);
+  // the coordinates are below exactLimit, int64_t holds both types
+  IntLineseg<int64_t> i1, i2;
+  to_int_lineseg(l1, i1);
+  to_int_lineseg(l2, i2);
+  int res = IntLineseg<int64_t>::intx(i1, i2);
+  if (res == 2)
+    IntLineseg<int64_t>::crossing_params(i1, i2, params);
+  return res;
+}
+
+// contact points of a touching or overlapping pair: f(a, b, P) for each
+// endpoint P of one segment on the other, a and b being the parameters of P
+// along l1 and l2
+template <class F>
+void for_each_contact(const Lineseg &l1, const Lineseg &l2,
+                      const pair_predicates &preds, F &&f)
+{
+  auto on = [&](const Lineseg &l, const Pnt2 &P)
+  {
+    if (preds.exact == ExactCoords::none)
+      return l.dist(P) < preds.tol;
+    IntLineseg<int64_t> il;
+    to_int_lineseg(l, il);
+    IntPnt2<int64_t> iP = {(int64_t)P.x, (int64_t)P.y};
+    return IntLineseg<int64_t>::orient(il.S, il.E, iP) == 0 &&
+           IntLineseg<int64_t>::on_segment(il.S, il.E, iP);
+  };
+  if (on(l1, l2.S))
+    f(l1.param(l2.S), 0., l2.S);
+  if (on(l1, l2.E))
+    f(l1.param(l2.E), 1., l2.E);
+  if (on(l2, l1.S))
+    f(0., l2.param(l1.S), l1.S);
+  if (on(l2, l1.E))
+    f(1., l2.param(l1.E), l1.E);
+}
+
+// record of a pair for which pair_intx(l1, l2, preds, params) returned res;
+// a pair those predicates do not find touching (res <= 0, from other ones)
+// is listed as a touch at its closest points
+inline IntxRecord
+make_intx_record(const Lineseg &l1, const Lineseg &l2, int res,
+                 const double params[2],
+                 const pair_predicates &preds = pair_predicates())
+{
+  IntxRecord rec = {l1.id, l2.id, IntxType::transverse, 0., 0.};
+  if (res == 2)
+  {
+    rec.alfa = params[0];
+    rec.beta = params[1];
+    return rec;
+  }
+  // contact points: endpoints of one segment on the other one
+  const double inf = numeric_limits<double>::infinity();
+  double aLo = inf, aHi = -inf, bLo = inf, bHi = -inf;
+  rec.alfa = inf;
+  rec.type = IntxType::touch;
+  for_each_contact(l1, l2, preds, [&](double a, double b, const Pnt2 &)
+  {
+    if (a < rec.alfa)
+    {
+      rec.alfa = a;
+      rec.beta = b;
+    }
+    aLo = min(aLo, a);
+    aHi = max(aHi, a);
+    bLo = min(bLo, b);
+    bHi = max(bHi, b);
+  });
+  if (rec.alfa == inf)
+  {
+    double closest[2];
+    l1.dist(l2, closest);
+    rec.alfa = closest[0];
+    rec.beta = closest[1];
+    return rec;
+  }
+  // an overlap shares a length above the tolerance, or any length with
+  // exact predicates
+  double minLen = preds.exact == ExactCoords::none ? preds.tol : 0.;
+  if ((aHi - aLo) * l1.len() > minLen || (bHi - bLo) * l2.len() > minLen)
+    rec.type = IntxType::overlap;
+  return rec;
+}
+
+// point where segment is is split by another one, at parameter t along it
+struct split_point
+{
+  uint32_t is;
+  double t;
+  Pnt2 P;
+};
+
+// box of a segment, padded by the tolerance, and grid of the tiles of
+// LsegIntersector::numIntx_tiled (lseg_tiles.cpp)
+struct tile_box
+{
+  double x0, y0, x1, y1;
+};
+
+struct tile_grid
+{
+  double x0 = 0., y0 = 0., w = 1., h = 1.;
+  int nx = 1, ny = 1;
+
+  int tile_x(double x) const
+  {
+    return min(max((int)floor((x - x0) / w), 0), nx - 1);
+  }
+  int tile_y(double y) const
+  {
+    return min(max((int)floor((y - y0) / h), 0), ny - 1);
+  }
+};
+
+// one tile of numIntx_tiled: a pair found in several tiles is only counted
+// in the tile of its reference point, the lower-left corner of the
+// intersection of the boxes of its segments
+struct tile_ref
+{
+  const vector<tile_box> *boxes; // by Lineseg id
+  const tile_grid *grid;
+  size_t tile; // index in the grid, row by row
+
+  bool owns(uint32_t id1, uint32_t id2) const
+  {
+    const auto &b1 = (*boxes)[id1], &b2 = (*boxes)[id2];
+    int tx = grid->tile_x(max(b1.x0, b2.x0));
+    int ty = grid->tile_y(max(b1.y0, b2.y0));
+    return (size_t)ty * grid->nx + tx == tile;
+  }
+};
+
+// where the records of one query go
+struct report_target
+{
+  const vector<Lineseg> *segs;
+  const IntxSink *sink;
+  mutex *sinkLock; // nullptr when the sink may be called concurrently
+  size_t chunkSize;
+  atomic<bool> *stop = nullptr; // set when the query is over (any_reporter)
+  // split points of each thread, by thread index (node_reporter)
+  vector<vector<split_point>> *splits = nullptr;
+  // distance of a proximity join, and where its pairs go (near_reporter)
+  double clearance = 0.;
+  const NearSink *nearSink = nullptr;
+  // tile of a tiled count, and the pairs counted in it (tile_reporter)
+  const tile_ref *tile = nullptr;
+  atomic<int64_t> *nTilePairs = nullptr;
+  // predicates of the query; the engines run the kernel with preds.exact
+  pair_predicates preds;
+};
+
+// record of the pair found by the engines, with the same argument order as
+// the kernel (see intx_batch.h); the record lists the earlier segment first
+inline IntxRecord pair_record(const report_target &target, uint32_t iActive,
+                              uint32_t iNew)
+{
+  const auto &segs = *target.segs;
+  double params[2];
+  int res = pair_intx(segs[iActive], segs[iNew], target.preds, params);
+  if (iActive > iNew)
+  {
+    swap(iActive, iNew);
+    swap(params[0], params[1]);
+  }
+  return make_intx_record(segs[iActive], segs[iNew], res, params,
+                          target.preds);
+}
+
+// buffers the records found by one thread
+struct intx_reporter
+{
+  static constexpr bool enabled = true;
+  static constexpr bool stops = false;
+
+  const report_target *target;
+  int thread;
+  vector<IntxRecord> chunk;
+
+  intx_reporter(const report_target *target, int thread)
+      : target(target), thread(thread)
+  {
+    chunk.reserve(target->chunkSize);
+  }
+
+  void add(uint32_t iActive, uint32_t iNew)
+  {
+    chunk.push_back(pair_record(*target, iActive, iNew));
+    if (chunk.size() == target->chunkSize)
+      flush();
+  }
+  bool done() const { return false; }
+
+  void flush()
+  {
+    if (chunk.empty())
+      return;
+    if (target->sinkLock != nullptr)
+    {
+      lock_guard<mutex> lock(*target->sinkLock);
+      (*target->sink)(chunk.data(), chunk.size(), thread);
+    }
+    else
+    {
+      (*target->sink)(chunk.data(), chunk.size(), thread);
+    }
+    chunk.clear();
+  }
+};
+
+// count-only queries
+struct no_reporter
+{
+  static constexpr bool enabled = false;
+  static constexpr bool stops = false;
+
+  no_reporter(const report_target *, int) {}
+  void add(uint32_t, uint32_t) {}
+  bool done() const { return false; }
+  void flush() {}
+};
+
+// anyIntersection: the first pair found, by any thread, sets target->stop
+// and goes to the sink as a single record; the other threads see stop and
+// end their sweep
+struct any_reporter
+{
+  static constexpr bool enabled = true;
+  static constexpr bool stops = true;
+
+  const report_target *target;
+  int thread;
+
+  any_reporter(const report_target *target, int thread)
+      : target(target), thread(thread)
+  {
+  }
+  void add(uint32_t iActive, uint32_t iNew)
+  {
+    if (target->stop->exchange(true))
+      return;
+    IntxRecord rec = pair_record(*target, iActive, iNew);
+    (*target->sink)(&rec, 1, thread);
+  }
+  bool done() const { return target->stop->load(memory_order_relaxed); }
+  void flush() {}
+};
+
+// proximityJoin: buffers the near pairs found by one thread, when there is
+// a sink for them
+struct near_reporter
+{
+  static constexpr bool enabled = true;
+  static constexpr bool stops = false;
+
+  const report_target *target;
+  int thread;
+  vector<NearRecord> chunk;
+
+  near_reporter(const report_target *target, int thread)
+      : target(target), thread(thread)
+  {
+    if (target->nearSink != nullptr)
+      chunk.reserve(target->chunkSize);
+  }
+
+  // the record lists the earlier segment first
+  void add(uint32_t iActive, uint32_t iNew)
+  {
+    if (target->nearSink == nullptr)
+      return;
+    if (iActive > iNew)
+      swap(iActive, iNew);
+    const auto &l1 = (*target->segs)[iActive], &l2 = (*target->segs)[iNew];
+    double params[2];
+    double dist = l1.dist(l2, params);
+    chunk.push_back(NearRecord{l1.id, l2.id, dist, params[0], params[1]});
+    if (chunk.size() == target->chunkSize)
+      flush();
+  }
+  bool done() const { return false; }
+
+  void flush()
+  {
+    if (chunk.empty())
+      return;
+    if (target->sinkLock != nullptr)
+    {
+      lock_guard<mutex> lock(*target->sinkLock);
+      (*target->nearSink)(chunk.data(), chunk.size(), thread);
+    }
+    else
+    {
+      (*target->nearSink)(chunk.data(), chunk.size(), thread);
+    }
+    chunk.clear();
+  }
+};
+
+// numIntx_tiled: the pairs of the tile found by one thread, counted without
+// a record
+struct tile_reporter
+{
+  static constexpr bool enabled = true;
+  static constexpr bool stops = false;
+
+  const report_target *target;
+  int64_t nPairs = 0;
+
+  tile_reporter(const report_target *target, int) : target(target) {}
+  void add(uint32_t iActive, uint32_t iNew)
+  {
+    const auto &segs = *target->segs;
+    nPairs += target->tile->owns(segs[iActive].id, segs[iNew].id);
+  }
+  bool done() const { return false; }
+  void flush()
+  {
+    *target->nTilePairs += nPairs;
+    nPairs = 0;
+  }
+};
+
+// nodeSegs: the points where each pair meets, added to the split points of
+// both segments. A transverse pair gives its crossing, computed once for
+// both, and a touching or overlapping pair its contact points, which are
+// input endpoints, so that a point shared by several segments comes out
+// with the same coordinates for all of them.
+struct node_reporter
+{
+  static constexpr bool enabled = true;
+  static constexpr bool stops = false;
+
+  const report_target *target;
+  vector<split_point> &splits;
+
+  node_reporter(const report_target *target, int thread)
+      : target(target), splits((*target->splits)[thread])
+  {
+  }
+  void add(uint32_t iActive, uint32_t iNew)
+  {
+    // the same pair gives the same point whichever engine finds it
+    if (iActive > iNew)
+      swap(iActive, iNew);
+    const auto &l1 = (*target->segs)[iActive], &l2 = (*target->segs)[iNew];
+    double params[2];
+    if (pair_intx(l1, l2, target->preds, params) == 2)
+    {
+      Pnt2 P(l1.S.x + params[0] * (l1.E.x - l1.S.x),
+             l1.S.y + params[0] * (l1.E.y - l1.S.y));
+      splits.push_back(split_point{iActive, params[0], P});
+      splits.push_back(split_point{iNew, params[1], P});
+      return;
+    }
+    for_each_contact(l1, l2, target->preds,
+                     [&](double a, double b, const Pnt2 &P)
+    {
+      splits.push_back(split_point{iActive, a, P});
+      splits.push_back(split_point{iNew, b, P});
+    });
+  }
+  bool done() const { return false; }
+  void flush() {}
+};
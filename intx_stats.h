@@ -0,0 +1,203 @@
+#pragma once
+
+#include "sweep_axis.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Statistics of one query of LsegIntersector (see LsegIntersector::stats):
+// time per stage and counters describing how hard the input was for the
+// engine. They are gathered when LSEG_STATS is nonzero; otherwise (the
+// default) intx_stats is an empty struct, its counters are constant zeros
+// and the engines compile without any instrumentation.
+
+#ifndef LSEG_STATS
+#define LSEG_STATS 0
+#endif
+
+// stages of a query; for the grid, build is the binning and sweep the scan of
+// the cells, for numIntx_stream build also sorts the runs and sort merges them
+enum class IntxStage
+{
+  build,       // interval ends, boxes, coordinate arrays
+  sort,        // ordering the events
+  sweep,       // broad phase, without the pair tests
+  exact_tests, // pair kernel: filter and exact test
+};
+
+const int nIntxStages = 4;
+
+inline const char *intx_stage_name(IntxStage stage)
+{
+  switch (stage)
+  {
+  case IntxStage::build:
+    return "build";
+  case IntxStage::sort:
+    return "sort";
+  case IntxStage::sweep:
+    return "sweep";
+  case IntxStage::exact_tests:
+  default:
+    return "exact_tests";
+  }
+}
+
+template <bool Enabled> struct basic_intx_stats;
+
+template <> struct basic_intx_stats<true>
+{
+  static constexpr bool enabled = true;
+  using clock = chrono::steady_clock;
+
+  // thread time, summed over the threads of the query
+  double stageMs[nIntxStages] = {};
+  uint64_t nEvents = 0;
+  // pairs listed by the broad phase, and the ones that passed the y and
+  // diagonal filter
+  uint64_t nCandidates = 0, nPassed = 0;
+  // passed pairs by result of Lineseg::intx: none, contact, transverse.
+  // Touches and overlaps share the contact bucket, as the pair kernel does
+  // not tell them apart
+  uint64_t nByResult[3] = {};
+  // size of the active set (or status) when a segment is inserted
+  uint64_t maxActive = 0, nActiveSamples = 0;
+  double sumActive = 0.;
+  // the clock costs about as much as a small batch of pairs, so only one
+  // batch in exactSampling is timed, and the time per pair of those is
+  // applied to the others
+  static const uint64_t exactSampling = 16;
+  uint64_t nBatches = 0, nSampledPairs = 0;
+  double sampledMs = 0.;
+  // axis of the sweep, and with SweepAxis::automatic the estimated mean
+  // active set of each candidate axis (see sweep_axis.h)
+  SweepAxis sweepAxis = SweepAxis::x;
+  double axisEstimates[nSweepAxes] = {};
+
+  double meanActive() const
+  {
+    return nActiveSamples > 0 ? sumActive / nActiveSamples : 0.;
+  }
+
+  void reset() { *this = basic_intx_stats(); }
+
+  clock::time_point start() const { return clock::now(); }
+  // nThreads: threads busy since t0, for thread time
+  void stop(IntxStage stage, clock::time_point t0, int nThreads = 1)
+  {
+    stageMs[(int)stage] +=
+        nThreads * chrono::duration<double, milli>(clock::now() - t0).count();
+  }
+  // time of a nested stage, counted in it rather than in the enclosing one:
+  // exclude(outer, inner, mark(inner)) around the enclosing stage
+  double mark(IntxStage inner) const { return stageMs[(int)inner]; }
+  void exclude(IntxStage outer, IntxStage inner, double innerMark)
+  {
+    stageMs[(int)outer] -= stageMs[(int)inner] - innerMark;
+  }
+
+  // runs test(), the pair kernel on n pairs
+  template <class F> void time_exact(size_t n, F &&test)
+  {
+    if (nBatches++ % exactSampling != 0)
+    {
+      test();
+      if (nSampledPairs > 0)
+        stageMs[(int)IntxStage::exact_tests] += n * sampledMs / nSampledPairs;
+      return;
+    }
+    auto t0 = clock::now();
+    test();
+    double ms = chrono::duration<double, milli>(clock::now() - t0).count();
+    stageMs[(int)IntxStage::exact_tests] += ms;
+    sampledMs += ms;
+    nSampledPairs += n;
+  }
+
+  void set_axis(SweepAxis axis, const double *estimates)
+  {
+    sweepAxis = axis;
+    copy(estimates, estimates + nSweepAxes, axisEstimates);
+  }
+  void add_events(size_t n) { nEvents += n; }
+  void note_active(size_t n)
+  {
+    maxActive = max(maxActive, (uint64_t)n);
+    sumActive += (double)n;
+    ++nActiveSamples;
+  }
+  // n candidates and their results, as given by intx_batch
+  void add_pairs(const int8_t *res, size_t n)
+  {
+    nCandidates += n;
+    for (size_t k = 0; k < n; ++k)
+    {
+      if (res[k] >= 0)
+      {
+        ++nPassed;
+        ++nByResult[res[k]];
+      }
+    }
+  }
+  // one pair tested without a filter
+  void add_pair(int res)
+  {
+    ++nCandidates;
+    ++nPassed;
+    ++nByResult[res];
+  }
+
+  void merge(const basic_intx_stats &other)
+  {
+    for (int s = 0; s < nIntxStages; ++s)
+    {
+      stageMs[s] += other.stageMs[s];
+    }
+    nEvents += other.nEvents;
+    nCandidates += other.nCandidates;
+    nPassed += other.nPassed;
+    for (int r = 0; r < 3; ++r)
+    {
+      nByResult[r] += other.nByResult[r];
+    }
+    maxActive = max(maxActive, other.maxActive);
+    nActiveSamples += other.nActiveSamples;
+    sumActive += other.sumActive;
+    nBatches += other.nBatches;
+    nSampledPairs += other.nSampledPairs;
+    sampledMs += other.sampledMs;
+  }
+};
+
+template <> struct basic_intx_stats<false>
+{
+  static constexpr bool enabled = false;
+
+  static constexpr double stageMs[nIntxStages] = {};
+  static constexpr uint64_t nEvents = 0;
+  static constexpr uint64_t nCandidates = 0, nPassed = 0;
+  static constexpr uint64_t nByResult[3] = {};
+  static constexpr uint64_t maxActive = 0, nActiveSamples = 0;
+  static constexpr double sumActive = 0.;
+  static constexpr SweepAxis sweepAxis = SweepAxis::x;
+  static constexpr double axisEstimates[nSweepAxes] = {};
+
+  double meanActive() const { return 0.; }
+  void reset() {}
+  int start() const { return 0; }
+  void stop(IntxStage, int, int = 1) {}
+  double mark(IntxStage) const { return 0.; }
+  void exclude(IntxStage, IntxStage, double) {}
+  template <class F> void time_exact(size_t, F &&test) { test(); }
+  void set_axis(SweepAxis, const double *) {}
+  void add_events(size_t) {}
+  void note_active(size_t) {}
+  void add_pairs(const int8_t *, size_t) {}
+  void add_pair(int) {}
+  void merge(const basic_intx_stats &) {}
+};
+
+using intx_stats = basic_intx_stats<LSEG_STATS != 0>;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+// Discrete oriented polytopes (k-DOPs) used by the pair filter of
+// intx_batch: the extent of a segment along K / 2 fixed axes, padded by the
+// tolerance. Two segments within tol of each other overlap along every axis,
+// so a gap along any axis rules the pair out. More directions hug the
+// segments more tightly, at the cost of more bounds per segment:
+//  - 4: x and y, the bounding box
+//  - 8: adds both diagonals, x + y and x - y
+//  - 16: adds x + 2y, x - 2y, 2x + y and 2x - y
+// The axes are not normalized, which keeps the projections to small integer
+// multiples; the padding along (a, b) is tol * (|a| + |b|), which covers
+// tol * sqrt(a^2 + b^2).
+//
+// The bounds of a segment are stored as K doubles: the K / 2 lower bounds,
+// then the K / 2 upper bounds.
+
+template <int K> struct kdop_axes;
+
+template <> struct kdop_axes<4>
+{
+  static constexpr int nAxes = 2;
+  static constexpr double a[nAxes] = {1., 0.};
+  static constexpr double b[nAxes] = {0., 1.};
+};
+
+template <> struct kdop_axes<8>
+{
+  static constexpr int nAxes = 4;
+  static constexpr double a[nAxes] = {1., 0., 1., 1.};
+  static constexpr double b[nAxes] = {0., 1., 1., -1.};
+};
+
+template <> struct kdop_axes<16>
+{
+  static constexpr int nAxes = 8;
+  static constexpr double a[nAxes] = {1., 0., 1., 1., 1., 1., 2., 2.};
+  static constexpr double b[nAxes] = {0., 1., 1., -1., 2., -2., 1., -1.};
+};
+
+// supported number of directions closest to k (at least k, up to 16)
+inline int kdop_directions(int k) { return k <= 4 ? 4 : k <= 8 ? 8 : 16; }
+
+// bounds of the segment (S, E), padded by tol
+template <int K>
+inline void kdop_bounds(double Sx, double Sy, double Ex, double Ey,
+                        double tol, double *bounds)
+{
+  using axes = kdop_axes<K>;
+#pragma GCC unroll 8
+  for (int j = 0; j < axes::nAxes; ++j)
+  {
+    double pS = axes::a[j] * Sx + axes::b[j] * Sy;
+    double pE = axes::a[j] * Ex + axes::b[j] * Ey;
+    double pad = tol * (fabs(axes::a[j]) + fabs(axes::b[j]));
+    bounds[j] = min(pS, pE) - pad;
+    bounds[axes::nAxes + j] = max(pS, pE) + pad;
+  }
+}
+
+// true if the bounds overlap along every axis; the test is unrolled over the
+// axes
+template <int K>
+inline bool kdop_overlap(const double *bounds1, const double *bounds2)
+{
+  constexpr int nAxes = kdop_axes<K>::nAxes;
+  return [&]<size_t... J>(index_sequence<J...>)
+  {
+    return ((bounds1[nAxes + J] > bounds2[J] &&
+             bounds1[J] < bounds2[nAxes + J]) &&
+            ...);
+  }(make_index_sequence<nAxes>());
+}
@@ -57,6 +57,30 @@ static bool test_intx5() // no intersection
   return pass;
 }
 
+static bool test_intx6() // no intersection (collinear, disjoint)
+{
+  cout << "Testing no intx (collinear)\n";
+  // l2 lies on the extension of l1: only the bounded distance tells them
+  // apart from a touch
+  Lineseg l1(Pnt2{0., 0.}, Pnt2(1., 0.));
+  Lineseg l2(Pnt2{2., 0.}, Pnt2(3., 0.));
+  double params[2];
+  bool pass = Lineseg::intx(l1, l2, params) == 0 &&
+              l1.dist(l2.S) == 1. && l1.dist(l2.S, false) == 0.;
+  cout << "dist = " << l1.dist(l2.S) << ", to the line "
+       << l1.dist(l2.S, false) << "\n";
+  return pass;
+}
+
+static bool test_intx7() // overlap intersection (collinear)
+{
+  cout << "Testing overlap intx\n";
+  Lineseg l1(Pnt2{0., 0.}, Pnt2(2., 0.));
+  Lineseg l2(Pnt2{1., 0.}, Pnt2(3., 0.));
+  double params[2];
+  return Lineseg::intx(l1, l2, params) == 1;
+}
+
 void test_lineseg_intx()
 {
   bool test1_result = test_intx1();
@@ -69,4 +93,8 @@ void test_lineseg_intx()
   cout << "test_intx4() ==> " << (test4_result ? "Pass" : "Fail") << endl;
   bool test5_result = test_intx5();
   cout << "test_intx5() ==> " << (test5_result ? "Pass" : "Fail") << endl;
+  bool test6_result = test_intx6();
+  cout << "test_intx6() ==> " << (test6_result ? "Pass" : "Fail") << endl;
+  bool test7_result = test_intx7();
+  cout << "test_intx7() ==> " << (test7_result ? "Pass" : "Fail") << endl;
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <iostream>
 
@@ -19,6 +21,7 @@ struct Pnt2 {
   Pnt2() : x(0.), y(0.) {}
   Pnt2(double x, double y) : x(x), y(y) {}
   Pnt2(const Pnt2 &P) : x(P.x), y(P.y) {}
+  Pnt2 &operator=(const Pnt2 &) = default;
 
   double distSq(const Pnt2 &P) const {
     return (x - P.x) * (x - P.x) + (y - P.y) * (y - P.y);
@@ -44,6 +47,18 @@ struct Vec2 {
   }
 };
 
+// outputs of Lineseg::intx<Policy>, chosen at compile time so that the
+// engines run the leanest test their query needs
+template <bool Params, bool Type, bool Debug = false> struct intx_policy {
+  static constexpr bool params = Params; // alfa and beta, when transverse
+  static constexpr bool type = Type;     // transverse (2) vs touch (1)
+  static constexpr bool debug = Debug;   // trace to cout
+};
+using intx_full = intx_policy<true, true>;
+using intx_debug = intx_policy<true, true, true>;
+using intx_type = intx_policy<false, true>; // classification, no params
+using intx_bool = intx_policy<false, false>; // 1 if they intersect
+
 struct Lineseg {
   Pnt2 S;
   Pnt2 E;
@@ -51,72 +66,170 @@ struct Lineseg {
 
   Lineseg() : S(), E(), id(0) {}
   Lineseg(const Lineseg &Seg) : S(Seg.S), E(Seg.E), id(Seg.id) {}
+  Lineseg &operator=(const Lineseg &) = default;
   Lineseg(const Pnt2 &P, const Pnt2 &Q, uint32_t id = 0) : S(P), E(Q), id(id) {}
 
   double lenSq() const { return S.distSq(E); }
   double len() const { return sqrt(lenSq()); }
 
-  // distance to a point
+  // distance to a point: to the segment when bounded (the closest end when
+  // P projects outside of it), else to its line
   // TBD: return closest parameter
   double dist(const Pnt2 &P, bool bounded = true) const {
+    return dist(P, len(), bounded);
+  }
+  // the same, with the length of the segment already known
+  double dist(const Pnt2 &P, double length, bool bounded = true) const {
     const double eps = 1.e-12; // could/should be exposed
 
     double distSsq = S.distSq(P);
     double distEsq = E.distSq(P);
     double minEnds = sqrt(min(distEsq, distSsq));
-    if (len() < eps) {
+    if (length < eps) {
       return minEnds; // regardless of bounded option
     }
-    return min(minEnds, abs(Vec2::CrossZ(Vec2(S, P), Vec2(S, E))) / len());
+    // the distance to the line only counts if P projects inside the segment
+    double proj = Vec2(S, P).dot(Vec2(S, E));
+    if (bounded && (proj < 0. || proj > lenSq())) {
+      return minEnds;
+    }
+    return min(minEnds, abs(Vec2::CrossZ(Vec2(S, P), Vec2(S, E))) / length);
+  }
+
+  // dist(P, length) < tol, without the square root and the division when
+  // P is clearly farther: the margin covers their rounding, so the answer
+  // is always the one of dist
+  bool within(const Pnt2 &P, double length, double tol) const {
+    const double margin = 1. + 1.e-10;
+    double tolSq = tol * tol * margin;
+    if (S.distSq(P) > tolSq && E.distSq(P) > tolSq) {
+      if (length < 1.e-12)
+        return false;
+      double proj = Vec2(S, P).dot(Vec2(S, E));
+      if (proj < 0. || proj > lenSq() ||
+          fabs(Vec2::CrossZ(Vec2(S, P), Vec2(S, E))) > tol * length * margin)
+        return false;
+    }
+    return dist(P, length) < tol;
+  }
+
+  // parameter of the projection of P, clamped to the segment [0, 1]
+  double param(const Pnt2 &P) const {
+    double lSq = lenSq();
+    if (lSq < eps * eps) {
+      return 0.;
+    }
+    return min(max(Vec2(S, P).dot(Vec2(S, E)) / lSq, 0.), 1.);
+  }
+
+  // point at parameter t (S at 0, E at 1)
+  Pnt2 at(double t) const {
+    return Pnt2(S.x + t * (E.x - S.x), S.y + t * (E.y - S.y));
+  }
+
+  // Distance to the segment L, with no tolerance, and in params (when
+  // given) the parameters of a pair of closest points along this segment
+  // and along L. Segments that cross are at 0; otherwise the distance is
+  // that of an endpoint of one of them to the other.
+  double dist(const Lineseg &L, double params[2] = nullptr) const {
+    Vec2 v1(S, E), v2(L.S, L.E);
+    double D = Vec2::CrossZ(v1, v2);
+    double alfa = 0., beta = 0., best = -1.;
+    if (D != 0.) {
+      Vec2 PP(S, L.S);
+      alfa = Vec2::CrossZ(PP, v2) / D;
+      beta = Vec2::CrossZ(PP, v1) / D;
+      if (alfa >= 0. && alfa <= 1. && beta >= 0. && beta <= 1.)
+        best = 0.;
+    }
+    auto closer = [&](double t, double u, double d) {
+      if (best < 0. || d < best) {
+        best = d;
+        alfa = t;
+        beta = u;
+      }
+    };
+    if (best != 0.) {
+      double t = param(L.S);
+      closer(t, 0., at(t).dist(L.S));
+      t = param(L.E);
+      closer(t, 1., at(t).dist(L.E));
+      t = L.param(S);
+      closer(0., t, L.at(t).dist(S));
+      t = L.param(E);
+      closer(1., t, L.at(t).dist(E));
+    }
+    if (params != nullptr) {
+      params[0] = alfa;
+      params[1] = beta;
+    }
+    return best;
   }
 
   // all cases are handled:
   // - transverse (not parallel) if applicable
   // - all remaining cases are covered by min distance between point and line
   // segment
+  // Traces to cout when dbg is set.
   static int intx(const Lineseg &l1, const Lineseg &l2, double params[2],
                   double tol = eps) {
+    return dbg ? intx<intx_debug>(l1, l2, params, tol)
+               : intx<intx_full>(l1, l2, params, tol);
+  }
+
+  // Same classification, computing only what Policy asks for (see
+  // intx_policy): without params they are not written (params may be
+  // nullptr), without type any intersection returns 1. The endpoint
+  // distances are evaluated one at a time and the first one within tol
+  // decides, which gives the same result as their minimum.
+  template <class Policy>
+  static int intx(const Lineseg &l1, const Lineseg &l2, double params[2],
+                  double tol = eps) {
+    const int touch = 1, transverse = Policy::type ? 2 : 1;
+    double len1 = l1.len(), len2 = l2.len();
     // handle general transverse case
-    bool inBounds = false;
     double D = Vec2::CrossZ(Vec2(l1.S, l1.E), Vec2(l2.S, l2.E));
-    if (dbg)
+    if constexpr (Policy::debug)
       cout << "D = " << D << endl;
-    if (fabs(D) > eps * l1.len() * l2.len()) // not parallel
+    if (fabs(D) > eps * len1 * len2) // not parallel
     {
       Vec2 PP(l1.S, l2.S);
       double alfa = Vec2::CrossZ(PP, Vec2(l2.S, l2.E)) / D;
       double beta = Vec2::CrossZ(PP, Vec2(l1.S, l1.E)) / D;
-      if (dbg)
+      if constexpr (Policy::debug)
         cout << "alfa = " << alfa << ", beta = " << beta << endl;
-      if (params != nullptr) {
-        params[0] = alfa;
-        params[1] = beta;
+      if constexpr (Policy::params) {
+        if (params != nullptr) {
+          params[0] = alfa;
+          params[1] = beta;
+        }
       }
       // using strict inequality because boundary cases are handled
       // by min distance in next block
-      inBounds |= (alfa > 0. && alfa < 1. && beta > 0. && beta < 1.);
-    } else {
-      if (dbg) {
-        cout << "Segments are parallel or degenerate\n";
+      if (alfa > 0. && alfa < 1. && beta > 0. && beta < 1.) {
+        if constexpr (Policy::debug)
+          cout << "transverse intersection\n";
+        return transverse;
       }
+    } else if constexpr (Policy::debug) {
+      cout << "Segments are parallel or degenerate\n";
     }
     // all other cases are covered by min distance between one segment endpoint
     // and the other segment
-    if (!inBounds) {
+    if constexpr (Policy::debug) {
       double l1l2S = l1.dist(l2.S), l1l2E = l1.dist(l2.E);
       double l2l1S = l2.dist(l1.S), l2l1E = l2.dist(l1.E);
       double minEnds = min(min(l1l2S, l1l2E), min(l2l1S, l2l1E));
-      if (dbg) {
-        cout << "l1l2S = " << l1l2S << ", l1l2E = " << l1l2E << endl;
-        cout << "l2l1S = " << l2l1S << ", l2l1E = " << l2l1E << endl;
-        cout << "minEnds = " << minEnds << endl;
-      }
-      return minEnds < tol ? 1 : 0;
-    }
-    if (dbg) {
-      cout << "transverse intersection\n";
+      cout << "l1l2S = " << l1l2S << ", l1l2E = " << l1l2E << endl;
+      cout << "l2l1S = " << l2l1S << ", l2l1E = " << l2l1E << endl;
+      cout << "minEnds = " << minEnds << endl;
+      return minEnds < tol ? touch : 0;
+    } else {
+      return l1.within(l2.S, len1, tol) || l1.within(l2.E, len1, tol) ||
+                     l2.within(l1.S, len2, tol) || l2.within(l1.E, len2, tol)
+                 ? touch
+                 : 0;
     }
-    return 2;
   }
 };
 
@@ -0,0 +1,389 @@
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <set>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Bentley-Ottmann sweep, used as a reference engine for numIntx.
+ *
+ * The status structure is a std::set (red-black tree) of segment indices,
+ * ordered by their y-coordinate at the current sweep position, and the event
+ * queue holds the segment endpoints and the crossings found so far.
+ * Each time two segments become adjacent in the status they are tested with
+ * Lineseg::intx; transverse intersections that lie ahead of the sweep are
+ * queued as crossing events, where the segments swap their order.
+ *
+ * Degenerate cases follow the tolerance semantics of numIntx:
+ * - segments within tol of the event point are treated as passing through
+ *   it, so all of them are tested (shared endpoints, touches, bundles of
+ *   segments through one point, collinear overlaps)
+ * - ties in the status order, within the rounding band of the steeper
+ *   segment, are broken by slope, then by index
+ * - at a given x, crossings are handled first, then the segments ending
+ *   there are removed and the ones starting there are inserted, so the
+ *   status never holds segments that are tied at the event point but ordered
+ *   on different sides of it; segments starting at x are also tested against
+ *   the ones that just ended at x, kept sorted by y in endedAtX
+ * - vertical and zero-length segments are not inserted in the status; they
+ *   are tested against the status range and the ended segments they span
+ *   once all other events at their x-coordinate have been handled
+ */
+
+namespace {
+
+enum bo_event_type { bo_cross = 0, bo_end = 1, bo_start = 2, bo_vertical = 3 };
+
+struct bo_event {
+  double x, y;
+  int type;
+  uint32_t a, b;
+
+  bool operator<(const bo_event &ev) const {
+    if (x != ev.x)
+      return x < ev.x;
+    if (type != ev.type)
+      return type < ev.type;
+    if (y != ev.y)
+      return y < ev.y;
+    return a != ev.a ? a < ev.a : b < ev.b;
+  }
+  bool operator>(const bo_event &ev) const { return ev < *this; }
+};
+
+// segment oriented from its lower-left to its upper-right endpoint
+struct bo_seg {
+  Pnt2 L, R;
+  double slope;
+  bool vertical;
+};
+
+struct bo_sweep;
+
+struct bo_less {
+  using is_transparent = void;
+  const bo_sweep *sw;
+
+  bool operator()(uint32_t a, uint32_t b) const;
+  bool operator()(uint32_t a, double y) const;
+};
+
+struct bo_sweep {
+  const vector<Lineseg> &segs;
+  const LsegIntersector &owner; // for the group masks
+  double tol;
+  intx_stats &stats;
+  vector<bo_seg> bsegs;
+  double xs = 0.; // current sweep position
+
+  set<uint32_t, bo_less> status;
+  vector<set<uint32_t, bo_less>::iterator> pos;
+  vector<char> inStatus;
+  priority_queue<bo_event, vector<bo_event>, greater<bo_event>> crossings;
+  unordered_set<uint64_t> reported;
+  vector<uint32_t> endedAtX;     // segments that ended at the current x
+  vector<uint32_t> verticalsAtX; // vertical segments met at the current x
+  double maxEndedSlope = 0.;
+  int nTested = 0, nIntx = 0;
+
+  bo_sweep(const vector<Lineseg> &segs, const LsegIntersector &owner,
+           double tol, intx_stats &stats)
+      : segs(segs), owner(owner), tol(tol), stats(stats),
+        status(bo_less{this}),
+        pos(segs.size()), inStatus(segs.size(), 0) {
+    bsegs.reserve(segs.size());
+    for (const auto &seg : segs) {
+      bool SfirstInX = seg.S.x < seg.E.x || (seg.S.x == seg.E.x && seg.S.y <= seg.E.y);
+      const Pnt2 &L = SfirstInX ? seg.S : seg.E;
+      const Pnt2 &R = SfirstInX ? seg.E : seg.S;
+      bool vertical = L.x == R.x;
+      double slope = vertical ? 0. : (R.y - L.y) / (R.x - L.x);
+      bsegs.push_back(bo_seg{L, R, slope, vertical});
+    }
+  }
+
+  double y_at(uint32_t is) const {
+    const auto &bs = bsegs[is];
+    if (xs <= bs.L.x)
+      return bs.L.y;
+    if (xs >= bs.R.x)
+      return bs.R.y;
+    return bs.L.y + (xs - bs.L.x) * bs.slope;
+  }
+
+  // vertical offset of a segment passing within tol of a point
+  double band(uint32_t is) const { return tol * (1. + fabs(bsegs[is].slope)); }
+
+  bool near(uint32_t is, double y) const {
+    return fabs(y_at(is) - y) <= band(is);
+  }
+
+  bool below(uint32_t a, uint32_t b) const {
+    if (a == b)
+      return false;
+    // y is only known within the rounding band of the steeper segment, as
+    // crossings are located in x; that band does not grow with tol, which
+    // only pads the filters, or the ties would hide the order of segments
+    // that are far apart
+    double slope = max(fabs(bsegs[a].slope), fabs(bsegs[b].slope));
+    double ya = y_at(a), yb = y_at(b), tie = eps * (1. + slope);
+    if (ya < yb - tie)
+      return true;
+    if (yb < ya - tie)
+      return false;
+    if (bsegs[a].slope != bsegs[b].slope)
+      return bsegs[a].slope < bsegs[b].slope;
+    return a < b;
+  }
+
+  // tests a pair, unless it has already been found to intersect; crossings
+  // at the current x are not queued when the caller is already reordering
+  // the segments through that point
+  void test(uint32_t a, uint32_t b, bool scheduleAtX = true) {
+    if (a == b)
+      return;
+    uint64_t key = ((uint64_t)min(a, b) << 32) | max(a, b);
+    if (reported.count(key))
+      return;
+    ++nTested;
+    double params[2];
+    int res = 0;
+    stats.time_exact(
+        1, [&] { res = Lineseg::intx<intx_full>(segs[a], segs[b], params); });
+    stats.add_pair(res);
+    if (res == 0)
+      return;
+    reported.insert(key);
+    // pairs excluded by the group masks still swap in the status
+    nIntx += owner.testsPair(a, b);
+    if (res == 2 && !bsegs[a].vertical && !bsegs[b].vertical) {
+      // a crossing found at (or, by rounding, just behind) the current x is
+      // still handled, before any other event at that x
+      const auto &seg = segs[a];
+      double px = seg.S.x + params[0] * (seg.E.x - seg.S.x);
+      double py = seg.S.y + params[0] * (seg.E.y - seg.S.y);
+      if (px > xs || scheduleAtX)
+        crossings.push(bo_event{max(px, xs), py, bo_cross, a, b});
+    }
+  }
+
+  // tests s against its neighbours: the first one on each side, and then all
+  // the following ones that pass within tol of (xs, y)
+  void test_neighbours(set<uint32_t, bo_less>::iterator it, double y) {
+    uint32_t is = *it;
+    for (auto up = next(it); up != status.end(); ++up) {
+      test(is, *up);
+      if (!near(*up, y))
+        break;
+    }
+    for (auto down = it; down != status.begin();) {
+      --down;
+      test(is, *down);
+      if (!near(*down, y))
+        break;
+    }
+  }
+
+  // moves the sweep to x, forgetting the segments met at the previous x
+  void advance(double x) {
+    if (x != xs) {
+      endedAtX.clear();
+      verticalsAtX.clear();
+      maxEndedSlope = 0.;
+    }
+    xs = x;
+  }
+
+  // tests s against the segments that ended at the current x, within
+  // [ylo, yhi] padded by the tolerance
+  void test_ended(uint32_t is, double ylo, double yhi) {
+    double pad = band(is) + tol * (1. + maxEndedSlope);
+    auto it = lower_bound(endedAtX.begin(), endedAtX.end(), ylo - pad,
+                          [this](uint32_t ie, double y) {
+                            return bsegs[ie].R.y < y;
+                          });
+    for (; it != endedAtX.end() && bsegs[*it].R.y <= yhi + pad; ++it) {
+      test(is, *it);
+    }
+  }
+
+  void start(uint32_t is) {
+    const auto &bs = bsegs[is];
+    advance(bs.L.x);
+    stats.note_active(status.size());
+    pos[is] = status.insert(is).first;
+    inStatus[is] = 1;
+    test_neighbours(pos[is], bs.L.y);
+    test_ended(is, bs.L.y, bs.L.y);
+  }
+
+  void end(uint32_t is) {
+    const auto &bs = bsegs[is];
+    advance(bs.R.x);
+    auto it = pos[is];
+    test_neighbours(it, bs.R.y);
+    auto up = next(it);
+    it = status.erase(it);
+    inStatus[is] = 0;
+    if (up != status.end() && it != status.begin()) {
+      test(*prev(it), *up);
+    }
+    endedAtX.push_back(is);
+    maxEndedSlope = max(maxEndedSlope, fabs(bs.slope));
+  }
+
+  void vertical(uint32_t is) {
+    const auto &bs = bsegs[is];
+    advance(bs.L.x);
+    // status range spanned by the vertical segment
+    auto it = status.lower_bound(bs.L.y - tol);
+    while (it != status.begin() && y_at(*prev(it)) >= bs.L.y - band(*prev(it)))
+      --it;
+    for (; it != status.end() && y_at(*it) <= bs.R.y + band(*it); ++it) {
+      test(is, *it);
+    }
+    test_ended(is, bs.L.y, bs.R.y);
+    // other vertical segments at the same x
+    for (auto iv : verticalsAtX) {
+      if (bsegs[iv].L.y <= bs.R.y + tol && bsegs[iv].R.y >= bs.L.y - tol)
+        test(is, iv);
+    }
+    verticalsAtX.push_back(is);
+  }
+
+  void cross(const bo_event &ev) {
+    // a crossing found while removing one of the segments is already handled
+    if (!inStatus[ev.a] || !inStatus[ev.b])
+      return;
+    advance(ev.x);
+    // collect the contiguous run of segments through the crossing point,
+    // which holds a, b and whatever lies between them
+    auto lo = pos[ev.a], hi = pos[ev.a];
+    bool found = false;
+    for (auto it = pos[ev.a]; it != status.end() && !found; ++it) {
+      hi = it;
+      found = *it == ev.b;
+    }
+    if (!found) {
+      hi = pos[ev.a];
+      for (auto it = pos[ev.a];; --it) {
+        lo = it;
+        if (*it == ev.b || it == status.begin())
+          break;
+      }
+    }
+    while (lo != status.begin() && near(*prev(lo), ev.y))
+      --lo;
+    while (next(hi) != status.end() && near(*next(hi), ev.y))
+      ++hi;
+
+    vector<uint32_t> run(lo, next(hi));
+    for (size_t i = 0; i < run.size(); ++i) {
+      for (size_t j = i + 1; j < run.size(); ++j) {
+        test(run[i], run[j], false);
+      }
+    }
+    // re-insert the run in its order after the crossing, where ties in y are
+    // broken by slope
+    bool hasBelow = lo != status.begin();
+    uint32_t below = hasBelow ? *prev(lo) : 0;
+    status.erase(lo, next(hi));
+    for (auto is : run) {
+      pos[is] = status.insert(is).first;
+    }
+    // a segment of the run may be re-inserted beyond one that is tied with it
+    // but was not near enough to join the run, so every new neighbour of the
+    // run is tested, not only the ones at its ends
+    auto inRun = [&run](uint32_t is) {
+      return find(run.begin(), run.end(), is) != run.end();
+    };
+    for (auto is : run) {
+      auto it = pos[is];
+      if (it != status.begin() && !inRun(*prev(it)))
+        test(*prev(it), is);
+      if (next(it) != status.end() && !inRun(*next(it)))
+        test(is, *next(it));
+    }
+    if (hasBelow) {
+      auto it = next(pos[below]);
+      if (it != status.end() && !inRun(*it))
+        test(below, *it);
+    }
+  }
+
+  int run() {
+    auto tBuild = stats.start();
+    vector<bo_event> events;
+    events.reserve(2 * bsegs.size());
+    for (uint32_t is = 0; is < (uint32_t)bsegs.size(); ++is) {
+      const auto &bs = bsegs[is];
+      if (owner.isRemoved(is)) {
+        continue;
+      } else if (bs.vertical) {
+        events.push_back(bo_event{bs.L.x, bs.L.y, bo_vertical, is, is});
+      } else {
+        events.push_back(bo_event{bs.L.x, bs.L.y, bo_start, is, is});
+        events.push_back(bo_event{bs.R.x, bs.R.y, bo_end, is, is});
+      }
+    }
+    stats.stop(IntxStage::build, tBuild);
+    auto tSort = stats.start();
+    sort(events.begin(), events.end());
+    stats.stop(IntxStage::sort, tSort);
+
+    // merge the sorted endpoints with the crossings found along the way
+    auto tSweep = stats.start();
+    double exactMark = stats.mark(IntxStage::exact_tests);
+    size_t k = 0;
+    while (k < events.size() || !crossings.empty()) {
+      if (!crossings.empty() &&
+          (k == events.size() || !(events[k] < crossings.top()))) {
+        bo_event ev = crossings.top();
+        crossings.pop();
+        stats.add_events(1);
+        cross(ev);
+        continue;
+      }
+      const auto &ev = events[k++];
+      switch (ev.type) {
+      case bo_start:
+        start(ev.a);
+        break;
+      case bo_vertical:
+        vertical(ev.a);
+        break;
+      default:
+        end(ev.a);
+        break;
+      }
+    }
+    stats.add_events(events.size());
+    stats.stop(IntxStage::sweep, tSweep);
+    stats.exclude(IntxStage::sweep, IntxStage::exact_tests, exactMark);
+    return nIntx;
+  }
+};
+
+bool bo_less::operator()(uint32_t a, uint32_t b) const {
+  return sw->below(a, b);
+}
+bool bo_less::operator()(uint32_t a, double y) const { return sw->y_at(a) < y; }
+
+} // namespace
+
+int LsegIntersector::numIntx_BO(int *filtered_pairs) {
+  stats_.reset();
+  bo_sweep sweep(segs_, *this, tol_, stats_);
+  int nIntx = sweep.run();
+  if (filtered_pairs != nullptr) {
+    *filtered_pairs = sweep.nTested;
+  }
+  return nIntx;
+}
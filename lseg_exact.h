@@ -0,0 +1,187 @@
+#pragma once
+
+#include "lseg.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Exact predicates for segments snapped to an integer grid (e.g. coordinates
+// in nanometre units). Lineseg::intx classifies a pair with a tolerance,
+// square roots and the global eps; on integer coordinates the same
+// classification follows from the signs of four orientation determinants,
+// computed exactly in a wider integer type, with no tolerance and no square
+// root:
+//  - 2: the segments cross at a point interior to both
+//  - 1: an endpoint of one segment lies on the other (touch or overlap)
+//  - 0: no common point
+// These are the answers of Lineseg::intx whenever its tolerance is smaller
+// than the distances the grid can produce, degenerate inputs (collinear,
+// shared endpoints, zero-length segments) included.
+//
+// The coordinate type picks the determinant type at compile time; the
+// coordinates must be below limit in absolute value, so that differences
+// and products fit.
+
+template <class Coord> struct exact_coord_traits;
+
+template <> struct exact_coord_traits<int32_t>
+{
+  using wide = int64_t;
+  static constexpr double limit = 0x1p30;
+};
+
+template <> struct exact_coord_traits<int64_t>
+{
+  using wide = __int128;
+  static constexpr double limit = 0x1p62;
+};
+
+template <class Coord> struct IntPnt2
+{
+  Coord x, y;
+};
+
+template <class Coord> struct IntLineseg
+{
+  using wide = typename exact_coord_traits<Coord>::wide;
+
+  IntPnt2<Coord> S, E;
+  uint32_t id = 0;
+
+  // sign of the cross product (B - A) x (C - A): 1 if C is left of AB, -1
+  // if right, 0 if collinear
+  static int orient(const IntPnt2<Coord> &A, const IntPnt2<Coord> &B,
+                    const IntPnt2<Coord> &C)
+  {
+    wide det =
+        (wide)(B.x - A.x) * (C.y - A.y) - (wide)(B.y - A.y) * (C.x - A.x);
+    return (det > 0) - (det < 0);
+  }
+
+  // C, collinear with A and B, lies on the segment AB
+  static bool on_segment(const IntPnt2<Coord> &A, const IntPnt2<Coord> &B,
+                         const IntPnt2<Coord> &C)
+  {
+    return min(A.x, B.x) <= C.x && C.x <= max(A.x, B.x) &&
+           min(A.y, B.y) <= C.y && C.y <= max(A.y, B.y);
+  }
+
+  static int intx(const IntLineseg &l1, const IntLineseg &l2)
+  {
+    int o1 = orient(l1.S, l1.E, l2.S), o2 = orient(l1.S, l1.E, l2.E);
+    // both ends of l2 strictly on one side: the common case in a sweep
+    if (o1 * o2 > 0)
+      return 0;
+    int o3 = orient(l2.S, l2.E, l1.S), o4 = orient(l2.S, l2.E, l1.E);
+    if (o1 * o2 < 0 && o3 * o4 < 0)
+      return 2;
+    bool touch = (o1 == 0 && on_segment(l1.S, l1.E, l2.S)) ||
+                 (o2 == 0 && on_segment(l1.S, l1.E, l2.E)) ||
+                 (o3 == 0 && on_segment(l2.S, l2.E, l1.S)) ||
+                 (o4 == 0 && on_segment(l2.S, l2.E, l1.E));
+    return touch ? 1 : 0;
+  }
+
+  // parameters along l1 and l2 of the crossing of two segments that intx
+  // finds transverse, as Lineseg::intx computes them, from the exact
+  // determinants, so that they are only rounded once
+  static void crossing_params(const IntLineseg &l1, const IntLineseg &l2,
+                              double params[2])
+  {
+    wide v1x = (wide)l1.E.x - l1.S.x, v1y = (wide)l1.E.y - l1.S.y;
+    wide v2x = (wide)l2.E.x - l2.S.x, v2y = (wide)l2.E.y - l2.S.y;
+    wide px = (wide)l2.S.x - l1.S.x, py = (wide)l2.S.y - l1.S.y;
+    double D = (double)(v1x * v2y - v1y * v2x);
+    params[0] = (double)(px * v2y - py * v2x) / D;
+    params[1] = (double)(px * v1y - py * v1x) / D;
+  }
+};
+
+// pair test chosen by the coordinate type: the tolerance-based
+// Lineseg::intx for doubles, with the outputs of Policy (see lseg.h), the
+// exact one for integers, which always gives the type
+template <class Policy = intx_type>
+int seg_intx(const Lineseg &l1, const Lineseg &l2, double tol = eps)
+{
+  return Lineseg::intx<Policy>(l1, l2, nullptr, tol);
+}
+
+template <class Policy = intx_type, class Coord>
+int seg_intx(const IntLineseg<Coord> &l1, const IntLineseg<Coord> &l2,
+             double = 0.)
+{
+  return IntLineseg<Coord>::intx(l1, l2);
+}
+
+// integer type that holds all the coordinates of a set of segments exactly:
+// none if some coordinate is not an integer or is out of range
+enum class ExactCoords
+{
+  none,
+  int32,
+  int64
+};
+
+// c converted to Coord, if it is an integer within the range of Coord
+template <class Coord> bool exact_coord(double c, Coord &ic)
+{
+  if (!(fabs(c) < exact_coord_traits<Coord>::limit) || c != floor(c))
+    return false;
+  ic = (Coord)c;
+  return true;
+}
+
+template <class Coord>
+bool to_int_lineseg(const Lineseg &seg, IntLineseg<Coord> &iseg)
+{
+  iseg.id = seg.id;
+  return exact_coord(seg.S.x, iseg.S.x) && exact_coord(seg.S.y, iseg.S.y) &&
+         exact_coord(seg.E.x, iseg.E.x) && exact_coord(seg.E.y, iseg.E.y);
+}
+
+// segs on the grid; all their coordinates must be exact in Coord
+template <class Coord>
+vector<IntLineseg<Coord>> int_segments(const vector<Lineseg> &segs)
+{
+  vector<IntLineseg<Coord>> isegs(segs.size());
+  for (size_t is = 0; is < segs.size(); ++is)
+  {
+    to_int_lineseg(segs[is], isegs[is]);
+  }
+  return isegs;
+}
+
+// narrowest integer type that holds the coordinates of seg exactly; limit:
+// bound on their absolute value, at most the limit of int64_t
+inline ExactCoords
+exact_coords_of(const Lineseg &seg,
+                double limit = exact_coord_traits<int64_t>::limit)
+{
+  IntLineseg<int32_t> iseg32;
+  if (to_int_lineseg(seg, iseg32))
+    return ExactCoords::int32;
+  IntLineseg<int64_t> iseg64;
+  if (!to_int_lineseg(seg, iseg64) ||
+      !(max(max(fabs(seg.S.x), fabs(seg.S.y)),
+            max(fabs(seg.E.x), fabs(seg.E.y))) < limit))
+    return ExactCoords::none;
+  return ExactCoords::int64;
+}
+
+inline ExactCoords
+exact_coords_of(const vector<Lineseg> &segs,
+                double limit = exact_coord_traits<int64_t>::limit)
+{
+  ExactCoords coords = ExactCoords::int32;
+  for (const auto &seg : segs)
+  {
+    ExactCoords segCoords = exact_coords_of(seg, limit);
+    if (segCoords == ExactCoords::none)
+      return ExactCoords::none;
+    if (segCoords == ExactCoords::int64)
+      coords = segCoords;
+  }
+  return coords;
+}
@@ -0,0 +1,627 @@
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Spatial broad phase, used by numIntx_grid.
+ *
+ * The tolerance-padded bounding boxes of the segments are binned into a
+ * uniform grid, with cells of about twice the mean box extent, so that short
+ * segments packed in a box only meet a handful of neighbours per cell. When
+ * the occupancy of the cells is very uneven (clusters, mixed lengths), the
+ * boxes are binned into the leaves of an adaptive quadtree instead.
+ *
+ * A pair listed in several cells is only tested in the cell that holds its
+ * reference point, the lower-left corner of the overlap of the two boxes.
+ * Cells are half-open, so that point lies in exactly one cell, and both boxes
+ * are listed in it. This needs no global set of the pairs already tested, and
+ * makes the cells independent, so they are processed in parallel.
+ */
+
+namespace {
+
+struct seg_box {
+  double x0, y0, x1, y1;
+};
+
+// the grid is abandoned for the quadtree when the mean number of pairs per
+// cell is this many times what a uniform density would give
+const double maxOccupancySkew = 4.;
+// cell size relative to the mean segment box extent; larger cells have more
+// pairs to test, smaller ones more entries to bin
+const double cellsPerExtent = 2.;
+// cells per segment are capped, for inputs of points or tiny segments
+const double maxCellsPerSeg = 2.;
+const size_t leafCapacity = 32;
+const size_t maxSplitGrowth = 2;
+const int maxDepth = 16;
+const size_t minSegsPerThread = 4096;
+// automatic engine selection
+const size_t minSegsForGrid = 1000;
+const double maxGridDensity = 8.;
+
+struct grid_stats {
+  seg_box box;         // union of the segment boxes
+  double meanExtent;   // mean of the larger side of the segment boxes
+  size_t nLive;        // number of segments that are not removed
+};
+
+// boxes padded as the sweep intervals
+vector<seg_box> segment_boxes(const vector<Lineseg> &segs, double tol) {
+  vector<seg_box> boxes(segs.size());
+  for (size_t is = 0; is < segs.size(); ++is) {
+    const auto &seg = segs[is];
+    boxes[is] =
+        seg_box{min(seg.S.x, seg.E.x) - tol, min(seg.S.y, seg.E.y) - tol,
+                max(seg.S.x, seg.E.x) + tol, max(seg.S.y, seg.E.y) + tol};
+  }
+  return boxes;
+}
+
+// stats of the boxes of the segments that are not removed
+grid_stats compute_stats(const vector<seg_box> &boxes,
+                         const vector<uint8_t> &removed) {
+  grid_stats st = {{0., 0., 0., 0.}, 0., 0};
+  for (size_t is = 0; is < boxes.size(); ++is) {
+    if (removed[is])
+      continue;
+    const auto &b = boxes[is];
+    if (st.nLive++ == 0)
+      st.box = b;
+    st.box.x0 = min(st.box.x0, b.x0);
+    st.box.y0 = min(st.box.y0, b.y0);
+    st.box.x1 = max(st.box.x1, b.x1);
+    st.box.y1 = max(st.box.y1, b.y1);
+    st.meanExtent += max(b.x1 - b.x0, b.y1 - b.y0);
+  }
+  if (st.nLive > 0)
+    st.meanExtent /= st.nLive;
+  return st;
+}
+
+// half-open region of a cell or quadtree leaf; the outer cells extend to
+// infinity, so every point lies in exactly one cell
+struct cell_region {
+  double x0, y0, x1, y1;
+
+  bool holds(double x, double y) const {
+    return x >= x0 && x < x1 && y >= y0 && y < y1;
+  }
+};
+
+// uniform grid, with the segments of each cell stored contiguously
+struct uniform_grid {
+  double x0 = 0., y0 = 0., step = 1.;
+  int nx = 1, ny = 1;
+  vector<uint32_t> cellStart; // nx * ny + 1 offsets into cellIds
+  vector<uint32_t> cellIds;
+  vector<seg_box> cellBoxes; // boxes of cellIds, in the same order
+  // lower-left cell of each segment; as cell_x is monotonic, the cell of the
+  // reference point of a pair is the max of those of its segments
+  vector<int> firstX, firstY;
+
+  int cell_x(double x) const {
+    return min(max((int)floor((x - x0) / step), 0), nx - 1);
+  }
+  int cell_y(double y) const {
+    return min(max((int)floor((y - y0) / step), 0), ny - 1);
+  }
+
+  void build(const vector<seg_box> &boxes, const vector<uint8_t> &removed,
+             const grid_stats &st) {
+    double width = st.box.x1 - st.box.x0, height = st.box.y1 - st.box.y0;
+    double nLive = max((double)st.nLive, 1.);
+    step = max(cellsPerExtent * st.meanExtent,
+               sqrt(width * height / (maxCellsPerSeg * nLive)));
+    if (!(step > 0.))
+      step = 1.;
+    x0 = st.box.x0;
+    y0 = st.box.y0;
+    nx = max((int)min(width / step, 65536.) + 1, 1);
+    ny = max((int)min(height / step, 65536.) + 1, 1);
+
+    // counting sort of the (segment, cell) entries by cell
+    cellStart.assign((size_t)nx * ny + 1, 0);
+    for (size_t is = 0; is < boxes.size(); ++is) {
+      if (removed[is])
+        continue;
+      const auto &b = boxes[is];
+      int ix1 = cell_x(b.x1), iy1 = cell_y(b.y1);
+      for (int iy = cell_y(b.y0); iy <= iy1; ++iy) {
+        for (int ix = cell_x(b.x0); ix <= ix1; ++ix) {
+          ++cellStart[(size_t)iy * nx + ix + 1];
+        }
+      }
+    }
+    for (size_t ic = 1; ic < cellStart.size(); ++ic) {
+      cellStart[ic] += cellStart[ic - 1];
+    }
+    cellIds.resize(cellStart.back());
+    cellBoxes.resize(cellStart.back());
+    firstX.resize(boxes.size());
+    firstY.resize(boxes.size());
+    vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (uint32_t is = 0; is < (uint32_t)boxes.size(); ++is) {
+      if (removed[is])
+        continue;
+      const auto &b = boxes[is];
+      firstX[is] = cell_x(b.x0);
+      firstY[is] = cell_y(b.y0);
+      int ix1 = cell_x(b.x1), iy1 = cell_y(b.y1);
+      for (int iy = firstY[is]; iy <= iy1; ++iy) {
+        for (int ix = firstX[is]; ix <= ix1; ++ix) {
+          uint32_t k = fill[(size_t)iy * nx + ix]++;
+          cellIds[k] = is;
+          cellBoxes[k] = b;
+        }
+      }
+    }
+  }
+
+  // mean number of pairs per cell, relative to a uniform density
+  double occupancy_skew() const {
+    double nEntries = 0., sumSq = 0.;
+    size_t nNonEmpty = 0;
+    for (size_t ic = 0; ic + 1 < cellStart.size(); ++ic) {
+      double count = cellStart[ic + 1] - cellStart[ic];
+      nEntries += count;
+      sumSq += count * count;
+      nNonEmpty += count > 0.;
+    }
+    return nEntries > 0. ? sumSq * nNonEmpty / (nEntries * nEntries) : 1.;
+  }
+};
+
+struct quad_leaf {
+  cell_region region;
+  vector<uint32_t> ids;
+  vector<seg_box> boxes;
+};
+
+// splits the node until it holds at most leafCapacity segments; box is the
+// extent used to place the split point, region the half-open cell
+void build_quadtree(const vector<seg_box> &boxes, vector<uint32_t> &&ids,
+                    const seg_box &box, const cell_region &region, int depth,
+                    vector<quad_leaf> &leaves) {
+  if (ids.size() <= leafCapacity || depth == maxDepth) {
+    leaves.push_back(quad_leaf{region, std::move(ids), {}});
+    return;
+  }
+  double xm = 0.5 * (box.x0 + box.x1), ym = 0.5 * (box.y0 + box.y1);
+  vector<uint32_t> children[4];
+  for (auto is : ids) {
+    const auto &b = boxes[is];
+    bool left = b.x0 < xm, right = b.x1 >= xm;
+    bool below = b.y0 < ym, above = b.y1 >= ym;
+    if (left && below)
+      children[0].push_back(is);
+    if (right && below)
+      children[1].push_back(is);
+    if (left && above)
+      children[2].push_back(is);
+    if (right && above)
+      children[3].push_back(is);
+  }
+  // splitting stops paying off once the cells get smaller than the segments,
+  // which are then copied into most children
+  size_t nChildIds = 0;
+  for (const auto &child : children) {
+    nChildIds += child.size();
+  }
+  if (nChildIds > maxSplitGrowth * ids.size()) {
+    leaves.push_back(quad_leaf{region, std::move(ids), {}});
+    return;
+  }
+  ids.clear();
+  ids.shrink_to_fit();
+  for (int k = 0; k < 4; ++k) {
+    bool right = k & 1, above = k & 2;
+    seg_box cbox = {right ? xm : box.x0, above ? ym : box.y0,
+                    right ? box.x1 : xm, above ? box.y1 : ym};
+    cell_region creg = {right ? xm : region.x0, above ? ym : region.y0,
+                        right ? region.x1 : xm, above ? region.y1 : ym};
+    build_quadtree(boxes, std::move(children[k]), cbox, creg, depth + 1,
+                   leaves);
+  }
+}
+
+// runs f(k) for k in [0, n) on nThreads threads, in chunks
+template <class F> void parallel_for(size_t n, int nThreads, F &&f) {
+  if (nThreads <= 1) {
+    for (size_t k = 0; k < n; ++k) {
+      f(k, 0);
+    }
+    return;
+  }
+  const size_t chunk = max((size_t)1, n / (16 * nThreads));
+  atomic<size_t> next(0);
+  auto work = [&](int it) {
+    for (size_t begin = next.fetch_add(chunk); begin < n;
+         begin = next.fetch_add(chunk)) {
+      for (size_t k = begin; k < min(n, begin + chunk); ++k) {
+        f(k, it);
+      }
+    }
+  };
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it) {
+    workers.emplace_back(work, it);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+struct cell_counts {
+  vector<uint32_t> cands;
+  vector<int8_t> res;
+  int nFiltered = 0, nIntx = 0;
+  intx_stats stats;
+};
+
+// tests the pairs of one cell whose reference point lies in it; cellBoxes
+// are the boxes of ids, and refInCell(i, j, rx, ry) tells whether the
+// reference point (rx, ry) of the pair (ids[i], ids[j]) belongs to the cell
+// (and whether the pair is tested at all); intersecting pairs are passed to
+// rep
+template <class RefInCell, class Reporter>
+void test_cell(const uint32_t *ids, const seg_box *cellBoxes, size_t n,
+               RefInCell &&refInCell, const seg_soa &soa, BatchIsa isa,
+               cell_counts &counts, Reporter &rep) {
+  if (n < 2)
+    return;
+  // the segments of a cell play the part of the active set
+  counts.stats.note_active(n);
+  for (size_t i = 0; i < n; ++i) {
+    const auto &bi = cellBoxes[i];
+    counts.cands.clear();
+    for (size_t j = i + 1; j < n; ++j) {
+      const auto &bj = cellBoxes[j];
+      double rx = max(bi.x0, bj.x0), ry = max(bi.y0, bj.y0);
+      // same x-overlap test as the sweep, where ends come before starts
+      if (rx < min(bi.x1, bj.x1) && ry <= min(bi.y1, bj.y1) &&
+          refInCell(i, j, rx, ry))
+        counts.cands.push_back(ids[j]);
+    }
+    if (counts.cands.empty())
+      continue;
+    counts.res.resize(counts.cands.size());
+    counts.stats.time_exact(counts.cands.size(), [&] {
+      intx_batch(soa, ids[i], counts.cands.data(), counts.cands.size(),
+                 counts.res.data(), isa);
+    });
+    counts.stats.add_pairs(counts.res.data(), counts.res.size());
+    for (auto pair_res : counts.res) {
+      counts.nFiltered += pair_res >= 0;
+      counts.nIntx += pair_res > 0;
+    }
+    if constexpr (Reporter::enabled) {
+      for (size_t ic = 0; ic < counts.cands.size(); ++ic) {
+        if (counts.res[ic] > 0)
+          rep.add(counts.cands[ic], ids[i]);
+      }
+    }
+  }
+}
+
+} // namespace
+
+EngineType LsegIntersector::selectEngine() const {
+  if (engine_ != EngineType::automatic)
+    return engine_;
+  if (segs_.size() < minSegsForGrid)
+    return EngineType::sweep;
+  // The grid wins while a segment box meets few others: its cost grows with
+  // the number of segments per cell, while the y-buckets of the sweep degrade
+  // more slowly as segments get longer or cluster. The density seen by an
+  // average segment is estimated from a coarse histogram of the box centres;
+  // the threshold was measured on uniform random segments.
+  vector<seg_box> boxes = segment_boxes(segs_, tol_);
+  grid_stats st = compute_stats(boxes, removed_);
+  double width = st.box.x1 - st.box.x0, height = st.box.y1 - st.box.y0;
+  double step = max(4. * st.meanExtent, max(width, height) / 256.);
+  if (!(step > 0.))
+    return EngineType::sweep;
+  int nx = (int)(width / step) + 1, ny = (int)(height / step) + 1;
+  vector<uint32_t> hist((size_t)nx * ny, 0);
+  for (size_t is = 0; is < boxes.size(); ++is) {
+    if (removed_[is])
+      continue;
+    const auto &b = boxes[is];
+    int ix = (int)((0.5 * (b.x0 + b.x1) - st.box.x0) / step);
+    int iy = (int)((0.5 * (b.y0 + b.y1) - st.box.y0) / step);
+    ++hist[(size_t)min(iy, ny - 1) * nx + min(ix, nx - 1)];
+  }
+  double sumSq = 0.;
+  for (auto count : hist) {
+    sumSq += (double)count * count;
+  }
+  double density = sumSq / max((double)st.nLive, 1.) * st.meanExtent *
+                   st.meanExtent / (step * step);
+  return density < maxGridDensity ? EngineType::grid : EngineType::sweep;
+}
+
+int LsegIntersector::numIntx_grid(int *filtered_pairs) {
+  return run_grid<no_reporter>(filtered_pairs, nullptr);
+}
+
+template <class Reporter>
+int LsegIntersector::run_grid(int *filtered_pairs,
+                              const report_target *target) {
+  stats_.reset();
+  auto tBuild = stats_.start();
+  // a proximity join tests distances, on filters padded for its clearance;
+  // the reporting queries pick the predicates, which their records use
+  double clearance = target != nullptr ? target->clearance : 0.;
+  ExactCoords exact = target != nullptr ? target->preds.exact : exactCoords();
+  double pad = clearance > 0. ? nearPadding(clearance) : broadPadding(exact);
+  vector<seg_box> boxes = segment_boxes(segs_, pad);
+  grid_stats st = compute_stats(boxes, removed_);
+  seg_soa soa;
+  soa.assign(segs_, pad, kdopDirs_);
+  soa.exact = exact;
+  soa.clearance = clearance;
+
+  int nThreads =
+      nThreads_ > 0 ? nThreads_ : (int)thread::hardware_concurrency();
+  nThreads = max(1, min(nThreads, (int)(segs_.size() / minSegsPerThread)));
+  vector<cell_counts> counts(nThreads);
+  vector<Reporter> reps;
+  for (int it = 0; it < nThreads; ++it) {
+    reps.emplace_back(target, it);
+  }
+
+  // pairs excluded by the group masks are skipped before the pair kernel
+  bool grouped = groupsFiltered();
+  uniform_grid grid;
+  grid.build(boxes, removed_, st);
+  auto tScan = tBuild;
+  if (grid.occupancy_skew() <= maxOccupancySkew) {
+    stats_.stop(IntxStage::build, tBuild);
+    tScan = stats_.start();
+    parallel_for((size_t)grid.nx * grid.ny, nThreads, [&](size_t ic, int it) {
+      int ix = (int)(ic % grid.nx), iy = (int)(ic / grid.nx);
+      const uint32_t *ids = grid.cellIds.data() + grid.cellStart[ic];
+      test_cell(
+          ids, grid.cellBoxes.data() + grid.cellStart[ic],
+          grid.cellStart[ic + 1] - grid.cellStart[ic],
+          [&](size_t i, size_t j, double, double) {
+            return max(grid.firstX[ids[i]], grid.firstX[ids[j]]) == ix &&
+                   max(grid.firstY[ids[i]], grid.firstY[ids[j]]) == iy &&
+                   (!grouped || testsPair(ids[i], ids[j]));
+          },
+          soa, batchIsa_, counts[it], reps[it]);
+    });
+  } else {
+    // uneven density: adaptive quadtree
+    grid = uniform_grid();
+    const double inf = numeric_limits<double>::infinity();
+    vector<uint32_t> ids;
+    ids.reserve(segs_.size());
+    for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+      if (!removed_[is])
+        ids.push_back(is);
+    }
+    vector<quad_leaf> leaves;
+    build_quadtree(boxes, std::move(ids), st.box,
+                   cell_region{-inf, -inf, inf, inf}, 0, leaves);
+    stats_.stop(IntxStage::build, tBuild);
+    tScan = stats_.start();
+    parallel_for(leaves.size(), nThreads, [&](size_t il, int it) {
+      auto &leaf = leaves[il];
+      leaf.boxes.resize(leaf.ids.size());
+      for (size_t k = 0; k < leaf.ids.size(); ++k) {
+        leaf.boxes[k] = boxes[leaf.ids[k]];
+      }
+      test_cell(
+          leaf.ids.data(), leaf.boxes.data(), leaf.ids.size(),
+          [&](size_t i, size_t j, double x, double y) {
+            return leaf.region.holds(x, y) &&
+                   (!grouped || testsPair(leaf.ids[i], leaf.ids[j]));
+          },
+          soa, batchIsa_, counts[it], reps[it]);
+    });
+  }
+
+  for (auto &rep : reps) {
+    rep.flush();
+  }
+  // the scan of the cells, less the pair tests of all threads
+  stats_.stop(IntxStage::sweep, tScan, nThreads);
+  double exactMark = stats_.mark(IntxStage::exact_tests);
+  int nFiltered = 0, nIntx = 0;
+  for (const auto &c : counts) {
+    nFiltered += c.nFiltered;
+    nIntx += c.nIntx;
+    stats_.merge(c.stats);
+  }
+  stats_.exclude(IntxStage::sweep, IntxStage::exact_tests, exactMark);
+  if (filtered_pairs != nullptr) {
+    *filtered_pairs = nFiltered;
+  }
+  return nIntx;
+}
+
+template int LsegIntersector::run_grid<intx_reporter>(int *,
+                                                     const report_target *);
+template int LsegIntersector::run_grid<node_reporter>(int *,
+                                                     const report_target *);
+template int LsegIntersector::run_grid<near_reporter>(int *,
+                                                     const report_target *);
+template int LsegIntersector::run_grid<tile_reporter>(int *,
+                                                     const report_target *);
+
+namespace {
+
+// box of the indexed geometry of segment is, with the padding of the kernel
+seg_box soa_box(const seg_soa &soa, uint32_t is) {
+  return seg_box{min(soa.sx[is], soa.ex[is]) - soa.tol,
+                 min(soa.sy[is], soa.ey[is]) - soa.tol,
+                 max(soa.sx[is], soa.ex[is]) + soa.tol,
+                 max(soa.sy[is], soa.ey[is]) + soa.tol};
+}
+
+// adds (insert) or removes segment is from the cells its box overlaps
+void bin_dynamic(dynamic_index &dyn, uint32_t is, bool insert) {
+  seg_box b = soa_box(dyn.soa, is);
+  int ix1 = dyn.cell_x(b.x1), iy1 = dyn.cell_y(b.y1);
+  for (int iy = dyn.cell_y(b.y0); iy <= iy1; ++iy) {
+    for (int ix = dyn.cell_x(b.x0); ix <= ix1; ++ix) {
+      auto &cell = dyn.cells[(size_t)iy * dyn.nx + ix];
+      if (insert) {
+        cell.push_back(is);
+      } else {
+        auto it = find(cell.begin(), cell.end(), is);
+        *it = cell.back();
+        cell.pop_back();
+      }
+    }
+  }
+}
+
+} // namespace
+
+void LsegIntersector::build_dynamic() {
+  dynamic_index &dyn = dynamic_;
+  fill(begin(dyn.nCoords), end(dyn.nCoords), 0);
+  if (exactPredicates_) {
+    for (const auto &seg : segs_) {
+      ++dyn.nCoords[(int)exact_coords_of(seg, exactLimit)];
+    }
+  }
+  ExactCoords exact =
+      exactPredicates_ ? dyn.exact_coords() : ExactCoords::none;
+  double pad = broadPadding(exact);
+  vector<seg_box> boxes = segment_boxes(segs_, pad);
+  grid_stats st = compute_stats(boxes, removed_);
+  // same cell size as the uniform grid of numIntx_grid
+  double width = st.box.x1 - st.box.x0, height = st.box.y1 - st.box.y0;
+  double nLive = max((double)st.nLive, 1.);
+  dyn.step = max(cellsPerExtent * st.meanExtent,
+                 sqrt(width * height / (maxCellsPerSeg * nLive)));
+  if (!(dyn.step > 0.))
+    dyn.step = 1.;
+  dyn.x0 = st.box.x0;
+  dyn.y0 = st.box.y0;
+  dyn.nx = max((int)min(width / dyn.step, 4096.) + 1, 1);
+  dyn.ny = max((int)min(height / dyn.step, 4096.) + 1, 1);
+  dyn.cells.assign((size_t)dyn.nx * dyn.ny, {});
+
+  dyn.soa.assign(segs_, pad, kdopDirs_);
+  dyn.soa.exact = exact;
+  dyn.indexed.assign(segs_.size(), 0);
+  for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+    if (removed_[is])
+      continue;
+    dyn.indexed[is] = 1;
+    bin_dynamic(dyn, is, true);
+  }
+  dyn.changed.clear();
+  dyn.nBuilt = segs_.size();
+  dyn.built = true;
+
+  // the total, with every segment marked changed, so that each pair is
+  // counted once
+  dyn.isChanged.assign(segs_.size(), 1);
+  dyn.nIntx = 0;
+  for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+    if (dyn.indexed[is])
+      dyn.nIntx += count_dynamic(is);
+  }
+  dyn.isChanged.assign(segs_.size(), 0);
+}
+
+int LsegIntersector::count_dynamic(uint32_t is) {
+  dynamic_index &dyn = dynamic_;
+  seg_box bs = soa_box(dyn.soa, is);
+  auto &cands = dyn.cands.ids;
+  auto &res = dyn.cands.res;
+  cands.clear();
+  int ix1 = dyn.cell_x(bs.x1), iy1 = dyn.cell_y(bs.y1);
+  for (int iy = dyn.cell_y(bs.y0); iy <= iy1; ++iy) {
+    for (int ix = dyn.cell_x(bs.x0); ix <= ix1; ++ix) {
+      for (auto io : dyn.cells[(size_t)iy * dyn.nx + ix]) {
+        // pairs of two changed segments are counted once, from the one
+        // with the lower index
+        if (io == is || (io < is && dyn.isChanged[io]))
+          continue;
+        seg_box bo = soa_box(dyn.soa, io);
+        double rx = max(bs.x0, bo.x0), ry = max(bs.y0, bo.y0);
+        // the pair is listed in every cell of the overlap of the two boxes,
+        // and kept in the one holding its reference point
+        if (rx < min(bs.x1, bo.x1) && ry <= min(bs.y1, bo.y1) &&
+            dyn.cell_x(rx) == ix && dyn.cell_y(ry) == iy &&
+            testsPair(is, io))
+          cands.push_back(io);
+      }
+    }
+  }
+  res.resize(cands.size());
+  intx_batch(dyn.soa, is, cands.data(), cands.size(), res.data(), batchIsa_);
+  int nIntx = 0;
+  for (auto pair_res : res) {
+    nIntx += pair_res > 0;
+  }
+  return nIntx;
+}
+
+int LsegIntersector::numIntx_dynamic() {
+  dynamic_index &dyn = dynamic_;
+  if (!dyn.built || segs_.size() > 2 * dyn.nBuilt) {
+    build_dynamic();
+    return dyn.nIntx;
+  }
+  if (dyn.changed.empty())
+    return dyn.nIntx;
+
+  // with exact predicates, the changes may switch numIntx to or from them,
+  // or to wider integers: the index is then built again
+  if (exactPredicates_) {
+    for (auto is : dyn.changed) {
+      if (is < dyn.soa.size())
+        --dyn.nCoords[(int)exact_coords_of(dyn.soa.seg(is), exactLimit)];
+      ++dyn.nCoords[(int)exact_coords_of(segs_[is], exactLimit)];
+    }
+    if (dyn.exact_coords() != dyn.soa.exact) {
+      build_dynamic();
+      return dyn.nIntx;
+    }
+  }
+
+  // pairs of the changed segments before the changes, then after
+  int lost = 0;
+  for (auto is : dyn.changed) {
+    if (is < dyn.indexed.size() && dyn.indexed[is])
+      lost += count_dynamic(is);
+  }
+  dyn.indexed.resize(segs_.size(), 0);
+  for (auto is : dyn.changed) {
+    if (dyn.indexed[is])
+      bin_dynamic(dyn, is, false);
+    dyn.set_geometry(is, segs_[is]);
+    dyn.indexed[is] = !removed_[is];
+    if (dyn.indexed[is])
+      bin_dynamic(dyn, is, true);
+  }
+  int gained = 0;
+  for (auto is : dyn.changed) {
+    if (dyn.indexed[is])
+      gained += count_dynamic(is);
+  }
+  dyn.nIntx += gained - lost;
+
+  for (auto is : dyn.changed) {
+    dyn.isChanged[is] = 0;
+  }
+  dyn.changed.clear();
+  return dyn.nIntx;
+}
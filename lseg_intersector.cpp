@@ -1,84 +1,470 @@
 #include "lseg_intersector.h"
+#include "active_set.h"
+#include "event_sort.h"
 #include "interval.h"
 #include "lseg.h"
+#include "seg_io.h"
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 using namespace std;
 
-#define TIMING 0
+// the parallel sweep is only worth its setup cost on larger inputs
+static const size_t minEventsPerSlab = 4096;
+static const int slabsPerThread = 4;
+// anyIntersection sorts the events in chunks growing by this factor, from
+// the first one, as the sweep reaches them
+static const size_t firstLazyChunk = 1024;
+static const size_t lazyChunkGrowth = 8;
 
-struct customComp {
-  bool operator()(const intvl_end &i1, const intvl_end &i2) const {
-    return (i1.pI->ends[i1.iend] < i2.pI->ends[i2.iend]) ||
-           ((i1.pI->ends[i1.iend] == i2.pI->ends[i2.iend] &&
-             i1.iend > i2.iend));
+template <class ActiveSet, class Reporter>
+void LsegIntersector::sweep_events(const vector<intvl_end> &sides,
+                                   const seg_soa &soa, size_t begin,
+                                   size_t end, ActiveSet &active,
+                                   candidate_batch &cands, Reporter &rep,
+                                   int &nFiltered, int &nIntx,
+                                   intx_stats &stats) const {
+  auto tSweep = stats.start();
+  double exactMark = stats.mark(IntxStage::exact_tests);
+  stats.add_events(end - begin);
+  auto &ids = cands.ids;
+  auto &res = cands.res;
+  for (size_t k = begin; k < end; ++k) {
+    const auto &side = sides[k];
+    if (side.iend == 0) {
+      ids.clear();
+      active.for_each_ovlp(side.id, [&](uint32_t id) { ids.push_back(id); });
+      res.resize(ids.size());
+      stats.time_exact(ids.size(), [&] {
+        intx_batch(soa, side.id, ids.data(), ids.size(), res.data(),
+                   batchIsa_);
+      });
+      if constexpr (intx_stats::enabled) {
+        stats.note_active(active.size());
+        stats.add_pairs(res.data(), res.size());
+      }
+      for (auto pair_res : res) {
+        nFiltered += pair_res >= 0;
+        nIntx += pair_res > 0;
+      }
+      if constexpr (Reporter::enabled) {
+        for (size_t ic = 0; ic < ids.size(); ++ic) {
+          if (res[ic] > 0)
+            rep.add(ids[ic], side.id);
+        }
+      }
+      active.insert(side.id);
+      if constexpr (Reporter::stops) {
+        if (rep.done())
+          break;
+      }
+    } else {
+      active.erase(side.id);
+    }
   }
-};
+  stats.stop(IntxStage::sweep, tSweep);
+  stats.exclude(IntxStage::sweep, IntxStage::exact_tests, exactMark);
+}
 
-static void print_intervals(vector<intvl> &intervals) {
-  cout << "\nnumber of intervals = " << intervals.size() << endl;
-  for (auto intv : intervals) {
-    cout << "(" << intv.ends[0] << "," << intv.ends[1] << ", " << intv.id
-         << ") " << endl;
+void LsegIntersector::addSegs(const segment_file &file) {
+  size_t n = segs_.size() + file.nSegs;
+  segs_.reserve(n);
+  groups_.reserve(n);
+  removed_.reserve(n);
+  for (size_t is = 0; is < file.nSegs; ++is) {
+    const double *c = file.coords + 4 * is;
+    uint32_t id = file.ids != nullptr ? file.ids[is] : (uint32_t)is;
+    segs_.emplace_back(Pnt2(c[0], c[1]), Pnt2(c[2], c[3]), id);
+    uint8_t group = file.groups != nullptr ? file.groups[is] : 0;
+    groups_.push_back(group);
+    removed_.push_back(0);
+    usedGroups_ |= (uint64_t)1 << group;
+    dynamic_.note_change((uint32_t)segs_.size() - 1);
   }
 }
 
 int LsegIntersector::numIntx(int *filtered_pairs) {
-  // collect all x end coordinates
-
-  vector<intvl_end> sides;
-  for (const auto &seg : segs_) {
-    shared_ptr<intvl> inSeg = make_shared<intvl>(intvl{
-        min(seg.S.x, seg.E.x) - tol_, max(seg.S.x, seg.E.x) + tol_, seg.id});
-    sides.emplace_back(intvl_end{inSeg, 0});
-    sides.emplace_back(intvl_end{inSeg, 1});
-  }
-  // sort all interval endpoints
-  sort(sides.begin(), sides.end(), customComp());
-
-  unordered_set<uint32_t> curr_ovlps;
-  int nFiltered = 0, nIntx = 0;
-
-  for (const auto &end : sides) {
-    if (end.iend == 0) {
-      for (auto id : curr_ovlps) {
-        if (overlaps_along_y_and_diags(
-                pair<uint32_t, uint32_t>{id, end.pI->id})) {
-          ++nFiltered;
-          double params[2];
-          int pair_res =
-              Lineseg::intx(segs_.at(id), segs_.at(end.pI->id), params);
-          if (pair_res > 0)
-            ++nIntx;
-        }
+  switch (selectEngine()) {
+  case EngineType::grid:
+    return numIntx_grid(filtered_pairs);
+  case EngineType::sweep:
+  default:
+    return numIntx_sweep(filtered_pairs);
+  }
+}
+
+int LsegIntersector::numIntx_sweep(int *filtered_pairs) {
+  return run_sweep<no_reporter>(filtered_pairs, nullptr);
+}
+
+int LsegIntersector::reportIntx(const IntxSink &sink, bool concurrentSink,
+                                size_t chunkSize) {
+  mutex sinkLock;
+  report_target target = {.segs = &segs_,
+                          .sink = &sink,
+                          .sinkLock = concurrentSink ? nullptr : &sinkLock,
+                          .chunkSize = max(chunkSize, (size_t)1),
+                          .preds = {.exact = exactCoords()}};
+  switch (selectEngine()) {
+  case EngineType::grid:
+    return run_grid<intx_reporter>(nullptr, &target);
+  case EngineType::sweep:
+  default:
+    return run_sweep<intx_reporter>(nullptr, &target);
+  }
+}
+
+int LsegIntersector::collect_splits(vector<vector<split_point>> &splits) {
+  int nThreads =
+      nThreads_ > 0 ? nThreads_ : (int)thread::hardware_concurrency();
+  splits.assign(max(nThreads, 1), vector<split_point>());
+  // contacts within the merge distance of nodeSegs
+  report_target target = {.segs = &segs_,
+                          .sink = nullptr,
+                          .sinkLock = nullptr,
+                          .chunkSize = 1,
+                          .splits = &splits,
+                          .preds = {exactCoords(), max(tol_, eps)}};
+  switch (selectEngine()) {
+  case EngineType::grid:
+    return run_grid<node_reporter>(nullptr, &target);
+  case EngineType::sweep:
+  default:
+    return run_sweep<node_reporter>(nullptr, &target);
+  }
+}
+
+int64_t LsegIntersector::count_tile_pairs(const tile_ref &tile) {
+  atomic<int64_t> nPairs(0);
+  report_target target = {.segs = &segs_,
+                          .sink = nullptr,
+                          .sinkLock = nullptr,
+                          .chunkSize = 1,
+                          .tile = &tile,
+                          .nTilePairs = &nPairs,
+                          .preds = {.exact = exactCoords()}};
+  switch (selectEngine()) {
+  case EngineType::grid:
+    run_grid<tile_reporter>(nullptr, &target);
+    break;
+  case EngineType::sweep:
+  default:
+    run_sweep<tile_reporter>(nullptr, &target);
+    break;
+  }
+  return nPairs;
+}
+
+int LsegIntersector::proximityJoin(double clearance, const NearSink &sink,
+                                   bool concurrentSink, size_t chunkSize) {
+  if (!(clearance > 0.)) {
+    stats_.reset();
+    return 0;
+  }
+  mutex sinkLock;
+  report_target target = {.segs = &segs_,
+                          .sink = nullptr,
+                          .sinkLock = concurrentSink ? nullptr : &sinkLock,
+                          .chunkSize = max(chunkSize, (size_t)1),
+                          .clearance = clearance,
+                          .nearSink = sink ? &sink : nullptr,
+                          .preds = {}}; // distances, not predicates
+  switch (selectEngine()) {
+  case EngineType::grid:
+    return run_grid<near_reporter>(nullptr, &target);
+  case EngineType::sweep:
+  default:
+    return run_sweep<near_reporter>(nullptr, &target);
+  }
+}
+
+bool LsegIntersector::anyIntersection(IntxRecord *first) {
+  atomic<bool> found(false);
+  IntxRecord rec;
+  // only called by the thread that found the first pair
+  IntxSink sink = [&](const IntxRecord *records, size_t, int) {
+    rec = records[0];
+  };
+  report_target target = {.segs = &segs_,
+                          .sink = &sink,
+                          .sinkLock = nullptr,
+                          .chunkSize = 1,
+                          .stop = &found,
+                          .preds = {.exact = exactCoords()}};
+  run_sweep<any_reporter>(nullptr, &target);
+  if (found && first != nullptr)
+    *first = rec;
+  return found;
+}
+
+template <class Reporter>
+int LsegIntersector::run_sweep(int *filtered_pairs,
+                               const report_target *target) {
+  stats_.reset();
+  auto tBuild = stats_.start();
+  // a proximity join tests distances, on filters padded for its clearance;
+  // the reporting queries pick the predicates, which their records use
+  double clearance = target != nullptr ? target->clearance : 0.;
+  ExactCoords exact = target != nullptr ? target->preds.exact : exactCoords();
+  double pad = clearance > 0. ? nearPadding(clearance) : broadPadding(exact);
+  sweep_workspace &ws = workspace();
+  // axis of the sweep, from a sample of the segments when automatic
+  sweep_frame frame;
+  double axisEstimates[nSweepAxes] = {};
+  if (sweepAxis_ == SweepAxis::automatic)
+    frame = choose_sweep_frame(segs_, removed_, pad, axisEstimates,
+                               &ws.axisScratch);
+  else
+    frame = sweep_frame_of(sweepAxis_, segs_, removed_, &ws.axisScratch);
+  stats_.set_axis(frame.axis, axisEstimates);
+
+  // collect all end coordinates along the axis in one flat array
+  auto &sides = ws.sides;
+  sides.clear();
+  sides.reserve(2 * segs_.size());
+  for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+    if (removed_[is])
+      continue;
+    intvl proj = frame.along(segs_[is], pad, is);
+    sides.push_back(intvl_end{proj.ends[0], is, 0});
+    sides.push_back(intvl_end{proj.ends[1], is, 1});
+  }
+  stats_.stop(IntxStage::build, tBuild);
+  // sort all interval endpoints; a query that stops early sorts them as
+  // it goes (see sweep)
+  if constexpr (!Reporter::stops) {
+    auto tSort = stats_.start();
+    sort_events(sides, eventSort_, nThreads_, &ws.sortScratch);
+    stats_.stop(IntxStage::sort, tSort);
+  }
+
+  // coordinates for the batched pair kernel
+  tBuild = stats_.start();
+  auto &soa = ws.soa;
+  soa.assign(segs_, pad, kdopDirs_);
+  soa.exact = exact;
+  soa.clearance = clearance;
+  stats_.stop(IntxStage::build, tBuild);
+
+  // with group masks, one active set per group
+  bool grouped = groupsFiltered();
+  switch (activeSet_) {
+  case ActiveSetType::hash:
+    return grouped ? sweep<grouped_active_set<hash_active_set>, Reporter>(
+                         sides, soa, frame, filtered_pairs, target)
+                   : sweep<hash_active_set, Reporter>(sides, soa, frame,
+                                                      filtered_pairs, target);
+  case ActiveSetType::ybucket:
+  default:
+    return grouped
+               ? sweep<grouped_active_set<ybucket_active_set>, Reporter>(
+                     sides, soa, frame, filtered_pairs, target)
+               : sweep<ybucket_active_set, Reporter>(sides, soa, frame,
+                                                     filtered_pairs, target);
+  }
+}
+
+// With nThreads_ > 1, the sorted endpoints are split into slabs of
+// consecutive events, and each slab is swept independently after being
+// seeded with the intervals that are still open at its left boundary; the
+// seeds of all the slabs are listed in one pass over the events. A pair is
+// only tested at the start event of its later interval, which belongs to
+// exactly one slab, so every pair is counted once and the result is
+// identical to the serial sweep.
+template <class ActiveSet, class Reporter>
+int LsegIntersector::sweep(vector<intvl_end> &sides,
+                           const seg_soa &soa, const sweep_frame &frame,
+                           int *filtered_pairs, const report_target *target) {
+  // extents across the axis (y for the x-sweep) for the active sets; buckets
+  // are sized after the mean height
+  auto tBuild = stats_.start();
+  sweep_workspace &ws = workspace();
+  auto &yInts = ws.yInts;
+  yInts.resize(segs_.size());
+  intvl yRange = {{0., 0.}, 0};
+  double ySum = 0.;
+  for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+    yInts[is] = frame.across(segs_[is], soa.tol, is);
+    yRange.ends[0] = is == 0 ? yInts[is].ends[0]
+                             : min(yRange.ends[0], yInts[is].ends[0]);
+    yRange.ends[1] = is == 0 ? yInts[is].ends[1]
+                             : max(yRange.ends[1], yInts[is].ends[1]);
+    ySum += yInts[is].ends[1] - yInts[is].ends[0];
+  }
+  double yStep = segs_.empty() ? 0. : ySum / segs_.size();
+  int nGroups = bit_width(usedGroups_);
+  stats_.stop(IntxStage::build, tBuild);
+
+  int nThreads =
+      nThreads_ > 0 ? nThreads_ : (int)thread::hardware_concurrency();
+  bool serial = nThreads <= 1 || sides.size() < 2 * minEventsPerSlab;
+  if (Reporter::stops && serial) {
+    // the next chunk of events is selected, then sorted, only when the
+    // sweep reaches it, so an early stop skips most of the sort
+    auto &active = ws.active_set<ActiveSet>();
+    init_active_set(active, yInts, yRange, yStep, groups_, groupMasks_.data(),
+                    nGroups);
+    Reporter rep(target, 0);
+    int nFiltered = 0, nIntx = 0;
+    size_t begin = 0, chunk = firstLazyChunk;
+    while (begin < sides.size() && !rep.done()) {
+      auto tSort = stats_.start();
+      size_t end = min(sides.size(), begin + chunk);
+      if (end < sides.size())
+        nth_element(sides.begin() + begin, sides.begin() + end, sides.end(),
+                    customComp());
+      sort(sides.begin() + begin, sides.begin() + end, customComp());
+      stats_.stop(IntxStage::sort, tSort);
+      sweep_events(sides, soa, begin, end, active, ws.cands, rep, nFiltered,
+                   nIntx, stats_);
+      begin = end;
+      chunk *= lazyChunkGrowth;
+    }
+    rep.flush();
+    return nIntx;
+  }
+  if constexpr (Reporter::stops) {
+    auto tSort = stats_.start();
+    sort_events(sides, eventSort_, nThreads_, &ws.sortScratch);
+    stats_.stop(IntxStage::sort, tSort);
+  }
+  if (serial) {
+    auto &active = ws.active_set<ActiveSet>();
+    init_active_set(active, yInts, yRange, yStep, groups_, groupMasks_.data(),
+                    nGroups);
+    Reporter rep(target, 0);
+    int nFiltered = 0, nIntx = 0;
+    sweep_events(sides, soa, 0, sides.size(), active, ws.cands, rep,
+                 nFiltered, nIntx, stats_);
+    rep.flush();
+
+    if (filtered_pairs != nullptr) {
+      *filtered_pairs = nFiltered;
+    }
+    return nIntx;
+  }
+
+  // position of the closing event of each interval, used for seeding
+  tBuild = stats_.start();
+  vector<uint32_t> endPos(segs_.size());
+  for (size_t k = 0; k < sides.size(); ++k) {
+    if (sides[k].iend == 1)
+      endPos[sides[k].id] = (uint32_t)k;
+  }
+
+  // a few slabs per thread keep all threads busy when the density of
+  // segments (and thus the sweep cost) varies along x
+  size_t nSlabs = min((size_t)(slabsPerThread * nThreads),
+                      sides.size() / minEventsPerSlab);
+  nThreads = (int)min((size_t)nThreads, nSlabs);
+  vector<size_t> bounds(nSlabs + 1);
+  for (size_t k = 0; k <= nSlabs; ++k) {
+    bounds[k] = sides.size() * k / nSlabs;
+  }
+  // seeds of each slab: the intervals open at its left boundary, in the
+  // order of their start events, found in one pass over the events
+  vector<vector<uint32_t>> seeds(nSlabs);
+  size_t nextBound = 1; // first slab starting after event k
+  for (size_t k = 0; k < sides.size(); ++k) {
+    while (nextBound < nSlabs && bounds[nextBound] <= k) {
+      ++nextBound;
+    }
+    if (sides[k].iend != 0)
+      continue;
+    uint32_t id = sides[k].id;
+    for (size_t islab = nextBound;
+         islab < nSlabs && bounds[islab] <= endPos[id]; ++islab) {
+      seeds[islab].push_back(id);
+    }
+  }
+  stats_.stop(IntxStage::build, tBuild);
+
+  atomic<size_t> nextSlab(0);
+  atomic<int> nFilteredAll(0), nIntxAll(0);
+  vector<intx_stats> threadStats(nThreads);
+  auto sweep_slabs = [&](int it) {
+    int nFiltered = 0, nIntx = 0;
+    ActiveSet active;
+    init_active_set(active, yInts, yRange, yStep, groups_, groupMasks_.data(),
+                    nGroups);
+    candidate_batch cands;
+    Reporter rep(target, it);
+    // a stopping query ends as soon as any thread has found its pair
+    for (size_t islab = nextSlab++; islab < nSlabs && !rep.done();
+         islab = nextSlab++) {
+      size_t begin = bounds[islab], end = bounds[islab + 1];
+      // seeding is part of the sweep cost of a slab
+      auto tSeed = threadStats[it].start();
+      active.clear();
+      for (auto id : seeds[islab]) {
+        active.insert(id);
       }
-      auto ins = curr_ovlps.insert(end.pI->id);
-    } else {
-      curr_ovlps.extract(end.pI->id);
+      threadStats[it].stop(IntxStage::sweep, tSeed);
+      sweep_events(sides, soa, begin, end, active, cands, rep, nFiltered,
+                   nIntx, threadStats[it]);
     }
+    rep.flush();
+    nFilteredAll += nFiltered;
+    nIntxAll += nIntx;
+  };
+
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it) {
+    workers.emplace_back(sweep_slabs, it);
+  }
+  sweep_slabs(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto &st : threadStats) {
+    stats_.merge(st);
   }
 
   if (filtered_pairs != nullptr) {
-    *filtered_pairs = nFiltered;
+    *filtered_pairs = nFilteredAll;
   }
-  return nIntx;
+  return nIntxAll;
 }
 
 int LsegIntersector::numIntx_BF() {
+  stats_.reset();
+  switch (exactCoords()) {
+  case ExactCoords::int32:
+    return count_BF(int_segments<int32_t>(segs_));
+  case ExactCoords::int64:
+    return count_BF(int_segments<int64_t>(segs_));
+  case ExactCoords::none:
+  default:
+    return count_BF(segs_);
+  }
+}
+
+// every tested pair, with the pair test of the coordinate type of Seg; only
+// the statistics need the type of intersection
+template <class Seg> int LsegIntersector::count_BF(const vector<Seg> &segs) {
+  using policy = conditional_t<intx_stats::enabled, intx_type, intx_bool>;
+  auto tExact = stats_.start();
   int nIntx = 0;
-  double params[2];
-  for (size_t is = 0; is < segs_.size(); ++is) {
-    for (size_t js = is + 1; js < segs_.size(); ++js) {
-      if (Lineseg::intx(segs_.at(is), segs_.at(js), params) > 0)
-        ++nIntx;
+  for (size_t is = 0; is < segs.size(); ++is) {
+    for (size_t js = is + 1; js < segs.size(); ++js) {
+      if (removed_[is] || removed_[js] || !testsPair(is, js))
+        continue;
+      int res = seg_intx<policy>(segs[is], segs[js]);
+      stats_.add_pair(res);
+      nIntx += res > 0;
     }
   }
+  stats_.stop(IntxStage::exact_tests, tExact);
   return nIntx;
-}
\ No newline at end of file
+}
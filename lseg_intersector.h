@@ -1,25 +1,119 @@
 #pragma once
+#include "arrangement.h"
+#include "dynamic_index.h"
+#include "event_sort.h"
 #include "interval.h"
+#include "intx_batch.h"
+#include "intx_report.h"
+#include "intx_stats.h"
+#include "kdop.h"
 #include "lseg.h"
+#include "seg_io.h"
+#include "seg_rtree.h"
+#include "sweep_axis.h"
+#include "sweep_workspace.h"
+#include <array>
 #include <cstdint>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
 using namespace std;
 
+// structure holding the segments crossed by the sweep line (see active_set.h)
+enum class ActiveSetType { hash, ybucket };
+
+// broad phase used by numIntx; automatic picks the sweep or the grid from
+// the segment extents
+enum class EngineType { sweep, grid, automatic };
+
 class LsegIntersector {
+public:
+  static const int maxGroups = 64;
+  // segment_file::open rejects the groups addSegs could not take
+  static_assert(maxGroups == seg_file_max_groups);
+
+private:
   vector<Lineseg> segs_;
   double tol_;
+  int nThreads_;
+  ActiveSetType activeSet_;
+  BatchIsa batchIsa_;
+  int kdopDirs_; // directions of the pair filter (kdop.h)
+  bool exactPredicates_;
+  EngineType engine_;
+  SweepAxis sweepAxis_;
+  EventSort eventSort_;
+  // group of each segment, and bit h of groupMasks_[g] set if the pairs
+  // between groups g and h are tested
+  vector<uint8_t> groups_;
+  array<uint64_t, maxGroups> groupMasks_;
+  uint64_t usedGroups_;
+  // removed segments keep their slot, so that indices stay valid
+  vector<uint8_t> removed_;
+  dynamic_index dynamic_;
+  // memory for the buffers of numIntx_stream, and where its runs go
+  size_t streamBudget_;
+  string tempDir_;
+  // statistics of the last query
+  intx_stats stats_;
+  // memory of the serial sweep, kept across queries; sharedWorkspace_, when
+  // set, is used instead of workspace_
+  sweep_workspace workspace_;
+  sweep_workspace *sharedWorkspace_;
+
+  sweep_workspace &workspace() {
+    return sharedWorkspace_ != nullptr ? *sharedWorkspace_ : workspace_;
+  }
+
+  // segment pairs (counted at the dynamic index) of the indexed segment is,
+  // skipping the pairs with changed segments of lower index
+  int count_dynamic(uint32_t is);
+  void build_dynamic();
+
+  // true when the group masks exclude some pairs of segments of the groups
+  // set in usedGroups
+  bool groupsFiltered(uint64_t usedGroups) const {
+    for (int g = 0; g < maxGroups; ++g) {
+      if (((usedGroups >> g) & 1) &&
+          (groupMasks_[g] & usedGroups) != usedGroups)
+        return true;
+    }
+    return false;
+  }
+  bool groupsFiltered() const { return groupsFiltered(usedGroups_); }
+
+  // integer type of the exact predicates for this query, if any; the
+  // broad phase works on doubles, which must hold the padded k-DOP bounds
+  // exactly
+  static constexpr double exactLimit = 0x1p48;
+  ExactCoords exactCoords() const {
+    return exactPredicates_ ? exact_coords_of(segs_, exactLimit)
+                            : ExactCoords::none;
+  }
+  // padding of the broad phase: tol_, or with exact predicates a fraction of
+  // the grid step, so that touching segments overlap in the strict interval
+  // tests while segments a step apart do not
+  double broadPadding(ExactCoords coords) const {
+    return coords == ExactCoords::none ? tol_ : 0.25;
+  }
+  // padding of a proximity join: half the clearance on each segment, with a
+  // margin for the rounding of the bounds
+  static double nearPadding(double clearance) {
+    return 0.5 * clearance * (1. + 1.e-9);
+  }
 
   // this function can easily be generalized to any 2d vector
   bool overlaps_along_y(const pair<uint32_t, uint32_t> &op) const {
     auto &seg1 = segs_[op.first];
-    intvl int1 = {min(seg1.S.y, seg1.E.y) - tol_,
-                  max(seg1.S.y, seg1.E.y) + tol_};
+    intvl int1 = {{min(seg1.S.y, seg1.E.y) - tol_,
+                   max(seg1.S.y, seg1.E.y) + tol_},
+                  op.first};
     auto &seg2 = segs_[op.second];
-    intvl int2 = {min(seg2.S.y, seg2.E.y) - tol_,
-                  max(seg2.S.y, seg2.E.y) + tol_};
+    intvl int2 = {{min(seg2.S.y, seg2.E.y) - tol_,
+                   max(seg2.S.y, seg2.E.y) + tol_},
+                  op.second};
     return intvl::intvl_ovlp(int1, int2);
   }
 
@@ -27,11 +121,11 @@ class LsegIntersector {
     auto &seg1 = segs_[op.first];
     auto d1S = 0.5 * (seg1.S.x + seg1.S.y);
     auto d1E = 0.5 * (seg1.E.x + seg1.E.y);
-    intvl int1 = {min(d1S, d1E) - tol_, max(d1S, d1E) + tol_};
+    intvl int1 = {{min(d1S, d1E) - tol_, max(d1S, d1E) + tol_}, op.first};
     auto &seg2 = segs_[op.second];
     auto d2S = 0.5 * (seg2.S.x + seg2.S.y);
     auto d2E = 0.5 * (seg2.E.x + seg2.E.y);
-    intvl int2 = {min(d2S, d2E) - tol_, max(d2S, d2E) + tol_};
+    intvl int2 = {{min(d2S, d2E) - tol_, max(d2S, d2E) + tol_}, op.second};
     return intvl::intvl_ovlp(int1, int2);
   }
 
@@ -39,11 +133,11 @@ class LsegIntersector {
     auto &seg1 = segs_[op.first];
     auto d1S = 0.5 * (seg1.S.x - seg1.S.y);
     auto d1E = 0.5 * (seg1.E.x - seg1.E.y);
-    intvl int1 = {min(d1S, d1E) - tol_, max(d1S, d1E) + tol_};
+    intvl int1 = {{min(d1S, d1E) - tol_, max(d1S, d1E) + tol_}, op.first};
     auto &seg2 = segs_[op.second];
     auto d2S = 0.5 * (seg2.S.x - seg2.S.y);
     auto d2E = 0.5 * (seg2.E.x - seg2.E.y);
-    intvl int2 = {min(d2S, d2E) - tol_, max(d2S, d2E) + tol_};
+    intvl int2 = {{min(d2S, d2E) - tol_, max(d2S, d2E) + tol_}, op.second};
     return intvl::intvl_ovlp(int1, int2);
   }
 
@@ -64,21 +158,276 @@ class LsegIntersector {
             max(S2.x - S2.y, E2.x - E2.y) + 4. * tol_);
   }
 
+  // sweep of the sorted endpoints [begin, end), starting from the segments
+  // already in the active set; each pair is counted at the start of its later
+  // interval, and intersecting pairs are passed to rep; cands holds the
+  // candidates of each start event
+  template <class ActiveSet, class Reporter>
+  void sweep_events(const vector<intvl_end> &sides, const seg_soa &soa,
+                    size_t begin, size_t end, ActiveSet &active,
+                    candidate_batch &cands, Reporter &rep, int &nFiltered,
+                    int &nIntx, intx_stats &stats) const;
+
+  // serial or slab-parallel sweep of the sorted endpoints (sorted here for a
+  // Reporter that stops)
+  template <class ActiveSet, class Reporter>
+  int sweep(vector<intvl_end> &sides, const seg_soa &soa,
+            const sweep_frame &frame, int *filtered_pairs,
+            const report_target *target);
+
+  template <class Seg> int count_BF(const vector<Seg> &segs);
+
+  // engines, with the reporters of intx_report.h; target is only used by
+  // intx_reporter
+  template <class Reporter>
+  int run_sweep(int *filtered_pairs, const report_target *target);
+  template <class Reporter>
+  int run_grid(int *filtered_pairs, const report_target *target);
+
+  // split points of the intersecting pairs, by the engine of numIntx, one
+  // list per thread; returns the number of pairs
+  int collect_splits(vector<vector<split_point>> &splits);
+  // pairs of one tile of numIntx_tiled, by the engine of numIntx; the ids
+  // of the segments index the boxes of the tile
+  int64_t count_tile_pairs(const tile_ref &tile);
+
 public:
-  LsegIntersector() : tol_(1.e-12) {}
+  LsegIntersector()
+      : tol_(1.e-12), nThreads_(1), activeSet_(ActiveSetType::ybucket),
+        batchIsa_(intx_batch_best_isa()), kdopDirs_(8),
+        exactPredicates_(false),
+        engine_(EngineType::sweep), sweepAxis_(SweepAxis::automatic),
+        eventSort_(EventSort::radix), usedGroups_(0),
+        streamBudget_((size_t)256 << 20), tempDir_("."),
+        sharedWorkspace_(nullptr) {
+    groupMasks_.fill(~(uint64_t)0);
+  }
+
+  void setTol(double tol) {
+    tol_ = tol;
+    dynamic_.built = false;
+  }
+
+  // number of threads used by numIntx; 0 means all available cores
+  void setNumThreads(int nThreads) { nThreads_ = nThreads; }
+
+  void setActiveSet(ActiveSetType activeSet) { activeSet_ = activeSet; }
+
+  // instruction set of the pair kernel; defaults to the best one available
+  void setBatchIsa(BatchIsa isa) { batchIsa_ = isa; }
 
-  void setTol(double tol) { tol_ = tol; }
+  // directions of the k-DOP bounds the pair filter tests (see kdop.h): 4, 8
+  // (the default) or 16; other values are rounded up
+  void setFilterDirections(int k) { kdopDirs_ = kdop_directions(k); }
+
+  // With exact predicates, when every coordinate is an integer (segments
+  // snapped to a grid, within +-2^48), numIntx, reportIntx and numIntx_BF
+  // classify the pairs with the exact integer tests of lseg_exact.h, with no
+  // tolerance; otherwise they fall back to Lineseg::intx.
+  void setExactPredicates(bool exact) {
+    exactPredicates_ = exact;
+    dynamic_.built = false;
+  }
+
+  void setEngine(EngineType engine) { engine_ = engine; }
+
+  // axis of the sweep (see sweep_axis.h); by default it is picked from a
+  // sample of the segments, and stats() tells which one was used
+  void setSweepAxis(SweepAxis axis) { sweepAxis_ = axis; }
+
+  // sort of the sweep events (see event_sort.h): radix by default, on the
+  // threads of setNumThreads
+  void setEventSort(EventSort method) { eventSort_ = method; }
+
+  // memory budget of numIntx_stream, in bytes, and the directory of its
+  // temporary files
+  void setStreamBudget(size_t memBudget, string tempDir = ".") {
+    streamBudget_ = memBudget;
+    tempDir_ = tempDir;
+  }
 
-  int addSeg(const Lineseg &seg) {
+  // Memory of the sweep (see sweep_workspace.h), e.g. one workspace per
+  // thread for the intersectors of that thread; nullptr goes back to the
+  // workspace of this object. The workspace must outlive its use here.
+  void setWorkspace(sweep_workspace *workspace) {
+    sharedWorkspace_ = workspace;
+  }
+
+  // engine numIntx will run, resolving automatic
+  EngineType selectEngine() const;
+
+  // Statistics of the last numIntx, numIntx_sweep, numIntx_grid, numIntx_BO,
+  // numIntx_BF, numIntx_stream or reportIntx (see intx_stats.h): time per
+  // stage, active-set sizes, candidate pairs and results by type. All zeros
+  // when built without LSEG_STATS.
+  const intx_stats &stats() const { return stats_; }
+
+  // group is in [0, maxGroups); with the default masks, the groups make no
+  // difference. Returns the number of segments, or -1 (and the segment is
+  // not added) if the group is out of range.
+  int addSeg(const Lineseg &seg, int group = 0) {
+    if (group < 0 || group >= maxGroups)
+      return -1;
     // leaving id tracking to the caller
     segs_.emplace_back(seg);
+    groups_.push_back((uint8_t)group);
+    removed_.push_back(0);
+    usedGroups_ |= (uint64_t)1 << group;
+    dynamic_.note_change((uint32_t)segs_.size() - 1);
     return (int)segs_.size();
   }
 
-  int numIntx_BF(); // brute force - intersect every pair
+  // removes all the segments, keeping the settings and the memory, for a
+  // new set of segments: with addSeg and numIntx, a stream of small
+  // queries on one object allocates nothing once warm
+  void clear() {
+    segs_.clear();
+    groups_.clear();
+    removed_.clear();
+    usedGroups_ = 0;
+    dynamic_ = dynamic_index();
+  }
+
+  // adds all the segments of a binary segment file, with their ids and
+  // groups if the file has them (below maxGroups, as segment_file::open
+  // checks). The coordinates are read from the mapping, with no parsing, but
+  // copied into the segments of this object, which the engines work on: the
+  // load is not zero-copy, and the file can be closed once added.
+  void addSegs(const segment_file &file);
+
+  // removes segment is (the one added by the (is + 1)-th call to addSeg);
+  // the other segments keep their index
+  bool removeSeg(int is) {
+    if (is < 0 || is >= (int)segs_.size() || removed_[is])
+      return false;
+    removed_[is] = 1;
+    dynamic_.note_change(is);
+    return true;
+  }
+
+  // moves segment is, keeping its group
+  bool updateSeg(int is, const Lineseg &seg) {
+    if (is < 0 || is >= (int)segs_.size() || removed_[is])
+      return false;
+    segs_[is] = seg;
+    dynamic_.note_change(is);
+    return true;
+  }
+
+  // whether the pairs between groups g1 and g2 are tested (and counted) by
+  // all engines; by default every pair is. false if a group is out of range.
+  bool setGroupPair(int g1, int g2, bool tested) {
+    if (g1 < 0 || g1 >= maxGroups || g2 < 0 || g2 >= maxGroups)
+      return false;
+    uint64_t bit1 = (uint64_t)1 << g1, bit2 = (uint64_t)1 << g2;
+    groupMasks_[g1] = tested ? groupMasks_[g1] | bit2 : groupMasks_[g1] & ~bit2;
+    groupMasks_[g2] = tested ? groupMasks_[g2] | bit1 : groupMasks_[g2] & ~bit1;
+    dynamic_.built = false;
+    return true;
+  }
+
+  // bichromatic (red-blue) mode, generalized to any number of groups: only
+  // the pairs between different groups are tested
+  void setCrossGroupsOnly() {
+    for (int g = 0; g < maxGroups; ++g) {
+      groupMasks_[g] = ~((uint64_t)1 << g);
+    }
+    dynamic_.built = false;
+  }
+
+  bool isRemoved(uint32_t is) const { return removed_[is]; }
 
-  // 2-stage pair filtration
+  bool testsPair(uint32_t is, uint32_t js) const {
+    return (groupMasks_[groups_[is]] >> groups_[js]) & 1;
+  }
+
+  int numIntx_BF(); // brute force - intersect every (tested) pair
+
+  // Bentley-Ottmann sweep (lseg_bo.cpp); filtered_pairs receives the number
+  // of pairs tested by the sweep
+  int numIntx_BO(int *filtered_pairs = nullptr);
+
+  // 2-stage pair filtration, with the engine set by setEngine
   int numIntx(int *filtered_pairs = nullptr);
+
+  // sweep broad phase, along the axis set by setSweepAxis
+  int numIntx_sweep(int *filtered_pairs = nullptr);
+
+  // uniform grid / quadtree broad phase (lseg_grid.cpp)
+  int numIntx_grid(int *filtered_pairs = nullptr);
+
+  // Count maintained across changes (lseg_grid.cpp): the first call indexes
+  // the segments in a persistent grid and counts all the intersections; the
+  // next ones only test the segments added, removed or updated since, so
+  // their cost follows the number of changes rather than the number of
+  // segments. The index is rebuilt when the tolerance, the exact predicates
+  // (or the integer type they need) or the group masks change, and when the
+  // number of segments has doubled.
+  int numIntx_dynamic();
+
+  // Out-of-core x-sweep of a binary segment file (lseg_stream.cpp), for sets
+  // that do not fit in memory; the segments added to this object are not
+  // used. The interval ends are sorted on disk, in runs, and only the active
+  // segments are held in memory besides buffers within the stream budget.
+  // Returns the same counts as numIntx_sweep on the segments of the file
+  // (with their groups and, with setExactPredicates, the exact predicates
+  // of the integer type they need), or -1 if the file cannot be read. The
+  // counts are 64-bit, for files of billions of segments.
+  int64_t numIntx_stream(string segfile, int64_t *filtered_pairs = nullptr);
+
+  // Count sharded over worker processes (lseg_tiles.cpp): the box of the
+  // segments is cut into nTilesX x nTilesY tiles (about 2 per worker when
+  // 0), and each tile is counted by one of nWorkers forked processes (0: one
+  // per core), with the settings of this object. A pair that straddles tile
+  // boundaries is only counted in the tile of its reference point, so the
+  // sum is the count of numIntx. Returns -1 if a worker fails; on Windows,
+  // the tiles are counted in this process.
+  int numIntx_tiled(int nWorkers = 0, int nTilesX = 0, int nTilesY = 0);
+
+  // Streams every intersection found by numIntx to sink, by chunks of up to
+  // chunkSize records, and returns their number. Each thread buffers its own
+  // chunk; with concurrentSink the threads call sink without locking, so it
+  // must be thread-safe (e.g. one output per thread index), otherwise the
+  // calls are serialized. Records come in no particular order.
+  int reportIntx(const IntxSink &sink, bool concurrentSink = false,
+                 size_t chunkSize = 4096);
+
+  // Whether any two tested segments intersect (e.g. polygon validity): the
+  // sweep of numIntx_sweep, stopped at the first intersecting pair, whose
+  // record goes to first when given. Serially, the events are sorted in
+  // growing chunks as the sweep reaches them, so the cost of an early hit
+  // does not include the sort; with several threads, all the slabs stop as
+  // soon as one of them finds a pair, which is then any of the pairs.
+  bool anyIntersection(IntxRecord *first = nullptr);
+
+  // Proximity join: the tested pairs of segments closer than clearance
+  // (Lineseg::dist), for clearances well above the tolerance. It runs the
+  // engine of numIntx with the sweep, the buckets and the k-DOP filter padded
+  // by clearance / 2, and a distance test that settles most pairs on cheap
+  // bounds (see intx_batch.cpp); exact predicates are not used. Returns the
+  // number of pairs, and streams them to sink when given, like reportIntx.
+  int proximityJoin(double clearance, const NearSink &sink = nullptr,
+                    bool concurrentSink = false, size_t chunkSize = 4096);
+
+  // Noding (lseg_noding.cpp): the planar arrangement of the segments
+  // (removed ones excluded), each one split at the points where it meets the
+  // others, as found by the engine of numIntx, with points within tol_ (at
+  // least eps) of each other merged into one vertex. The crossings come from
+  // the alfa and beta of Lineseg::intx, and the points of touching and
+  // overlapping pairs are the input endpoints involved. Memory is linear in
+  // the segments plus the intersections.
+  arrangement nodeSegs();
+
+  // Index of the current segments (removed ones excluded), for batches of
+  // query segments tested against a fixed set (see seg_rtree.h): a packed
+  // R-tree, built once, that can be saved and loaded, and queried by many
+  // threads at a time. It keeps its own copy of the geometry, so later
+  // changes to this object do not affect it.
+  seg_rtree buildIndex() const {
+    seg_rtree index;
+    index.build(segs_, removed_, tol_);
+    return index;
+  }
 };
 
 // initial set if tests - considerably more should be added
@@ -86,10 +435,32 @@ int test_intersector_1();
 int test_intersector_2();
 int test_intersector_3(ofstream &out, int nSegments, double maxSegLength,
                        bool BF = false);
+int test_intersector_MT(int nSegments, double maxSegLength);
+int test_active_sets_from_file(string segfile);
+int test_intx_batch(int nPairs);
+int test_intersector_BO(int nSegs);
+int test_intersector_grid(int nSegs);
+int test_intx_report(int nSegs);
+int test_intersector_groups(int nSegs);
+int test_intersector_dynamic(int nSegs);
+int test_segment_io(int nSegs);
+int test_intersector_stream(int nSegs);
+int test_intx_stats(int nSegs);
+int test_sweep_axis(int nSegs);
+int test_exact_predicates(int nPairs);
+int test_intx_policies(int nPairs);
+int test_any_intersection(int nSegs);
+int test_segment_index(int nSegs, int nQueries);
+int test_event_sort(int nEvents);
+int test_case_batch(int nCases);
+int test_intersector_tiled(int nSegs);
+int test_noding(int nSegs);
+int test_proximity_join(int nSegs);
+int benchmark_engines_from_file(string segfile, int bfMaxSegs = 10000);
+int benchmark_engines(int nSegments, int run);
 
 shared_ptr<vector<Lineseg>> random_segment_generator(int nSeg, double maxLen);
 
-shared_ptr<vector<Lineseg>> read_segments_from_file(string segfile);
 void write_segments_to_file(vector<Lineseg> &segments, string segfile);
 
 void generate_random_case(int nSeg, double maxsegLen, string caseName);
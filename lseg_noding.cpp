@@ -0,0 +1,240 @@
+#include "arrangement.h"
+#include "intx_report.h"
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Noding, used by nodeSegs.
+ *
+ * The engine of numIntx hands every intersecting pair to node_reporter,
+ * which adds the points where the two segments meet to the split points of
+ * both (intx_report.h). The split points are then grouped by segment, with
+ * a counting sort, and sorted along each segment between its endpoints.
+ *
+ * Points within the merge distance of each other are joined into one vertex
+ * (union-find). They are binned in square cells no smaller than the merge
+ * distance, so that the points to join are in neighbouring cells, and sorted
+ * by row and column of their cell. Each point is tested against the points
+ * after it in its own cell and the next one of its row, and against the 3
+ * cells below it in the next row, which a pointer per row reaches as the
+ * points go by, so that after the sort the pass is linear. Points with the
+ * same coordinates, like a crossing shared by several segments, are joined
+ * first, and only the first of them is tested. A vertex sits at an input
+ * endpoint of its points if there is one.
+ *
+ * The edges are the runs between consecutive vertices along each segment;
+ * an edge between the same two vertices as an earlier one, where segments
+ * overlap, is dropped.
+ */
+
+namespace {
+
+// a split point, or an endpoint, of segment is
+struct node_point {
+  Pnt2 P;
+  double t;
+  uint32_t is;
+  bool end;
+};
+
+// a point in its cell
+struct binned_point {
+  int64_t row, col;
+  double x, y;
+  uint32_t p;
+
+  bool operator<(const binned_point &b) const {
+    if (row != b.row)
+      return row < b.row;
+    if (col != b.col)
+      return col < b.col;
+    return x < b.x || (x == b.x && y < b.y);
+  }
+  // whether the cell is before (row, col)
+  bool before(int64_t r, int64_t c) const {
+    return row < r || (row == r && col < c);
+  }
+};
+
+struct disjoint_sets {
+  vector<uint32_t> parent;
+
+  explicit disjoint_sets(size_t n) : parent(n) {
+    iota(parent.begin(), parent.end(), 0);
+  }
+  uint32_t find(uint32_t k) {
+    while (parent[k] != k) {
+      parent[k] = parent[parent[k]];
+      k = parent[k];
+    }
+    return k;
+  }
+  void join(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a != b)
+      parent[max(a, b)] = min(a, b);
+  }
+};
+
+// cells are at least this fraction of the extent of the points, so that
+// their indices fit in 64 bits
+const double minCellFraction = 0x1p-40;
+
+} // namespace
+
+arrangement LsegIntersector::nodeSegs() {
+  stats_.reset();
+  arrangement arr;
+  vector<vector<split_point>> splits;
+  arr.nIntx = collect_splits(splits);
+
+  // split points grouped by segment, each thread's list freed once copied
+  size_t nSegs = segs_.size();
+  vector<size_t> start(nSegs + 1, 0);
+  for (const auto &list : splits) {
+    for (const auto &sp : list) {
+      ++start[sp.is + 1];
+    }
+  }
+  for (size_t is = 0; is < nSegs; ++is) {
+    start[is + 1] += start[is];
+  }
+  vector<split_point> bySeg(start[nSegs]);
+  vector<size_t> next(start.begin(), start.end() - 1);
+  for (auto &list : splits) {
+    for (const auto &sp : list) {
+      bySeg[next[sp.is]++] = sp;
+    }
+    vector<split_point>().swap(list);
+  }
+  vector<size_t>().swap(next);
+
+  // the points of each live segment: S, the split points along it, E
+  vector<node_point> pts;
+  pts.reserve(2 * nSegs + bySeg.size());
+  for (uint32_t is = 0; is < (uint32_t)nSegs; ++is) {
+    if (removed_[is])
+      continue;
+    auto first = bySeg.begin() + start[is];
+    auto last = bySeg.begin() + start[is + 1];
+    // ties by coordinates, so that the order does not depend on the threads
+    sort(first, last, [](const split_point &a, const split_point &b) {
+      if (a.t != b.t)
+        return a.t < b.t;
+      return a.P.x < b.P.x || (a.P.x == b.P.x && a.P.y < b.P.y);
+    });
+    pts.push_back(node_point{segs_[is].S, 0., is, true});
+    for (auto it = first; it != last; ++it) {
+      pts.push_back(node_point{it->P, it->t, is, false});
+    }
+    pts.push_back(node_point{segs_[is].E, 1., is, true});
+  }
+  vector<split_point>().swap(bySeg);
+  vector<size_t>().swap(start);
+  if (pts.empty())
+    return arr;
+
+  // cells of the points
+  double d = max(tol_, eps);
+  double x0 = pts[0].P.x, y0 = pts[0].P.y, x1 = x0, y1 = y0;
+  for (const auto &p : pts) {
+    x0 = min(x0, p.P.x);
+    y0 = min(y0, p.P.y);
+    x1 = max(x1, p.P.x);
+    y1 = max(y1, p.P.y);
+  }
+  double cell = max(d, max(x1 - x0, y1 - y0) * minCellFraction);
+  size_t nPts = pts.size();
+  vector<binned_point> bins(nPts);
+  for (uint32_t p = 0; p < (uint32_t)nPts; ++p) {
+    const auto &P = pts[p].P;
+    bins[p] = binned_point{(int64_t)floor((P.y - y0) / cell),
+                           (int64_t)floor((P.x - x0) / cell), P.x, P.y, p};
+  }
+  sort(bins.begin(), bins.end());
+
+  disjoint_sets sets(nPts);
+  vector<uint8_t> repeat(nPts, 0); // same coordinates as the point before
+  for (size_t k = 1; k < nPts; ++k) {
+    if (bins[k].x == bins[k - 1].x && bins[k].y == bins[k - 1].y) {
+      repeat[k] = 1;
+      sets.join(bins[k].p, bins[k - 1].p);
+    }
+  }
+  double dSq = d * d;
+  auto join_near = [&](size_t k, size_t j) {
+    double dx = bins[k].x - bins[j].x, dy = bins[k].y - bins[j].y;
+    if (!repeat[j] && dx * dx + dy * dy <= dSq)
+      sets.join(bins[k].p, bins[j].p);
+  };
+  size_t below = 0; // first point of the next row at or after column - 1
+  for (size_t k = 0; k < nPts; ++k) {
+    if (repeat[k])
+      continue;
+    int64_t row = bins[k].row, col = bins[k].col;
+    for (size_t j = k + 1; j < nPts && bins[j].before(row, col + 2); ++j) {
+      join_near(k, j);
+    }
+    while (below < nPts && bins[below].before(row + 1, col - 1)) {
+      ++below;
+    }
+    for (size_t j = below; j < nPts && bins[j].before(row + 1, col + 2); ++j) {
+      join_near(k, j);
+    }
+  }
+  vector<binned_point>().swap(bins);
+  vector<uint8_t>().swap(repeat);
+
+  // vertices, at an endpoint when their points have one
+  const uint32_t none = ~(uint32_t)0;
+  vector<uint32_t> vertexOf(nPts, none);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t p = 0; p < (uint32_t)nPts; ++p) {
+      uint32_t root = sets.find(p);
+      if (pts[p].end == (pass == 0) && vertexOf[root] == none) {
+        vertexOf[root] = (uint32_t)arr.vertices.size();
+        arr.vertices.push_back(pts[p].P);
+      }
+    }
+  }
+
+  // edges along each segment, then the repeated ones dropped
+  for (size_t k = 0; k < nPts;) {
+    uint32_t is = pts[k].is;
+    uint32_t v = vertexOf[sets.find((uint32_t)k)];
+    for (++k; k < nPts && pts[k].is == is; ++k) {
+      uint32_t w = vertexOf[sets.find((uint32_t)k)];
+      if (w != v)
+        arr.edges.push_back(arrangement_edge{v, w, is});
+      v = w;
+    }
+  }
+  // (lower vertex, higher vertex, edge) in one sortable key each
+  vector<pair<uint64_t, uint32_t>> byEnds(arr.edges.size());
+  for (uint32_t ie = 0; ie < (uint32_t)arr.edges.size(); ++ie) {
+    const auto &e = arr.edges[ie];
+    byEnds[ie] = {(uint64_t)min(e.v0, e.v1) << 32 | max(e.v0, e.v1), ie};
+  }
+  sort(byEnds.begin(), byEnds.end());
+  vector<uint8_t> dropped(arr.edges.size(), 0);
+  for (size_t k = 1; k < byEnds.size(); ++k) {
+    if (byEnds[k].first == byEnds[k - 1].first)
+      dropped[byEnds[k].second] = 1;
+  }
+  size_t nKept = 0;
+  for (size_t k = 0; k < arr.edges.size(); ++k) {
+    if (!dropped[k])
+      arr.edges[nKept++] = arr.edges[k];
+  }
+  arr.edges.resize(nKept);
+  return arr;
+}
@@ -0,0 +1,450 @@
+#include "active_set.h"
+#include "interval.h"
+#include "intx_batch.h"
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include "seg_io.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Out-of-core x-sweep, used by numIntx_stream.
+ *
+ * The binary segment file is read block by block, and the starts and ends
+ * of the x-extents are written to disk as sorted runs, each of them fitting
+ * in the memory budget. The padding, which depends on the predicates that
+ * the whole file allows, is only applied during the sweep; as it is the same
+ * for all the segments, it does not change the order of the runs. The start events carry the geometry of
+ * their segment, so the input is never read again: the runs are merged (in
+ * several passes when there are too many to all be read at once within the
+ * budget) and consumed in x order, with the ends before the starts at equal
+ * x, as in numIntx_sweep. Only the active segments stay in memory, in slots
+ * that are renumbered when they run out.
+ */
+
+namespace {
+
+struct stream_start {
+  double x;     // start of the x-extent
+  uint64_t seg; // position of the segment in the file
+  double sx, sy, ex, ey;
+  uint32_t group;
+  uint32_t pad;
+};
+
+struct stream_end {
+  double x;
+  uint64_t seg;
+};
+
+// input bytes per segment: coordinates, id and group
+const size_t inputBytesPerSeg = 4 * sizeof(double) + 5;
+const size_t minRunSegs = 1024;
+// a merge reads each run through a buffer of at least this size
+const size_t minReaderBytes = (size_t)64 << 10;
+const size_t minActiveSlots = 1024;
+
+struct run_file {
+  string path;
+  uint64_t nRecs;
+};
+
+// temporary files, removed when done
+struct temp_files {
+  string prefix;
+  size_t next = 0;
+  vector<string> paths;
+
+  explicit temp_files(const string &dir) {
+    auto stamp = chrono::steady_clock::now().time_since_epoch().count();
+    prefix = dir + "/lseg_stream_" + to_string(stamp) + "_";
+  }
+  ~temp_files() {
+    for (const auto &path : paths) {
+      remove(path.c_str());
+    }
+  }
+  string make() {
+    paths.push_back(prefix + to_string(next++) + ".run");
+    return paths.back();
+  }
+};
+
+template <class Rec>
+bool write_run(vector<Rec> &recs, temp_files &temps, vector<run_file> &runs) {
+  sort(recs.begin(), recs.end(),
+       [](const Rec &r1, const Rec &r2) { return r1.x < r2.x; });
+  string path = temps.make();
+  ofstream out(path, ios::binary);
+  out.write((const char *)recs.data(), recs.size() * sizeof(Rec));
+  if (!out) {
+    cout << "!!!!! unable to write " << path << " !!!!!\n";
+    return false;
+  }
+  runs.push_back(run_file{path, recs.size()});
+  recs.clear();
+  return true;
+}
+
+// sequential reader of a run, through a buffer
+template <class Rec> struct run_reader {
+  ifstream in;
+  vector<Rec> buf;
+  size_t pos = 0, n = 0;
+  uint64_t left = 0; // records still in the file
+
+  void open(const run_file &run, size_t bufRecs) {
+    in.open(run.path, ios::binary);
+    buf.resize(max(bufRecs, (size_t)1));
+    left = run.nRecs;
+    fill();
+  }
+  void fill() {
+    n = (size_t)min(left, (uint64_t)buf.size());
+    in.read((char *)buf.data(), n * sizeof(Rec));
+    left -= n;
+    pos = 0;
+  }
+  bool empty() const { return pos == n; }
+  const Rec &top() const { return buf[pos]; }
+  void pop() {
+    if (++pos == n)
+      fill();
+  }
+};
+
+// k-way merge of sorted runs
+template <class Rec> struct run_merger {
+  vector<unique_ptr<run_reader<Rec>>> readers;
+  using entry = pair<double, size_t>; // (x, reader)
+  priority_queue<entry, vector<entry>, greater<entry>> heap;
+
+  void open(const vector<run_file> &runs, size_t bufRecs) {
+    for (const auto &run : runs) {
+      readers.push_back(make_unique<run_reader<Rec>>());
+      readers.back()->open(run, bufRecs);
+      if (!readers.back()->empty())
+        heap.push(entry(readers.back()->top().x, readers.size() - 1));
+    }
+  }
+  bool empty() const { return heap.empty(); }
+  const Rec &top() const { return readers[heap.top().second]->top(); }
+  void pop() {
+    size_t ir = heap.top().second;
+    heap.pop();
+    readers[ir]->pop();
+    if (!readers[ir]->empty())
+      heap.push(entry(readers[ir]->top().x, ir));
+  }
+};
+
+// merges groups of maxRuns runs until there are at most maxRuns
+template <class Rec>
+bool reduce_runs(vector<run_file> &runs, size_t maxRuns, size_t bufRecs,
+                 temp_files &temps) {
+  while (runs.size() > maxRuns) {
+    vector<run_file> merged;
+    for (size_t k = 0; k < runs.size(); k += maxRuns) {
+      vector<run_file> group(runs.begin() + k,
+                             runs.begin() + min(k + maxRuns, runs.size()));
+      if (group.size() == 1) {
+        merged.push_back(group[0]);
+        continue;
+      }
+      run_merger<Rec> merger;
+      merger.open(group, bufRecs);
+      run_file out = {temps.make(), 0};
+      ofstream fOut(out.path, ios::binary);
+      vector<Rec> buf;
+      buf.reserve(bufRecs);
+      while (!merger.empty()) {
+        buf.push_back(merger.top());
+        merger.pop();
+        if (buf.size() == bufRecs || merger.empty()) {
+          fOut.write((const char *)buf.data(), buf.size() * sizeof(Rec));
+          out.nRecs += buf.size();
+          buf.clear();
+        }
+      }
+      if (!fOut) {
+        cout << "!!!!! unable to write " << out.path << " !!!!!\n";
+        return false;
+      }
+      merger = run_merger<Rec>();
+      for (const auto &run : group) {
+        remove(run.path.c_str());
+      }
+      merged.push_back(out);
+    }
+    runs = std::move(merged);
+  }
+  return true;
+}
+
+// the active segments, in slots indexed like the segments of the in-memory
+// sweep
+struct stream_actives {
+  seg_soa soa;
+  vector<intvl> yInts;
+  vector<uint8_t> groups;
+  unordered_map<uint64_t, uint32_t> slotOf; // file position -> slot
+  uint32_t nSlots = 0;                     // slots used since the last reset
+
+  // sizes the slots for at least 4 times the active segments, renumbering
+  // those and returning their (file position, slot) pairs
+  vector<pair<uint64_t, uint32_t>> renumber() {
+    size_t capacity = max(4 * slotOf.size(), minActiveSlots);
+    seg_soa newSoa;
+    newSoa.init(capacity, soa.tol, soa.nDirs);
+    newSoa.exact = soa.exact;
+    vector<intvl> newYInts(capacity);
+    vector<uint8_t> newGroups(capacity, 0);
+    vector<pair<uint64_t, uint32_t>> moved;
+    nSlots = 0;
+    for (auto &[seg, slot] : slotOf) {
+      uint32_t is = nSlots++;
+      newSoa.set(is, soa.sx[slot], soa.sy[slot], soa.ex[slot], soa.ey[slot]);
+      newYInts[is] = intvl{yInts[slot].ends, is};
+      newGroups[is] = groups[slot];
+      slot = is;
+      moved.emplace_back(seg, is);
+    }
+    soa = std::move(newSoa);
+    yInts = std::move(newYInts);
+    groups = std::move(newGroups);
+    return moved;
+  }
+};
+
+struct stream_query {
+  double pad; // padding of the broad phase, as numIntx_sweep pads
+  ExactCoords exact;
+  int kdopDirs;
+  BatchIsa isa;
+  intvl yRange;
+  double yStep;
+  const uint64_t *groupMasks;
+  int nGroups;
+};
+
+template <class ActiveSet>
+int64_t stream_sweep(run_merger<stream_start> &starts,
+                     run_merger<stream_end> &ends, const stream_query &q,
+                     int64_t *filtered_pairs, intx_stats &stats) {
+  auto tSweep = stats.start();
+  double exactMark = stats.mark(IntxStage::exact_tests);
+  stream_actives actives;
+  actives.soa.init(0, q.pad, q.kdopDirs);
+  actives.soa.exact = q.exact;
+  ActiveSet active;
+  auto reset = [&]() {
+    auto moved = actives.renumber();
+    init_active_set(active, actives.yInts, q.yRange, q.yStep, actives.groups,
+                    q.groupMasks, q.nGroups);
+    for (const auto &entry : moved) {
+      active.insert(entry.second);
+    }
+  };
+  reset();
+
+  vector<uint32_t> cands;
+  vector<int8_t> res;
+  int64_t nFiltered = 0, nIntx = 0;
+  // the segments that end after the last start do not matter
+  while (!starts.empty()) {
+    if (!ends.empty() && ends.top().x + q.pad <= starts.top().x - q.pad) {
+      // the end of a segment narrower than the rounding of the padding
+      // can come before its start, which then stays active, as in the
+      // in-memory sweep
+      auto it = actives.slotOf.find(ends.top().seg);
+      if (it != actives.slotOf.end()) {
+        active.erase(it->second);
+        actives.slotOf.erase(it);
+      }
+      ends.pop();
+      stats.add_events(1);
+      continue;
+    }
+    const stream_start &st = starts.top();
+    // erased slots are only reused after a reset, as the active sets may
+    // still list them
+    if (actives.nSlots == actives.yInts.size())
+      reset();
+    uint32_t is = actives.nSlots++;
+    actives.soa.set(is, st.sx, st.sy, st.ex, st.ey);
+    actives.yInts[is] = intvl{{min(st.sy, st.ey) - q.pad,
+                               max(st.sy, st.ey) + q.pad},
+                              is};
+    actives.groups[is] = (uint8_t)st.group;
+    actives.slotOf[st.seg] = is;
+    starts.pop();
+
+    cands.clear();
+    active.for_each_ovlp(is, [&](uint32_t id) { cands.push_back(id); });
+    res.resize(cands.size());
+    stats.time_exact(cands.size(), [&] {
+      intx_batch(actives.soa, is, cands.data(), cands.size(), res.data(),
+                 q.isa);
+    });
+    if constexpr (intx_stats::enabled) {
+      stats.add_events(1);
+      stats.note_active(active.size());
+      stats.add_pairs(res.data(), res.size());
+    }
+    for (auto pair_res : res) {
+      nFiltered += pair_res >= 0;
+      nIntx += pair_res > 0;
+    }
+    active.insert(is);
+  }
+  stats.stop(IntxStage::sweep, tSweep);
+  stats.exclude(IntxStage::sweep, IntxStage::exact_tests, exactMark);
+  if (filtered_pairs != nullptr) {
+    *filtered_pairs = nFiltered;
+  }
+  return nIntx;
+}
+
+} // namespace
+
+int64_t LsegIntersector::numIntx_stream(string segfile,
+                                        int64_t *filtered_pairs) {
+  stats_.reset();
+  auto tBuild = stats_.start();
+  ifstream in(segfile, ios::binary | ios::ate);
+  if (!in.is_open()) {
+    cout << "!!!!! unable to open " << segfile << " !!!!!\n";
+    return -1;
+  }
+  size_t fileSize = (size_t)in.tellg();
+  in.seekg(0);
+  seg_file_header header = {};
+  in.read((char *)&header, sizeof(header));
+  if (check_seg_file_header(header, in ? fileSize : 0, segfile) == 0)
+    return -1;
+  uint64_t nSegs = header.nSegs;
+  size_t coordsBytes = nSegs * 4 * sizeof(double);
+  // the id and group sections are read alongside the coordinates
+  ifstream inGroups;
+  if (header.flags & seg_file_groups) {
+    inGroups.open(segfile, ios::binary);
+    size_t idsBytes =
+        (header.flags & seg_file_ids) ? nSegs * sizeof(uint32_t) : 0;
+    inGroups.seekg(sizeof(header) + coordsBytes + idsBytes);
+  }
+
+  // sorted runs of the interval starts and ends
+  temp_files temps(tempDir_);
+  size_t segsPerRun = max(
+      streamBudget_ / (sizeof(stream_start) + sizeof(stream_end) +
+                       inputBytesPerSeg),
+      minRunSegs);
+  vector<stream_start> starts;
+  vector<stream_end> ends;
+  vector<double> coords;
+  vector<uint8_t> groups;
+  vector<run_file> startRuns, endRuns;
+  intvl yRange = {{0., 0.}, 0};
+  double ySum = 0.;
+  // integer type of the exact predicates, narrowed as the segments are read
+  ExactCoords exact =
+      exactPredicates_ ? ExactCoords::int32 : ExactCoords::none;
+  uint64_t usedGroups = 0;
+  starts.reserve((size_t)min((uint64_t)segsPerRun, nSegs));
+  ends.reserve(starts.capacity());
+  for (uint64_t first = 0; first < nSegs; first += segsPerRun) {
+    size_t n = (size_t)min((uint64_t)segsPerRun, nSegs - first);
+    coords.resize(4 * n);
+    in.read((char *)coords.data(), coords.size() * sizeof(double));
+    groups.assign(n, 0);
+    if (inGroups.is_open())
+      inGroups.read((char *)groups.data(), n);
+    if (!in || (inGroups.is_open() && !inGroups)) {
+      cout << "!!!!! unable to read " << segfile << " !!!!!\n";
+      return -1;
+    }
+    if (!valid_seg_groups(groups.data(), n, segfile))
+      return -1;
+    for (size_t k = 0; k < n; ++k) {
+      const double *c = &coords[4 * k];
+      double y0 = min(c[1], c[3]), y1 = max(c[1], c[3]);
+      yRange.ends[0] = first + k == 0 ? y0 : min(yRange.ends[0], y0);
+      yRange.ends[1] = first + k == 0 ? y1 : max(yRange.ends[1], y1);
+      ySum += y1 - y0;
+      usedGroups |= (uint64_t)1 << groups[k];
+      if (exact != ExactCoords::none) {
+        ExactCoords segCoords = exact_coords_of(
+            Lineseg(Pnt2(c[0], c[1]), Pnt2(c[2], c[3])), exactLimit);
+        if (segCoords != ExactCoords::int32)
+          exact = segCoords;
+      }
+      starts.push_back(stream_start{min(c[0], c[2]), first + k, c[0], c[1],
+                                    c[2], c[3], groups[k], 0});
+      ends.push_back(stream_end{max(c[0], c[2]), first + k});
+    }
+    if (!write_run(starts, temps, startRuns) ||
+        !write_run(ends, temps, endRuns))
+      return -1;
+  }
+  coords = vector<double>();
+  groups = vector<uint8_t>();
+  starts = vector<stream_start>();
+  ends = vector<stream_end>();
+  stats_.stop(IntxStage::build, tBuild);
+
+  // the final merge reads up to 2 * maxRuns runs at once, an intermediate one
+  // maxRuns runs and writes one
+  auto tSort = stats_.start();
+  size_t maxRuns = max(streamBudget_ / (4 * minReaderBytes), (size_t)2);
+  size_t readerBytes = streamBudget_ / (2 * maxRuns + 1);
+  size_t startRecs = max(readerBytes / sizeof(stream_start), (size_t)1);
+  size_t endRecs = max(readerBytes / sizeof(stream_end), (size_t)1);
+  if (!reduce_runs<stream_start>(startRuns, maxRuns, startRecs, temps) ||
+      !reduce_runs<stream_end>(endRuns, maxRuns, endRecs, temps))
+    return -1;
+  run_merger<stream_start> startMerger;
+  run_merger<stream_end> endMerger;
+  startMerger.open(startRuns, startRecs);
+  endMerger.open(endRuns, endRecs);
+  stats_.stop(IntxStage::sort, tSort);
+
+  double pad = broadPadding(exact);
+  yRange.ends[0] -= pad;
+  yRange.ends[1] += pad;
+  stream_query q = {pad,
+                    exact,
+                    kdopDirs_,
+                    batchIsa_,
+                    yRange,
+                    nSegs > 0 ? ySum / nSegs + 2. * pad : 0.,
+                    groupMasks_.data(),
+                    (int)bit_width(usedGroups)};
+  bool grouped = groupsFiltered(usedGroups);
+  switch (activeSet_) {
+  case ActiveSetType::hash:
+    return grouped ? stream_sweep<grouped_active_set<hash_active_set>>(
+                         startMerger, endMerger, q, filtered_pairs, stats_)
+                   : stream_sweep<hash_active_set>(startMerger, endMerger, q,
+                                                   filtered_pairs, stats_);
+  case ActiveSetType::ybucket:
+  default:
+    return grouped ? stream_sweep<grouped_active_set<ybucket_active_set>>(
+                         startMerger, endMerger, q, filtered_pairs, stats_)
+                   : stream_sweep<ybucket_active_set>(
+                         startMerger, endMerger, q, filtered_pairs, stats_);
+  }
+}
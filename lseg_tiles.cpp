@@ -0,0 +1,203 @@
+#include "intx_report.h"
+#include "lseg.h"
+#include "lseg_exact.h"
+#include "lseg_intersector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ * Tiled count, used by numIntx_tiled.
+ *
+ * The box of the segments is cut into a grid of tiles, and each segment goes
+ * to every tile its box (padded by the tolerance) overlaps. The tiles are
+ * counted by worker processes, forked with a copy of the segments and the
+ * tile lists; each worker runs the engine of an LsegIntersector on the
+ * segments of its tiles, one tile at a time, with a reporter that only
+ * counts the pairs of the tile (tile_reporter, intx_report.h), and writes
+ * its count to a pipe, which the coordinator reads and sums.
+ *
+ * A pair of segments that straddles a tile boundary is found in every tile
+ * the two share. It is counted in one of them only: the tile holding the
+ * lower-left corner of the intersection of the two padded boxes, its
+ * reference point. The point lies in both boxes, so both segments were
+ * given its tile, and every worker computes the same point from the same
+ * boxes, so exactly one tile counts the pair.
+ */
+
+namespace {
+
+// what a worker sends back through its pipe
+struct tile_result {
+  int64_t nIntx;
+  int64_t ok; // 0 if the worker failed
+};
+
+#ifndef _WIN32
+bool write_all(int fd, const void *data, size_t size) {
+  const char *p = (const char *)data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+  char *p = (char *)data;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+#endif
+
+} // namespace
+
+int LsegIntersector::numIntx_tiled(int nWorkers, int nTilesX, int nTilesY) {
+  stats_.reset();
+  if (nWorkers <= 0)
+    nWorkers = (int)thread::hardware_concurrency();
+  nWorkers = max(nWorkers, 1);
+
+  // padded boxes: any two segments that Lineseg::intx finds in contact
+  // have overlapping boxes
+  double pad = max(tol_, eps);
+  vector<tile_box> boxes(segs_.size());
+  tile_box all = {0., 0., 0., 0.};
+  bool first = true;
+  for (size_t is = 0; is < segs_.size(); ++is) {
+    const auto &seg = segs_[is];
+    boxes[is] = {min(seg.S.x, seg.E.x) - pad, min(seg.S.y, seg.E.y) - pad,
+                 max(seg.S.x, seg.E.x) + pad, max(seg.S.y, seg.E.y) + pad};
+    if (removed_[is])
+      continue;
+    all = first ? boxes[is]
+                : tile_box{min(all.x0, boxes[is].x0), min(all.y0, boxes[is].y0),
+                           max(all.x1, boxes[is].x1), max(all.y1, boxes[is].y1)};
+    first = false;
+  }
+
+  // about 2 tiles per worker by default, for some balance
+  tile_grid grid;
+  if (nTilesX <= 0 || nTilesY <= 0) {
+    nTilesX = max((int)round(sqrt(2. * nWorkers)), 1);
+    nTilesY = (2 * nWorkers + nTilesX - 1) / nTilesX;
+  }
+  grid.nx = nTilesX;
+  grid.ny = nTilesY;
+  grid.x0 = all.x0;
+  grid.y0 = all.y0;
+  grid.w = all.x1 > all.x0 ? (all.x1 - all.x0) / grid.nx : 1.;
+  grid.h = all.y1 > all.y0 ? (all.y1 - all.y0) / grid.ny : 1.;
+  vector<vector<uint32_t>> tileSegs((size_t)grid.nx * grid.ny);
+  for (uint32_t is = 0; is < (uint32_t)segs_.size(); ++is) {
+    if (removed_[is])
+      continue;
+    const auto &b = boxes[is];
+    for (int ty = grid.tile_y(b.y0); ty <= grid.tile_y(b.y1); ++ty) {
+      for (int tx = grid.tile_x(b.x0); tx <= grid.tile_x(b.x1); ++tx) {
+        tileSegs[(size_t)ty * grid.nx + tx].push_back(is);
+      }
+    }
+  }
+
+  // the tiles take the settings of this object; exact predicates only if
+  // all the segments allow them, as a tile could allow them alone
+  bool exact = exactCoords() != ExactCoords::none;
+  auto count_tile = [&](size_t it) -> int64_t {
+    LsegIntersector tile;
+    tile.tol_ = tol_;
+    tile.nThreads_ = nThreads_;
+    tile.activeSet_ = activeSet_;
+    tile.batchIsa_ = batchIsa_;
+    tile.kdopDirs_ = kdopDirs_;
+    tile.exactPredicates_ = exact;
+    tile.engine_ = engine_;
+    tile.sweepAxis_ = sweepAxis_;
+    tile.eventSort_ = eventSort_;
+    tile.groupMasks_ = groupMasks_;
+    for (auto is : tileSegs[it]) {
+      Lineseg seg = segs_[is];
+      seg.id = is;
+      tile.addSeg(seg, groups_[is]);
+    }
+    return tile.count_tile_pairs(tile_ref{&boxes, &grid, it});
+  };
+  size_t nTiles = tileSegs.size();
+  nWorkers = min(nWorkers, (int)nTiles);
+
+#ifdef _WIN32
+  // no fork: the tiles are counted in this process
+  int64_t total = 0;
+  for (size_t it = 0; it < nTiles; ++it) {
+    total += count_tile(it);
+  }
+  return (int)total;
+#else
+  // worker w counts tiles w, w + nWorkers, ...
+  cout.flush();
+  vector<pid_t> pids;
+  vector<int> pipes;
+  bool failed = false;
+  for (int w = 0; w < nWorkers && !failed; ++w) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      failed = true;
+      break;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      tile_result res = {0, 1};
+      for (size_t it = w; it < nTiles; it += nWorkers) {
+        res.nIntx += count_tile(it);
+      }
+      _exit(write_all(fds[1], &res, sizeof(res)) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+      close(fds[0]);
+      failed = true;
+      break;
+    }
+    pids.push_back(pid);
+    pipes.push_back(fds[0]);
+  }
+
+  int64_t total = 0;
+  for (size_t w = 0; w < pids.size(); ++w) {
+    tile_result res = {0, 0};
+    if (!read_all(pipes[w], &res, sizeof(res)) || !res.ok)
+      failed = true;
+    close(pipes[w]);
+    int status = 0;
+    if (waitpid(pids[w], &status, 0) != pids[w] || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      failed = true;
+    total += res.nIntx;
+  }
+  if (failed) {
+    cout << "!!!!! a tile worker failed !!!!!\n";
+    return -1;
+  }
+  return (int)total;
+#endif
+}
@@ -1,6 +1,10 @@
+#include "case_batch.h"
 #include "lseg_intersector.h"
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 /*
  * The code in this folder finds all intersections for a given input list of
@@ -49,7 +53,32 @@
  *  depend on the implementation
  */
 
-int main() {
+int main(int argc, char *argv[]) {
+  // lineseg --to-binary in.txt out.lsb converts a text segment file
+  if (argc == 4 && string(argv[1]) == "--to-binary") {
+    return convert_segments_to_binary(argv[2], argv[3]) ? 0 : 1;
+  }
+  // lineseg --batch [--threads t] [--list cases.txt] [case or glob]... runs
+  // many cases in one process, one result line per case (see case_batch.h)
+  if (argc >= 2 && string(argv[1]) == "--batch") {
+    int nThreads = 0;
+    vector<string> patterns;
+    for (int i = 2; i < argc; ++i) {
+      string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc) {
+        nThreads = atoi(argv[++i]);
+      } else if (arg == "--list" && i + 1 < argc) {
+        if (!read_case_list(argv[++i], patterns))
+          return 1;
+      } else {
+        patterns.push_back(arg);
+      }
+    }
+    return run_case_batch(expand_case_patterns(patterns), nThreads, cout) == 0
+               ? 0
+               : 1;
+  }
+
 #if 0
   test_lineseg_intx();
   cout << "--- running test case 1 -----------\n";
@@ -70,10 +99,65 @@ int main() {
   //       test_intersector_3(timing_out, nSegments, maxSegLen);
   // }
   timing_out.close();
+
+  cout << "--- running parallel sweep test -----------\n";
+  test_intersector_MT(20000, 0.02);
+  cout << "--- comparing active set structures -----------\n";
+  test_active_sets_from_file("random_segs_10000_1.txt");
+  cout << "--- checking the vectorized pair kernels -----------\n";
+  test_intx_batch(2000);
+  cout << "--- Bentley-Ottmann engine -----------\n";
+  test_intersector_BO(2000);
+  cout << "--- grid / quadtree engine -----------\n";
+  test_intersector_grid(20000);
+  cout << "--- streaming intersection records -----------\n";
+  test_intx_report(20000);
+  cout << "--- intersections between groups of segments -----------\n";
+  test_intersector_groups(5000);
+  cout << "--- incremental updates of the count -----------\n";
+  test_intersector_dynamic(200000);
+  cout << "--- text and binary segment files -----------\n";
+  test_segment_io(1000000);
+  cout << "--- out-of-core sweep -----------\n";
+  test_intersector_stream(200000);
+  cout << "--- query statistics -----------\n";
+  test_intx_stats(5000);
+  cout << "--- sweep axis -----------\n";
+  test_sweep_axis(20000);
+  cout << "--- exact predicates -----------\n";
+  test_exact_predicates(1000000);
+  cout << "--- intx policies -----------\n";
+  test_intx_policies(1000000);
+  cout << "--- any intersection -----------\n";
+  test_any_intersection(200000);
+  cout << "--- segment index -----------\n";
+  test_segment_index(1000000, 100000);
+  cout << "--- event sort -----------\n";
+  test_event_sort(2000000);
+  cout << "--- batch of cases -----------\n";
+  test_case_batch(20);
+  cout << "--- tiled worker processes -----------\n";
+  test_intersector_tiled(200000);
+  cout << "--- noding -----------\n";
+  test_noding(200000);
+  cout << "--- proximity join -----------\n";
+  test_proximity_join(4000);
+  for (string segfile : {"random_segments_50.txt", "random_segs_100_1.txt",
+                         "random_segs_1000_1.txt", "random_segs_10000_1.txt"}) {
+    benchmark_engines_from_file(segfile);
+  }
+  // (n, maxSegLen) sweep of initial_runtime_data, for all engines
+  // for (int n : {100, 361, 1000, 3612, 10000, 31623, 100000}) {
+  //   for (int run = 1; run <= 3; ++run) {
+  //     benchmark_engines(n, run);
+  //   }
+  // }
 #endif
 
   // generate_random_case(1000, 0.1, "random_segs_1000_1.txt");
-  string segfile("temp_case.txt");
+  // lineseg case.txt runs one case; without arguments, the case is
+  // temp_case.txt, as run_case.sh used to write it
+  string segfile(argc == 2 ? argv[1] : "temp_case.txt");
   // cout << "reading " << segfile << endl;
   test_intersector_from_file(segfile);
 
@@ -2,19 +2,19 @@
 
 if [ $# -eq 0 ]; then
   echo "Please provide a case name, e.g., 'my_case.txt'"
+  echo "or several cases or globs, e.g., 'random*.txt', to run them as a batch"
   exit 1
 fi
-case="$1"
-temp_case="temp_case.txt"
-# echo $case
-
-cp "$case" "$temp_case"
-sleep 0.1
 # Path to your executable
-executable_path="./build/lineseg.exe"
-
-# Execute the program
-# $executable_path "$@"
-$executable_path
+executable_path="./build/lineseg"
+if [ -x "$executable_path.exe" ]; then
+  executable_path="$executable_path.exe"
+fi
 
-rm "$temp_case"
\ No newline at end of file
+# Execute the program: the case files are passed as arguments, so that
+# several runs can share the directory
+if [ $# -eq 1 ] && [[ "$1" != *[*?[]* ]]; then
+  "$executable_path" "$1"
+else
+  "$executable_path" --batch "$@"
+fi
@@ -0,0 +1,428 @@
+#include "seg_io.h"
+#include "lseg.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// below this, a thread costs more to start than it saves
+static const size_t minBytesPerThread = 1 << 20;
+// text converted to binary per block
+static const size_t convertBlockBytes = (size_t)64 << 20;
+
+bool mapped_file::open(const string &path)
+{
+  close();
+#ifdef _WIN32
+  // no mapping: the file is read into a buffer
+  ifstream in(path, ios::binary | ios::ate);
+  if (!in.is_open())
+    return false;
+  size = (size_t)in.tellg();
+  mapping = malloc(max(size, (size_t)1));
+  in.seekg(0);
+  in.read((char *)mapping, size);
+  data = (const char *)mapping;
+  return (bool)in;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  size = (size_t)st.st_size;
+  if (size > 0)
+  {
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+      ::close(fd);
+      size = 0;
+      return false;
+    }
+    // the parsers read the file once, front to back
+    madvise(p, size, MADV_SEQUENTIAL);
+    mapping = p;
+  }
+  ::close(fd);
+  data = size > 0 ? (const char *)mapping : "";
+  return true;
+#endif
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+  free(mapping);
+#else
+  if (mapping != nullptr)
+    munmap(mapping, size);
+#endif
+  mapping = nullptr;
+  data = nullptr;
+  size = 0;
+}
+
+size_t check_seg_file_header(const seg_file_header &header, size_t fileSize,
+                             const string &path)
+{
+  if (fileSize < sizeof(header) ||
+      memcmp(header.magic, seg_file_magic, sizeof(header.magic)) != 0 ||
+      header.version != seg_file_version)
+  {
+    cout << "!!!!! " << path << " is not a binary segment file !!!!!\n";
+    return 0;
+  }
+  if (header.byteOrder != seg_file_byte_order)
+  {
+    cout << "!!!!! " << path
+         << " was written with another byte order !!!!!\n";
+    return 0;
+  }
+  // the size of the largest file must fit in size_t, as it would not with
+  // a corrupt count
+  const size_t maxBytesPerSeg =
+      4 * sizeof(double) + sizeof(uint32_t) + sizeof(uint8_t);
+  if (header.nSegs > (SIZE_MAX - sizeof(header)) / maxBytesPerSeg)
+  {
+    cout << "!!!!! " << path << " is truncated or corrupt !!!!!\n";
+    return 0;
+  }
+  size_t n = header.nSegs;
+  size_t expected = sizeof(header) + n * 4 * sizeof(double);
+  if (header.flags & seg_file_ids)
+    expected += n * sizeof(uint32_t);
+  if (header.flags & seg_file_groups)
+    expected += n * sizeof(uint8_t);
+  if (fileSize != expected)
+  {
+    cout << "!!!!! " << path << " is truncated or corrupt !!!!!\n";
+    return 0;
+  }
+  return expected;
+}
+
+bool valid_seg_groups(const uint8_t *groups, size_t n, const string &path)
+{
+  for (size_t is = 0; is < n; ++is)
+  {
+    if (groups[is] >= seg_file_max_groups)
+    {
+      cout << "!!!!! " << path << ": group " << (int)groups[is]
+           << " of segment " << is << " is not below " << seg_file_max_groups
+           << " !!!!!\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool segment_file::open(const string &path)
+{
+  nSegs = 0;
+  coords = nullptr;
+  ids = nullptr;
+  groups = nullptr;
+  if (!file.open(path))
+  {
+    cout << "!!!!! unable to open " << path << " !!!!!\n";
+    return false;
+  }
+  seg_file_header header = {};
+  memcpy(&header, file.data, min(sizeof(header), file.size));
+  if (check_seg_file_header(header, file.size, path) == 0)
+    return false;
+
+  // the sections are aligned, as the header is a multiple of 8 bytes
+  size_t n = header.nSegs;
+  const char *p = file.data + sizeof(header);
+  coords = (const double *)p;
+  p += n * 4 * sizeof(double);
+  if (header.flags & seg_file_ids)
+  {
+    ids = (const uint32_t *)p;
+    p += n * sizeof(uint32_t);
+  }
+  if (header.flags & seg_file_groups)
+  {
+    groups = (const uint8_t *)p;
+    if (!valid_seg_groups(groups, n, path))
+    {
+      coords = nullptr;
+      ids = nullptr;
+      groups = nullptr;
+      return false;
+    }
+  }
+  nSegs = n;
+  return true;
+}
+
+bool is_binary_segment_file(const string &path)
+{
+  ifstream in(path, ios::binary);
+  char magic[sizeof(seg_file_magic)] = {};
+  in.read(magic, sizeof(magic));
+  return in && memcmp(magic, seg_file_magic, sizeof(magic)) == 0;
+}
+
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Parses the line starting at p into v, and moves p past its end of line.
+// Returns 1 for a segment, 0 for a blank line and -1 for a malformed one.
+static int parse_line(const char *&p, const char *end, double v[4])
+{
+  const char *eol = (const char *)memchr(p, '\n', end - p);
+  if (eol == nullptr)
+    eol = end;
+  const char *q = p;
+  p = eol == end ? end : eol + 1;
+  while (q < eol && is_blank(*q))
+    ++q;
+  if (q == eol)
+    return 0;
+  for (int k = 0; k < 4; ++k)
+  {
+    while (q < eol && is_blank(*q))
+      ++q;
+    // from_chars does not take a leading +
+    if (q < eol && *q == '+')
+      ++q;
+    auto [next, ec] = from_chars(q, eol, v[k]);
+    if (ec != errc() || (next < eol && !is_blank(*next)))
+      return -1;
+    q = next;
+  }
+  // like the stream reader, anything after the 4 numbers is ignored
+  return 1;
+}
+
+shared_ptr<vector<Lineseg>> parse_segments(const char *text, size_t size,
+                                           int nThreads)
+{
+  if (nThreads <= 0)
+    nThreads = (int)thread::hardware_concurrency();
+  nThreads = max(1, min(nThreads, (int)(size / minBytesPerThread)));
+
+  // chunks end at line boundaries
+  vector<size_t> bounds(nThreads + 1, size);
+  bounds[0] = 0;
+  for (int it = 1; it < nThreads; ++it)
+  {
+    size_t b = max(size * it / nThreads, bounds[it - 1]);
+    const char *eol = (const char *)memchr(text + b, '\n', size - b);
+    bounds[it] = eol == nullptr ? size : (size_t)(eol - text) + 1;
+  }
+
+  vector<vector<Lineseg>> parts(nThreads);
+  vector<char> failed(nThreads, 0);
+  auto parse_chunk = [&](int it)
+  {
+    const char *p = text + bounds[it], *end = text + bounds[it + 1];
+    auto &part = parts[it];
+    part.reserve((end - p) / 32);
+    double v[4];
+    while (p < end)
+    {
+      int res = parse_line(p, end, v);
+      if (res < 0)
+      {
+        failed[it] = 1;
+        return;
+      }
+      if (res > 0)
+        part.emplace_back(Pnt2(v[0], v[1]), Pnt2(v[2], v[3]));
+    }
+  };
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it)
+  {
+    workers.emplace_back(parse_chunk, it);
+  }
+  parse_chunk(0);
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+  if (find(failed.begin(), failed.end(), 1) != failed.end())
+    return nullptr;
+
+  if (nThreads == 1)
+  {
+    auto &segs = parts[0];
+    for (uint32_t is = 0; is < (uint32_t)segs.size(); ++is)
+    {
+      segs[is].id = is;
+    }
+    return make_shared<vector<Lineseg>>(std::move(segs));
+  }
+  vector<size_t> offsets(nThreads + 1, 0);
+  for (int it = 0; it < nThreads; ++it)
+  {
+    offsets[it + 1] = offsets[it] + parts[it].size();
+  }
+  auto segments = make_shared<vector<Lineseg>>(offsets.back());
+  auto gather = [&](int it)
+  {
+    for (size_t k = 0; k < parts[it].size(); ++k)
+    {
+      auto &seg = (*segments)[offsets[it] + k];
+      seg = parts[it][k];
+      seg.id = (uint32_t)(offsets[it] + k);
+    }
+  };
+  workers.clear();
+  for (int it = 1; it < nThreads; ++it)
+  {
+    workers.emplace_back(gather, it);
+  }
+  gather(0);
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+  return segments;
+}
+
+shared_ptr<vector<Lineseg>> read_segments_from_file(string segfile)
+{
+  if (is_binary_segment_file(segfile))
+  {
+    segment_file bin;
+    if (!bin.open(segfile))
+      return nullptr;
+    auto segments = make_shared<vector<Lineseg>>(bin.nSegs);
+    for (size_t is = 0; is < bin.nSegs; ++is)
+    {
+      (*segments)[is] = bin.seg(is);
+    }
+    return segments;
+  }
+  mapped_file text;
+  if (!text.open(segfile))
+    return nullptr;
+  auto segments = parse_segments(text.data, text.size);
+  if (segments == nullptr)
+    cout << "!!!!! " << segfile << ": malformed segment line !!!!!\n";
+  return segments;
+}
+
+bool write_segments_binary(const vector<Lineseg> &segments, string segfile,
+                           bool writeIds, const vector<uint8_t> *groups)
+{
+  ofstream out(segfile, ios::binary);
+  if (!out.is_open())
+  {
+    cout << "!!!!! unable to open file !!!!!\n";
+    return false;
+  }
+  seg_file_header header = {};
+  memcpy(header.magic, seg_file_magic, sizeof(header.magic));
+  header.version = seg_file_version;
+  header.flags = (writeIds ? seg_file_ids : 0) |
+                 (groups != nullptr ? seg_file_groups : 0);
+  header.nSegs = segments.size();
+  header.byteOrder = seg_file_byte_order;
+  out.write((const char *)&header, sizeof(header));
+
+  vector<double> coords(4 * segments.size());
+  for (size_t is = 0; is < segments.size(); ++is)
+  {
+    const auto &seg = segments[is];
+    coords[4 * is] = seg.S.x;
+    coords[4 * is + 1] = seg.S.y;
+    coords[4 * is + 2] = seg.E.x;
+    coords[4 * is + 3] = seg.E.y;
+  }
+  out.write((const char *)coords.data(), coords.size() * sizeof(double));
+  if (writeIds)
+  {
+    vector<uint32_t> ids(segments.size());
+    for (size_t is = 0; is < segments.size(); ++is)
+    {
+      ids[is] = segments[is].id;
+    }
+    out.write((const char *)ids.data(), ids.size() * sizeof(uint32_t));
+  }
+  if (groups != nullptr)
+  {
+    vector<uint8_t> padded(*groups);
+    padded.resize(segments.size(), 0);
+    out.write((const char *)padded.data(), padded.size());
+  }
+  return (bool)out;
+}
+
+bool convert_segments_to_binary(string textFile, string binFile)
+{
+  mapped_file text;
+  if (!text.open(textFile))
+  {
+    cout << "!!!!! unable to open " << textFile << " !!!!!\n";
+    return false;
+  }
+  ofstream out(binFile, ios::binary);
+  if (!out.is_open())
+  {
+    cout << "!!!!! unable to open file !!!!!\n";
+    return false;
+  }
+  // the ids are the line numbers, which need not be stored; the count is
+  // written once known
+  seg_file_header header = {};
+  memcpy(header.magic, seg_file_magic, sizeof(header.magic));
+  header.version = seg_file_version;
+  header.byteOrder = seg_file_byte_order;
+  out.write((const char *)&header, sizeof(header));
+
+  // block by block, so that files larger than memory can be converted
+  vector<double> coords;
+  for (size_t pos = 0; pos < text.size;)
+  {
+    size_t end = min(pos + convertBlockBytes, text.size);
+    const char *eol = (const char *)memchr(text.data + end, '\n',
+                                           text.size - end);
+    end = eol == nullptr ? text.size : (size_t)(eol - text.data) + 1;
+    auto segments = parse_segments(text.data + pos, end - pos);
+    if (segments == nullptr)
+    {
+      cout << "!!!!! " << textFile << ": malformed segment line !!!!!\n";
+      return false;
+    }
+    coords.resize(4 * segments->size());
+    for (size_t is = 0; is < segments->size(); ++is)
+    {
+      const auto &seg = (*segments)[is];
+      coords[4 * is] = seg.S.x;
+      coords[4 * is + 1] = seg.S.y;
+      coords[4 * is + 2] = seg.E.x;
+      coords[4 * is + 3] = seg.E.y;
+    }
+    out.write((const char *)coords.data(), coords.size() * sizeof(double));
+    header.nSegs += segments->size();
+    pos = end;
+  }
+  out.seekp(0);
+  out.write((const char *)&header, sizeof(header));
+  return (bool)out;
+}
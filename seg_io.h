@@ -0,0 +1,109 @@
+#pragma once
+
+#include "lseg.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Segment files.
+//
+// The text format has one segment per line, "Sx Sy Ex Ey", separated by
+// blanks; it is parsed in parallel, with a locale-independent number parser.
+//
+// The binary format is a seg_file_header followed by the coordinates, 4
+// doubles per segment in the order of the text format, then optionally a
+// uint32 id and a uint8 group per segment. The file is memory-mapped and the
+// coordinates are read in place (see LsegIntersector::addSegs).
+
+struct seg_file_header
+{
+  char magic[8];      // "LSEGBIN"
+  uint32_t version;   // seg_file_version
+  uint32_t flags;     // seg_file_ids | seg_file_groups
+  uint64_t nSegs;
+  uint32_t byteOrder; // seg_file_byte_order, as written by the host
+  uint32_t reserved;
+};
+
+const char seg_file_magic[8] = "LSEGBIN";
+const uint32_t seg_file_version = 1;
+const uint32_t seg_file_byte_order = 0x01020304;
+const uint32_t seg_file_ids = 1;
+const uint32_t seg_file_groups = 2;
+// groups are below this (LsegIntersector::maxGroups)
+const int seg_file_max_groups = 64;
+
+// size the file should have for this header, or 0 (with a message) if the
+// header is invalid or does not match fileSize
+size_t check_seg_file_header(const seg_file_header &header, size_t fileSize,
+                             const string &path);
+
+// whether the n groups read from path are below seg_file_max_groups; false
+// (with a message) if one is not
+bool valid_seg_groups(const uint8_t *groups, size_t n, const string &path);
+
+// read-only memory mapping of a whole file
+struct mapped_file
+{
+  const char *data = nullptr;
+  size_t size = 0;
+
+  mapped_file() = default;
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+  ~mapped_file() { close(); }
+
+  bool open(const string &path);
+  void close();
+
+private:
+  void *mapping = nullptr; // start of the mapping, or of the read buffer
+};
+
+// binary segment file, mapped in memory; ids and groups are nullptr when the
+// file does not have them
+struct segment_file
+{
+  mapped_file file;
+  size_t nSegs = 0;
+  const double *coords = nullptr; // Sx, Sy, Ex, Ey of each segment
+  const uint32_t *ids = nullptr;
+  const uint8_t *groups = nullptr;
+
+  // false (with a message) if the file is missing or not a valid binary
+  // segment file, e.g. with a group not below seg_file_max_groups
+  bool open(const string &path);
+
+  Lineseg seg(size_t is) const
+  {
+    const double *c = coords + 4 * is;
+    return Lineseg(Pnt2(c[0], c[1]), Pnt2(c[2], c[3]),
+                   ids != nullptr ? ids[is] : (uint32_t)is);
+  }
+};
+
+// true if the file starts with the binary magic
+bool is_binary_segment_file(const string &path);
+
+// Parses the text format; ids are the line numbers among the segments, from
+// 0. Blank lines are skipped; a line that does not hold 4 numbers is an
+// error (nullptr). nThreads = 0 uses all cores.
+shared_ptr<vector<Lineseg>> parse_segments(const char *text, size_t size,
+                                           int nThreads = 0);
+
+// reads a text or binary segment file (detected from its first bytes);
+// nullptr if the file is missing or invalid
+shared_ptr<vector<Lineseg>> read_segments_from_file(string segfile);
+
+// groups may be nullptr; false if the file cannot be written
+bool write_segments_binary(const vector<Lineseg> &segments, string segfile,
+                           bool writeIds = true,
+                           const vector<uint8_t> *groups = nullptr);
+
+// converts a text segment file to the binary format, by blocks; the ids are
+// the line numbers, as for the text format, and are not stored
+bool convert_segments_to_binary(string textFile, string binFile);
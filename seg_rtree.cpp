@@ -0,0 +1,336 @@
+#include "seg_rtree.h"
+#include "intx_report.h"
+#include "lseg.h"
+#include "seg_io.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+// queries handed to a thread at a time by query_batch
+const size_t queriesPerChunk = 64;
+// deepest tree: nodeCapacity^maxDepth segments is well beyond 2^32
+const int maxDepth = 16;
+
+struct item_box
+{
+  double x0, y0, x1, y1;
+};
+
+item_box segment_box(const double *c, double tol)
+{
+  return item_box{min(c[0], c[2]) - tol, min(c[1], c[3]) - tol,
+                  max(c[0], c[2]) + tol, max(c[1], c[3]) + tol};
+}
+
+bool boxes_overlap(const item_box &a, double x0, double y0, double x1,
+                   double y1)
+{
+  return a.x0 <= x1 && x0 <= a.x1 && a.y0 <= y1 && y0 <= a.y1;
+}
+
+// STR order of the items: vertical slices of about sqrt(nGroups) groups of
+// nodeCapacity items by the x of their centre, each sorted by y
+vector<uint32_t> str_order(const vector<item_box> &boxes)
+{
+  size_t n = boxes.size();
+  vector<uint32_t> order(n);
+  for (uint32_t k = 0; k < (uint32_t)n; ++k)
+  {
+    order[k] = k;
+  }
+  auto cx = [&](uint32_t k) { return boxes[k].x0 + boxes[k].x1; };
+  auto cy = [&](uint32_t k) { return boxes[k].y0 + boxes[k].y1; };
+  sort(order.begin(), order.end(),
+       [&](uint32_t a, uint32_t b) { return cx(a) < cx(b); });
+  size_t nGroups = (n + rtreeNodeCapacity - 1) / rtreeNodeCapacity;
+  size_t nSlices = max((size_t)ceil(sqrt((double)nGroups)), (size_t)1);
+  size_t sliceSize =
+      rtreeNodeCapacity * ((nGroups + nSlices - 1) / nSlices);
+  for (size_t begin = 0; begin < n; begin += sliceSize)
+  {
+    sort(order.begin() + begin, order.begin() + min(n, begin + sliceSize),
+         [&](uint32_t a, uint32_t b) { return cy(a) < cy(b); });
+  }
+  return order;
+}
+
+// nodes over consecutive runs of nodeCapacity items
+void add_parents(const vector<item_box> &boxes, uint32_t firstItem, bool leaf,
+                 vector<rtree_node> &level)
+{
+  for (size_t begin = 0; begin < boxes.size(); begin += rtreeNodeCapacity)
+  {
+    size_t end = min(boxes.size(), begin + rtreeNodeCapacity);
+    rtree_node node = {boxes[begin].x0, boxes[begin].y0, boxes[begin].x1,
+                       boxes[begin].y1, firstItem + (uint32_t)begin,
+                       (uint32_t)(end - begin), leaf ? 1u : 0u, 0};
+    for (size_t k = begin + 1; k < end; ++k)
+    {
+      node.x0 = min(node.x0, boxes[k].x0);
+      node.y0 = min(node.y0, boxes[k].y0);
+      node.x1 = max(node.x1, boxes[k].x1);
+      node.y1 = max(node.y1, boxes[k].y1);
+    }
+    level.push_back(node);
+  }
+}
+
+// the nodes of a loaded file must form a tree of the stored segments, no
+// deeper than maxDepth, so that the queries stay within the arrays and the
+// stack
+bool valid_nodes(const vector<rtree_node> &nodes, size_t nSegs)
+{
+  vector<int> height(nodes.size(), 0);
+  for (size_t k = 0; k < nodes.size(); ++k)
+  {
+    const auto &node = nodes[k];
+    uint64_t end = (uint64_t)node.first + node.count;
+    if (node.count == 0 || node.count > rtreeNodeCapacity ||
+        (node.leaf ? end > nSegs : end > k))
+      return false;
+    for (uint32_t c = node.first; !node.leaf && c < end; ++c)
+    {
+      height[k] = max(height[k], height[c] + 1);
+    }
+    if (height[k] >= maxDepth)
+      return false;
+  }
+  return !nodes.empty() || nSegs == 0;
+}
+
+} // namespace
+
+void seg_rtree::build(const vector<Lineseg> &segs,
+                      const vector<uint8_t> &removed, double tol)
+{
+  this->tol = tol;
+  nodes.clear();
+  coords.clear();
+  ids.clear();
+
+  vector<uint32_t> live;
+  live.reserve(segs.size());
+  for (uint32_t is = 0; is < (uint32_t)segs.size(); ++is)
+  {
+    if (removed.empty() || !removed[is])
+      live.push_back(is);
+  }
+  vector<item_box> boxes(live.size());
+  for (size_t k = 0; k < live.size(); ++k)
+  {
+    const auto &seg = segs[live[k]];
+    double c[4] = {seg.S.x, seg.S.y, seg.E.x, seg.E.y};
+    boxes[k] = segment_box(c, tol);
+  }
+
+  // segments in leaf order
+  vector<uint32_t> order = str_order(boxes);
+  coords.resize(4 * live.size());
+  ids.resize(live.size());
+  vector<item_box> sorted(live.size());
+  for (size_t k = 0; k < order.size(); ++k)
+  {
+    const auto &seg = segs[live[order[k]]];
+    double *c = coords.data() + 4 * k;
+    c[0] = seg.S.x;
+    c[1] = seg.S.y;
+    c[2] = seg.E.x;
+    c[3] = seg.E.y;
+    ids[k] = seg.id;
+    sorted[k] = boxes[order[k]];
+  }
+
+  // levels, from the leaves up: each level is put in STR order, which keeps
+  // the children of the level above contiguous
+  vector<rtree_node> level;
+  add_parents(sorted, 0, true, level);
+  while (!level.empty())
+  {
+    boxes.resize(level.size());
+    for (size_t k = 0; k < level.size(); ++k)
+    {
+      boxes[k] = item_box{level[k].x0, level[k].y0, level[k].x1, level[k].y1};
+    }
+    order = level.size() > 1 ? str_order(boxes) : vector<uint32_t>{0};
+    uint32_t firstNode = (uint32_t)nodes.size();
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+      nodes.push_back(level[order[k]]);
+      sorted[k] = boxes[order[k]];
+    }
+    if (level.size() == 1)
+      break;
+    sorted.resize(level.size());
+    level.clear();
+    add_parents(sorted, firstNode, false, level);
+  }
+}
+
+size_t seg_rtree::query(const Lineseg &q, vector<IntxRecord> &hits) const
+{
+  if (nodes.empty())
+    return 0;
+  size_t nHits = hits.size();
+  double qc[4] = {q.S.x, q.S.y, q.E.x, q.E.y};
+  item_box qb = segment_box(qc, tol);
+  uint32_t stack[maxDepth * rtreeNodeCapacity];
+  int top = 0;
+  stack[top++] = (uint32_t)nodes.size() - 1;
+  while (top > 0)
+  {
+    const auto &node = nodes[stack[--top]];
+    if (!boxes_overlap(qb, node.x0, node.y0, node.x1, node.y1))
+      continue;
+    if (!node.leaf)
+    {
+      for (uint32_t k = node.first; k < node.first + node.count; ++k)
+      {
+        stack[top++] = k;
+      }
+      continue;
+    }
+    for (uint32_t k = node.first; k < node.first + node.count; ++k)
+    {
+      item_box b = segment_box(coords.data() + 4 * k, tol);
+      if (!boxes_overlap(qb, b.x0, b.y0, b.x1, b.y1))
+        continue;
+      Lineseg ref = seg(k);
+      double params[2];
+      int res = Lineseg::intx<intx_full>(ref, q, params);
+      if (res > 0)
+        hits.push_back(make_intx_record(ref, q, res, params));
+    }
+  }
+  return hits.size() - nHits;
+}
+
+void seg_rtree::query_batch(const vector<Lineseg> &queries, index_hits &hits,
+                            int nThreads) const
+{
+  size_t nQueries = queries.size();
+  size_t nChunks = (nQueries + queriesPerChunk - 1) / queriesPerChunk;
+  hits.start.assign(nQueries + 1, 0);
+  hits.records.clear();
+
+  // each chunk of queries has its own records, concatenated at the end
+  vector<vector<IntxRecord>> chunkHits(nChunks);
+  atomic<size_t> next(0);
+  auto work = [&]()
+  {
+    for (size_t ic = next.fetch_add(1); ic < nChunks; ic = next.fetch_add(1))
+    {
+      size_t end = min(nQueries, (ic + 1) * queriesPerChunk);
+      for (size_t iq = ic * queriesPerChunk; iq < end; ++iq)
+      {
+        hits.start[iq + 1] = query(queries[iq], chunkHits[ic]);
+      }
+    }
+  };
+  if (nThreads <= 0)
+    nThreads = (int)thread::hardware_concurrency();
+  nThreads = max(1, min(nThreads, (int)nChunks));
+  vector<thread> workers;
+  for (int it = 1; it < nThreads; ++it)
+  {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+
+  for (size_t iq = 0; iq < nQueries; ++iq)
+  {
+    hits.start[iq + 1] += hits.start[iq];
+  }
+  hits.records.reserve(hits.start[nQueries]);
+  for (auto &chunk : chunkHits)
+  {
+    hits.records.insert(hits.records.end(), chunk.begin(), chunk.end());
+  }
+}
+
+bool seg_rtree::save(const string &path) const
+{
+  ofstream out(path, ios::binary);
+  if (!out.is_open())
+  {
+    cout << "!!!!! unable to open " << path << " !!!!!\n";
+    return false;
+  }
+  rtree_file_header header = {};
+  memcpy(header.magic, rtree_file_magic, sizeof(header.magic));
+  header.version = rtree_file_version;
+  header.byteOrder = seg_file_byte_order;
+  header.nSegs = ids.size();
+  header.nNodes = nodes.size();
+  header.tol = tol;
+  header.nodeCapacity = rtreeNodeCapacity;
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)nodes.data(), nodes.size() * sizeof(rtree_node));
+  out.write((const char *)coords.data(), coords.size() * sizeof(double));
+  out.write((const char *)ids.data(), ids.size() * sizeof(uint32_t));
+  return (bool)out;
+}
+
+bool seg_rtree::load(const string &path)
+{
+  tol = 0.;
+  nodes.clear();
+  coords.clear();
+  ids.clear();
+  mapped_file file;
+  if (!file.open(path))
+  {
+    cout << "!!!!! unable to open " << path << " !!!!!\n";
+    return false;
+  }
+  rtree_file_header header = {};
+  memcpy(&header, file.data, min(sizeof(header), file.size));
+  if (file.size < sizeof(header) ||
+      memcmp(header.magic, rtree_file_magic, sizeof(header.magic)) != 0 ||
+      header.version != rtree_file_version ||
+      header.byteOrder != seg_file_byte_order ||
+      header.nodeCapacity != rtreeNodeCapacity ||
+      header.nSegs > UINT32_MAX || header.nNodes > UINT32_MAX ||
+      file.size != sizeof(header) + header.nNodes * sizeof(rtree_node) +
+                       header.nSegs * (4 * sizeof(double) + sizeof(uint32_t)))
+  {
+    cout << "!!!!! " << path << " is not a valid index file !!!!!\n";
+    return false;
+  }
+
+  // the sections are copied out of the mapping in bulk
+  const char *p = file.data + sizeof(header);
+  nodes.resize(header.nNodes);
+  memcpy(nodes.data(), p, nodes.size() * sizeof(rtree_node));
+  p += nodes.size() * sizeof(rtree_node);
+  coords.resize(4 * header.nSegs);
+  memcpy(coords.data(), p, coords.size() * sizeof(double));
+  p += coords.size() * sizeof(double);
+  ids.resize(header.nSegs);
+  memcpy(ids.data(), p, ids.size() * sizeof(uint32_t));
+  if (!valid_nodes(nodes, ids.size()))
+  {
+    cout << "!!!!! " << path << " is corrupt !!!!!\n";
+    nodes.clear();
+    coords.clear();
+    ids.clear();
+    return false;
+  }
+  tol = header.tol;
+  return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "intx_report.h"
+#include "lseg.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Static index of a reference set of segments, for streams of query segments
+// tested against the same set (LsegIntersector::buildIndex). It is a packed
+// R-tree built by sort-tile-recursive (STR) packing: the segment boxes,
+// padded by the tolerance, are sorted into vertical slices by the x of their
+// centre, each slice by y, and cut into leaves of nodeCapacity segments; the
+// leaves are packed the same way into the level above, up to the root. Every
+// node is full but the last of its level, and the children of a node are
+// contiguous, so a node is a box and a range.
+//
+// The segments are stored in leaf order and the nodes level by level, from
+// the leaves up (the root is the last node). Both are plain arrays: the index
+// is written to and read from disk as is, and the queries only read it, so
+// any number of threads can query one index without locking.
+
+const uint32_t rtreeNodeCapacity = 16;
+
+struct rtree_node
+{
+  double x0, y0, x1, y1; // box of the node, padded by tol
+  uint32_t first;        // first child node, or first segment of a leaf
+  uint32_t count;        // number of children or segments
+  uint32_t leaf;         // 1 for a leaf
+  uint32_t reserved;
+};
+
+// Index file: an rtree_file_header, then the nodes, then the coordinates (4
+// doubles per segment, Sx Sy Ex Ey) and the uint32 ids of the segments, in
+// leaf order.
+struct rtree_file_header
+{
+  char magic[8];      // "LSEGIDX"
+  uint32_t version;   // rtree_file_version
+  uint32_t byteOrder; // seg_file_byte_order (seg_io.h), as written by the host
+  uint64_t nSegs;
+  uint64_t nNodes;
+  double tol;
+  uint32_t nodeCapacity;
+  uint32_t reserved;
+};
+
+const char rtree_file_magic[8] = "LSEGIDX";
+const uint32_t rtree_file_version = 1;
+
+// hits of a batch of queries: the records of query iq are
+// records[start[iq]] to records[start[iq + 1] - 1]
+struct index_hits
+{
+  vector<size_t> start;
+  vector<IntxRecord> records;
+
+  size_t count(size_t iq) const { return start[iq + 1] - start[iq]; }
+  const IntxRecord *first(size_t iq) const
+  {
+    return records.data() + start[iq];
+  }
+};
+
+struct seg_rtree
+{
+  double tol = 0.; // padding of the boxes
+  vector<rtree_node> nodes;
+  vector<double> coords; // Sx, Sy, Ex, Ey of each segment, in leaf order
+  vector<uint32_t> ids;  // Lineseg ids, in leaf order
+
+  size_t size() const { return ids.size(); }
+  bool empty() const { return ids.empty(); }
+  Lineseg seg(size_t k) const
+  {
+    const double *c = coords.data() + 4 * k;
+    return Lineseg(Pnt2(c[0], c[1]), Pnt2(c[2], c[3]), ids[k]);
+  }
+
+  // indexes the segments that are not removed (removed may be empty)
+  void build(const vector<Lineseg> &segs, const vector<uint8_t> &removed,
+             double tol);
+
+  // Appends to hits the intersections of q with the indexed segments, as
+  // Lineseg::intx finds them: id1 and alfa are those of the indexed segment,
+  // id2 and beta those of q. Returns the number of records appended.
+  size_t query(const Lineseg &q, vector<IntxRecord> &hits) const;
+
+  // queries of a batch, on nThreads threads (0: all available cores)
+  void query_batch(const vector<Lineseg> &queries, index_hits &hits,
+                   int nThreads = 0) const;
+
+  // false (with a message) if the file cannot be written, or read, or is not
+  // a valid index file; a failed load leaves the index empty
+  bool save(const string &path) const;
+  bool load(const string &path);
+};
@@ -0,0 +1,196 @@
+#include "sweep_axis.h"
+#include "interval.h"
+#include "lseg.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+// segments swept per candidate axis by choose_sweep_frame
+const size_t maxAxisSample = 4096;
+// below this, the sample says little and the choice is not worth its cost
+const size_t minSegsForAxis = 1024;
+// another axis must promise an active set this much smaller than x (or the
+// best axis before it) to be chosen
+const double axisSwitchRatio = 0.75;
+
+// about maxAxisSample live segments, evenly spread over the input
+void sample_segments(const vector<uint8_t> &removed, size_t nLive,
+                     vector<uint32_t> &sample)
+{
+  size_t step = max(nLive / maxAxisSample, (size_t)1);
+  sample.clear();
+  sample.reserve(min(nLive, maxAxisSample + 1));
+  size_t iLive = 0;
+  for (uint32_t is = 0; is < (uint32_t)removed.size(); ++is)
+  {
+    if (removed[is])
+      continue;
+    if (iLive++ % step == 0)
+      sample.push_back(is);
+  }
+}
+
+// normal of the dominant orientation, from the doubled angles of the
+// segments weighted by their squared length; (0, 1) if there is none
+sweep_frame principal_frame(const vector<Lineseg> &segs,
+                            const vector<uint32_t> &sample)
+{
+  double c2 = 0., s2 = 0.;
+  for (auto is : sample)
+  {
+    double dx = segs[is].E.x - segs[is].S.x, dy = segs[is].E.y - segs[is].S.y;
+    c2 += dx * dx - dy * dy;
+    s2 += 2. * dx * dy;
+  }
+  double theta = 0.5 * atan2(s2, c2);
+  sweep_frame frame;
+  frame.axis = SweepAxis::principal;
+  frame.ux = -sin(theta);
+  frame.uy = cos(theta);
+  if (frame.ux < 0. || (frame.ux == 0. && frame.uy < 0.))
+  {
+    frame.ux = -frame.ux;
+    frame.uy = -frame.uy;
+  }
+  return frame;
+}
+
+// mean number of sampled segments open at the start of a sampled segment,
+// with the tie-break of the sweep (ends before starts)
+double mean_active(const vector<Lineseg> &segs, const vector<uint32_t> &sample,
+                   const sweep_frame &frame, double tol,
+                   vector<intvl_end> &sides)
+{
+  sides.clear();
+  sides.reserve(2 * sample.size());
+  for (auto is : sample)
+  {
+    intvl proj = frame.along(segs[is], tol, is);
+    sides.push_back(intvl_end{proj.ends[0], is, 0});
+    sides.push_back(intvl_end{proj.ends[1], is, 1});
+  }
+  sort(sides.begin(), sides.end(),
+       [](const intvl_end &i1, const intvl_end &i2) {
+         return i1.val < i2.val || (i1.val == i2.val && i1.iend > i2.iend);
+       });
+  double sum = 0.;
+  int nActive = 0;
+  for (const auto &side : sides)
+  {
+    if (side.iend == 0)
+      sum += nActive++;
+    else
+      --nActive;
+  }
+  return sample.empty() ? 0. : sum / sample.size();
+}
+
+} // namespace
+
+const char *sweep_axis_name(SweepAxis axis)
+{
+  switch (axis)
+  {
+  case SweepAxis::y:
+    return "y";
+  case SweepAxis::diag_pos:
+    return "diag_pos";
+  case SweepAxis::diag_neg:
+    return "diag_neg";
+  case SweepAxis::principal:
+    return "principal";
+  case SweepAxis::automatic:
+    return "automatic";
+  case SweepAxis::x:
+  default:
+    return "x";
+  }
+}
+
+intvl sweep_frame::project(const Lineseg &seg, double dx, double dy,
+                           double tol, uint32_t id)
+{
+  double pS = dx * seg.S.x + dy * seg.S.y;
+  double pE = dx * seg.E.x + dy * seg.E.y;
+  double pad = tol * (fabs(dx) + fabs(dy));
+  if (dx != 0. && dy != 0.)
+  {
+    pad += 4. * DBL_EPSILON *
+           max(fabs(seg.S.x) + fabs(seg.S.y), fabs(seg.E.x) + fabs(seg.E.y));
+  }
+  return intvl{{min(pS, pE) - pad, max(pS, pE) + pad}, id};
+}
+
+sweep_frame sweep_frame_of(SweepAxis axis, const vector<Lineseg> &segs,
+                           const vector<uint8_t> &removed,
+                           sweep_axis_scratch *scratch)
+{
+  sweep_frame frame;
+  frame.axis = axis;
+  const double h = numbers::sqrt2 / 2.;
+  switch (axis)
+  {
+  case SweepAxis::y:
+    frame.ux = 0.;
+    frame.uy = 1.;
+    break;
+  case SweepAxis::diag_pos:
+    frame.ux = h;
+    frame.uy = h;
+    break;
+  case SweepAxis::diag_neg:
+    frame.ux = h;
+    frame.uy = -h;
+    break;
+  case SweepAxis::principal:
+  {
+    sweep_axis_scratch local;
+    auto &sample = (scratch != nullptr ? *scratch : local).sample;
+    sample_segments(removed, count(removed.begin(), removed.end(), 0), sample);
+    return principal_frame(segs, sample);
+  }
+  case SweepAxis::x:
+  case SweepAxis::automatic:
+  default:
+    frame.axis = SweepAxis::x;
+    break;
+  }
+  return frame;
+}
+
+sweep_frame choose_sweep_frame(const vector<Lineseg> &segs,
+                               const vector<uint8_t> &removed, double tol,
+                               double *estimates,
+                               sweep_axis_scratch *scratch)
+{
+  fill(estimates, estimates + nSweepAxes, 0.);
+  size_t nLive = count(removed.begin(), removed.end(), 0);
+  if (nLive < minSegsForAxis)
+    return sweep_frame();
+  sweep_axis_scratch local;
+  if (scratch == nullptr)
+    scratch = &local;
+  auto &sample = scratch->sample;
+  sample_segments(removed, nLive, sample);
+  double scale = (double)nLive / sample.size();
+  sweep_frame best;
+  for (int a = 0; a < nSweepAxes; ++a)
+  {
+    sweep_frame frame = (SweepAxis)a == SweepAxis::principal
+                            ? principal_frame(segs, sample)
+                            : sweep_frame_of((SweepAxis)a, segs, removed);
+    estimates[a] =
+        scale * mean_active(segs, sample, frame, tol, scratch->sides);
+    if (estimates[a] < axisSwitchRatio * estimates[(int)best.axis])
+      best = frame;
+  }
+  return best;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "interval.h"
+#include "lseg.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Direction of the sweep of numIntx_sweep. The sweep runs along a unit
+// direction u and the active set orders the segments along v, u turned by 90
+// degrees. Its cost grows with the number of segments crossed by the sweep
+// line, which depends on the axis: layers dominated by long horizontal
+// segments keep a huge active set along x and a small one along y.
+//  - x, y: exact projections, the classic x-sweep and its transpose
+//  - diag_pos, diag_neg: along x + y and x - y
+//  - principal: across the dominant orientation of the segments
+//  - automatic: the candidate with the smallest estimated active set
+
+enum class SweepAxis
+{
+  x,
+  y,
+  diag_pos,
+  diag_neg,
+  principal,
+  automatic
+};
+
+// candidate axes, automatic excluded
+const int nSweepAxes = 5;
+
+const char *sweep_axis_name(SweepAxis axis);
+
+struct sweep_frame
+{
+  SweepAxis axis = SweepAxis::x;
+  double ux = 1., uy = 0.;
+
+  // projection interval of seg along u, or along v, padded so that the
+  // intervals of any two segments within tol overlap: by tol times the
+  // 1-norm of the direction, which matches the k-DOP bounds (kdop.h), plus
+  // the rounding of the projection when the axis is not x or y
+  intvl along(const Lineseg &seg, double tol, uint32_t id) const
+  {
+    return project(seg, ux, uy, tol, id);
+  }
+  intvl across(const Lineseg &seg, double tol, uint32_t id) const
+  {
+    return project(seg, -uy, ux, tol, id);
+  }
+
+  static intvl project(const Lineseg &seg, double dx, double dy, double tol,
+                       uint32_t id);
+};
+
+// buffers of the sample of the segments, kept by the caller across queries
+// so that the choice of the axis does not allocate
+struct sweep_axis_scratch
+{
+  vector<uint32_t> sample;
+  vector<intvl_end> sides;
+};
+
+// frame of a candidate axis; the principal direction is taken from a
+// sample of the segments
+sweep_frame sweep_frame_of(SweepAxis axis, const vector<Lineseg> &segs,
+                           const vector<uint8_t> &removed,
+                           sweep_axis_scratch *scratch = nullptr);
+
+// Frame of the candidate axis with the smallest active set, estimated by
+// sweeping a sample of the segments along each candidate: estimates[a] gets
+// the mean active-set size of axis a, scaled to all the segments. x is kept
+// unless another axis is clearly better, and on small inputs.
+sweep_frame choose_sweep_frame(const vector<Lineseg> &segs,
+                               const vector<uint8_t> &removed, double tol,
+                               double *estimates,
+                               sweep_axis_scratch *scratch = nullptr);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "active_set.h"
+#include "event_sort.h"
+#include "interval.h"
+#include "intx_batch.h"
+#include "sweep_axis.h"
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+// Memory of the sweep (numIntx_sweep, reportIntx and anyIntersection on the
+// sweep engine): the interval ends, the coordinates of the pair kernel, the
+// extents across the axis, the active sets, the candidates of a start event
+// and the buffers of the sort and of the choice of the axis. A query resets
+// the buffers rather than freeing them, so once a workspace has served a
+// query, the next ones on no more segments do not allocate.
+//
+// Each LsegIntersector owns one; LsegIntersector::setWorkspace points it to
+// another, e.g. one per thread shared by the intersectors of that thread. A
+// workspace serves one query at a time. Only the serial sweep uses it: the
+// threads of the slab-parallel sweep and of the parallel sorts, the grid
+// engine and the automatic engine selection allocate their own memory, and
+// so do the records of reportIntx.
+
+// candidates of a start event and their results, tested as one batch
+struct candidate_batch
+{
+  vector<uint32_t> ids;
+  vector<int8_t> res;
+};
+
+struct sweep_workspace
+{
+  vector<intvl_end> sides;
+  seg_soa soa;
+  vector<intvl> yInts;
+  candidate_batch cands;
+  event_sort_scratch sortScratch;
+  sweep_axis_scratch axisScratch;
+  tuple<hash_active_set, ybucket_active_set,
+        grouped_active_set<hash_active_set>,
+        grouped_active_set<ybucket_active_set>>
+      activeSets;
+
+  template <class ActiveSet> ActiveSet &active_set()
+  {
+    return get<ActiveSet>(activeSets);
+  }
+
+  // gives the memory back
+  void release() { *this = sweep_workspace(); }
+};
@@ -1,13 +1,21 @@
+#include "case_batch.h"
 #include "lseg.h"
+#include "lseg_exact.h"
 #include "lseg_intersector.h"
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
 #include <memory>
 #include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 static double getRandomDoubleUnit() {
@@ -222,6 +230,103 @@ int test_intersector_3(ofstream &out, int nSegments, double maxSegLength,
   return 0;
 }
 
+// the slab-parallel sweep must return the same counts as the serial sweep
+int test_intersector_MT(int nSegments, double maxSegLength) {
+  shared_ptr<vector<Lineseg>> segments =
+      random_segment_generator(nSegments, maxSegLength);
+  LsegIntersector SI;
+  for (const auto &seg : *segments) {
+    SI.addSeg(seg);
+  }
+  cout << "number of input segments = " << nSegments << " ----------" << endl;
+
+  int nFilteredSerial = -1;
+  int nIntxSerial = SI.numIntx(&nFilteredSerial);
+  cout << "serial: num filtered pairs = " << nFilteredSerial
+       << ", num intersections = " << nIntxSerial << endl;
+
+  bool pass = true;
+  for (int nThreads : {2, 3, 4, 8}) {
+    SI.setNumThreads(nThreads);
+    int nFiltered = -1;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    int nIntx = SI.numIntx(&nFiltered);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    cout << nThreads << " threads - Runtime in milliseconds = "
+         << std::chrono::duration<double, std::milli>(end_time - start_time)
+                .count()
+         << ", num intersections = " << nIntx << endl;
+    pass &= nIntx == nIntxSerial && nFiltered == nFilteredSerial;
+  }
+  cout << "test_intersector_MT() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// the vector pair kernels must classify exactly like the scalar one;
+// half of the segments are snapped to a coarse grid to get many touching,
+// overlapping, parallel and degenerate pairs
+int test_intx_batch(int nSegs) {
+  vector<Lineseg> segments;
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  std::uniform_int_distribution<> grid(0, 4);
+  for (int k = 0; k < nSegs; ++k) {
+    if (k % 2 == 0) {
+      segments.emplace_back(Pnt2(grid(gen) * 0.25, grid(gen) * 0.25),
+                            Pnt2(grid(gen) * 0.25, grid(gen) * 0.25), k);
+    } else {
+      Pnt2 P(dis(gen), dis(gen));
+      segments.emplace_back(
+          P, Pnt2(P.x + 0.5 * dis(gen) - 0.25, P.y + 0.5 * dis(gen) - 0.25),
+          k);
+    }
+  }
+  vector<uint32_t> ids(segments.size());
+  for (uint32_t k = 0; k < ids.size(); ++k) {
+    ids[k] = k;
+  }
+  vector<int8_t> expected(ids.size()), res(ids.size());
+  bool pass = true;
+  for (int nDirs : {4, 8, 16}) {
+    seg_soa soa;
+    soa.assign(segments, 1.e-12, nDirs);
+    // the filter must not drop intersecting pairs
+    int nPassed = 0, nMissed = 0;
+    for (uint32_t q = 0; q < ids.size(); ++q) {
+      intx_batch(soa, q, ids.data(), ids.size(), expected.data(),
+                 BatchIsa::scalar);
+      for (size_t k = 0; k < ids.size(); ++k) {
+        nPassed += expected[k] >= 0;
+        nMissed += expected[k] < 0 &&
+                   Lineseg::intx(segments[k], segments[q], nullptr) > 0;
+      }
+    }
+    cout << nDirs << "-DOP filter: " << nPassed << " pairs passed, "
+         << nMissed << " intersecting pairs filtered out\n";
+    pass &= nMissed == 0;
+    for (auto isa : {BatchIsa::avx2, BatchIsa::avx512}) {
+      if (isa > intx_batch_best_isa()) {
+        cout << intx_batch_isa_name(isa) << " not supported, skipped\n";
+        continue;
+      }
+      int nMismatch = 0;
+      for (uint32_t q = 0; q < ids.size(); ++q) {
+        intx_batch(soa, q, ids.data(), ids.size(), expected.data(),
+                   BatchIsa::scalar);
+        intx_batch(soa, q, ids.data(), ids.size(), res.data(), isa);
+        for (size_t k = 0; k < ids.size(); ++k) {
+          nMismatch += res[k] != expected[k];
+        }
+      }
+      cout << intx_batch_isa_name(isa) << ": " << nMismatch
+           << " mismatches with the scalar kernel\n";
+      pass &= nMismatch == 0;
+    }
+  }
+  cout << "test_intx_batch() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
 // generated the requested number of random segments in the unit square
 // length of each generated segment will be between 0.5*maxSegLen and maxSegLen
 shared_ptr<vector<Lineseg>> random_segment_generator(int nSeg,
@@ -241,25 +346,6 @@ shared_ptr<vector<Lineseg>> random_segment_generator(int nSeg,
   return make_shared<vector<Lineseg>>(segments);
 }
 
-shared_ptr<vector<Lineseg>> read_segments_from_file(string segfile) {
-  ifstream inSegments(segfile);
-  vector<Lineseg> segments;
-  Pnt2 P1, P2;
-  uint32_t id = 0;
-
-  if (!inSegments.is_open()) {
-    return nullptr;
-  }
-  string line;
-  while (std::getline(inSegments, line)) {
-    istringstream iss(line);
-    iss >> P1.x >> P1.y >> P2.x >> P2.y;
-    segments.emplace_back(Lineseg(P1, P2, id++));
-  }
-  inSegments.close();
-  return make_shared<vector<Lineseg>>(segments);
-}
-
 void write_segments_to_file(vector<Lineseg> &segments, string segfile) {
   ofstream fOut(segfile);
   if (!fOut.is_open())
@@ -311,3 +397,1687 @@ int test_intersector_from_file(string fileIn) {
   cout << "num intersections = " << nIntx << endl;
   return 0;
 }
+
+// runs the sweep with each active set structure on the same input
+int test_active_sets_from_file(string fileIn) {
+  shared_ptr<vector<Lineseg>> inSegments = read_segments_from_file(fileIn);
+  if (inSegments == nullptr || inSegments->size() == 0) {
+    cout << "!!!!! no segments read from input file !!!!!\n";
+    return -1;
+  }
+
+  LsegIntersector SI;
+  for (const auto &seg : *inSegments) {
+    SI.addSeg(seg);
+  }
+  cout << fileIn << ": number of input segments = " << inSegments->size()
+       << " ----------" << endl;
+
+  int nIntxRef = -1, nFilteredRef = -1;
+  bool pass = true;
+  for (auto activeSet : {ActiveSetType::hash, ActiveSetType::ybucket}) {
+    SI.setActiveSet(activeSet);
+    int nFiltered = -1;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    int nIntx = SI.numIntx(&nFiltered);
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    cout << (activeSet == ActiveSetType::hash ? "hash set" : "y-buckets")
+         << ": Runtime in milliseconds = "
+         << std::chrono::duration<double, std::milli>(end_time - start_time)
+                .count()
+         << ", num filtered pairs = " << nFiltered
+         << ", num intersections = " << nIntx << endl;
+    if (nIntxRef < 0) {
+      nIntxRef = nIntx;
+      nFilteredRef = nFiltered;
+    }
+    pass &= nIntx == nIntxRef && nFiltered == nFilteredRef;
+  }
+  cout << "test_active_sets_from_file() ==> " << (pass ? "Pass" : "Fail")
+       << endl;
+  return pass ? 0 : 1;
+}
+
+// Bentley-Ottmann must agree with brute force, also on grid-snapped segments
+// that share endpoints, overlap, touch and cross at common points
+int test_intersector_BO(int nSegs) {
+  bool pass = true;
+  for (int gridSize : {4, 16, 0}) {
+    vector<Lineseg> segments;
+    std::mt19937 gen(gridSize + 1);
+    std::uniform_real_distribution<> dis(0.0, 1.0);
+    std::uniform_int_distribution<> grid(0, max(gridSize, 1));
+    for (int k = 0; k < nSegs; ++k) {
+      if (gridSize > 0) {
+        double h = 1. / gridSize;
+        segments.emplace_back(Pnt2(grid(gen) * h, grid(gen) * h),
+                              Pnt2(grid(gen) * h, grid(gen) * h), k);
+      } else {
+        Pnt2 P(dis(gen), dis(gen));
+        segments.emplace_back(
+            P, Pnt2(P.x + 0.2 * dis(gen) - 0.1, P.y + 0.2 * dis(gen) - 0.1),
+            k);
+      }
+    }
+    LsegIntersector SI;
+    for (const auto &seg : segments) {
+      SI.addSeg(seg);
+    }
+    int nIntxBF = SI.numIntx_BF(), nIntxBO = SI.numIntx_BO(),
+        nIntx = SI.numIntx();
+    cout << "grid " << gridSize << ": num intersections = " << nIntxBO
+         << " (brute force " << nIntxBF << ", sweep " << nIntx << ")\n";
+    pass &= nIntxBO == nIntxBF && nIntx == nIntxBF;
+  }
+  cout << "test_intersector_BO() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// engines compared by the benchmarks; tag names their data files
+struct bench_engine {
+  const char *name, *tag;
+  int (LsegIntersector::*run)(int *filtered_pairs);
+};
+static const bench_engine benchEngines[] = {
+    {"sweep", "sweep", &LsegIntersector::numIntx_sweep},
+    {"grid", "grid", &LsegIntersector::numIntx_grid},
+    {"Bentley-Ottmann", "bo", &LsegIntersector::numIntx_BO}};
+
+// runs one engine and prints its runtime and counts
+template <class F>
+static int time_engine(const char *name, F &&engine, const int &nFiltered) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int nIntx = engine();
+  auto end_time = std::chrono::high_resolution_clock::now();
+  cout << name << ": Runtime in milliseconds = "
+       << std::chrono::duration<double, std::milli>(end_time - start_time)
+              .count()
+       << ", num tested pairs = " << nFiltered
+       << ", num intersections = " << nIntx << endl;
+  return nIntx;
+}
+
+// runs every engine on the same input; brute force only up to bfMaxSegs
+int benchmark_engines_from_file(string fileIn, int bfMaxSegs) {
+  shared_ptr<vector<Lineseg>> inSegments = read_segments_from_file(fileIn);
+  if (inSegments == nullptr || inSegments->size() == 0) {
+    cout << "!!!!! no segments read from input file !!!!!\n";
+    return -1;
+  }
+
+  LsegIntersector SI;
+  for (const auto &seg : *inSegments) {
+    SI.addSeg(seg);
+  }
+  cout << fileIn << ": number of input segments = " << inSegments->size()
+       << " ----------" << endl;
+
+  int nIntxRef = -1;
+  bool pass = true;
+  for (const auto &engine : benchEngines) {
+    int nFiltered = -1;
+    int nIntx = time_engine(
+        engine.name, [&] { return (SI.*engine.run)(&nFiltered); }, nFiltered);
+    nIntxRef = nIntxRef < 0 ? nIntx : nIntxRef;
+    pass &= nIntx == nIntxRef;
+  }
+  if ((int)inSegments->size() <= bfMaxSegs) {
+    int nPairs = (int)(inSegments->size() * (inSegments->size() - 1) / 2);
+    pass &= time_engine("brute force", [&] { return SI.numIntx_BF(); },
+                        nPairs) == nIntxRef;
+  }
+  cout << "benchmark_engines_from_file() ==> " << (pass ? "Pass" : "Fail")
+       << endl;
+  return pass ? 0 : 1;
+}
+
+// the (n, maxSegLen) sweep used for initial_runtime_data, for all engines;
+// each engine writes its "num intersections, runtime" pairs to
+// data_<n>_<run>_<engine>.txt, which graph_univariate.py can plot
+int benchmark_engines(int nSegments, int run) {
+  string prefix = "data_" + to_string(nSegments) + "_" + to_string(run);
+  vector<ofstream> outs;
+  for (const auto &engine : benchEngines) {
+    outs.emplace_back(prefix + "_" + engine.tag + ".txt");
+  }
+  bool pass = true;
+  for (int k = 1; k <= 20; ++k) {
+    double maxSegLen = 0.01 * k;
+    shared_ptr<vector<Lineseg>> segments =
+        random_segment_generator(nSegments, maxSegLen);
+    LsegIntersector SI;
+    for (const auto &seg : *segments) {
+      SI.addSeg(seg);
+    }
+
+    cout << "n = " << nSegments << ", max segment length = " << maxSegLen
+         << ":";
+    int nIntxRef = -1;
+    for (size_t ie = 0; ie < outs.size(); ++ie) {
+      auto start_time = std::chrono::high_resolution_clock::now();
+      int nIntx = (SI.*benchEngines[ie].run)(nullptr);
+      auto end_time = std::chrono::high_resolution_clock::now();
+      double run_time =
+          std::chrono::duration<double, std::milli>(end_time - start_time)
+              .count();
+      outs[ie] << nIntx << ' ' << run_time << endl;
+      cout << ' ' << benchEngines[ie].name << ' ' << run_time << " ms";
+      nIntxRef = nIntxRef < 0 ? nIntx : nIntxRef;
+      pass &= nIntx == nIntxRef;
+    }
+    cout << ", num intersections = " << nIntxRef << endl;
+  }
+  cout << "benchmark_engines() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// the grid (and its quadtree fallback) must return the same counts as the
+// sweep: uniform short segments, a dense cluster with a few long segments,
+// and grid-snapped segments; automatic must pick the grid for the first
+int test_intersector_grid(int nSegs) {
+  bool pass = true;
+  std::mt19937 gen(2024);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  std::uniform_int_distribution<> grid(0, 8);
+  for (const char *kind : {"uniform", "clustered", "grid-snapped"}) {
+    LsegIntersector SI;
+    for (int k = 0; k < nSegs; ++k) {
+      if (kind[0] == 'g') {
+        SI.addSeg(Lineseg(Pnt2(grid(gen) * 0.125, grid(gen) * 0.125),
+                          Pnt2(grid(gen) * 0.125, grid(gen) * 0.125), k));
+        continue;
+      }
+      bool inCluster = kind[0] == 'c' && dis(gen) < 0.9;
+      Pnt2 P = inCluster ? Pnt2(0.05 * dis(gen), 0.05 * dis(gen))
+                         : Pnt2(dis(gen), dis(gen));
+      double len = (kind[0] == 'c' && dis(gen) < 0.05 ? 0.2 : 0.005) *
+                   (0.5 + 0.5 * dis(gen));
+      double angle = 6.283185307179586 * dis(gen);
+      SI.addSeg(Lineseg(
+          P, Pnt2(P.x + len * cos(angle), P.y + len * sin(angle)), k));
+    }
+    int nFiltered = -1, nFilteredGrid = -1;
+    int nIntx = SI.numIntx_sweep(&nFiltered);
+    int nIntxGrid = SI.numIntx_grid(&nFilteredGrid);
+    SI.setEngine(EngineType::automatic);
+    bool useGrid = SI.selectEngine() == EngineType::grid;
+    cout << kind << ": num intersections = " << nIntxGrid << " (sweep "
+         << nIntx << "), num filtered pairs = " << nFilteredGrid << " (sweep "
+         << nFiltered << "), automatic engine = "
+         << (useGrid ? "grid" : "sweep") << endl;
+    pass &= nIntxGrid == nIntx && nFilteredGrid == nFiltered;
+    if (kind[0] == 'u')
+      pass &= useGrid;
+  }
+  cout << "test_intersector_grid() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// pairs of long segments far from the origin, crossing at their middle at
+// so small an angle that Lineseg::intx takes them for parallel and apart:
+// only the exact predicates find the crossings
+static vector<Lineseg> far_crossing_segments(int nPairs) {
+  const int64_t n = (int64_t)1 << 40, gap = (int64_t)1 << 42;
+  vector<Lineseg> segs;
+  for (int ip = 0; ip < nPairs; ++ip) {
+    int64_t x = ((int64_t)1 << 44) + ip * gap, y = (int64_t)1 << 44;
+    segs.emplace_back(Pnt2(x - n, y - n - 1), Pnt2(x + n, y + n + 1), 2 * ip);
+    segs.emplace_back(Pnt2(x - n + 1001, y - n + 999),
+                      Pnt2(x + n - 1001, y + n - 999), 2 * ip + 1);
+  }
+  return segs;
+}
+
+// the records streamed by reportIntx must match the brute force ones, for
+// both engines and with per-thread buffers; the first case has one
+// intersection of each type
+int test_intx_report(int nSegs) {
+  bool pass = true;
+  {
+    LsegIntersector SI;
+    SI.addSeg(Lineseg(Pnt2{0., 0.}, Pnt2{2., 2.}, 0));
+    SI.addSeg(Lineseg(Pnt2{0., 2.}, Pnt2{2., 0.}, 1)); // crosses 0
+    SI.addSeg(Lineseg(Pnt2{2., 2.}, Pnt2{3., 1.}, 2)); // touches 0
+    SI.addSeg(Lineseg(Pnt2{5., 0.}, Pnt2{7., 0.}, 3));
+    SI.addSeg(Lineseg(Pnt2{6., 0.}, Pnt2{8., 0.}, 4)); // overlaps 3
+    vector<IntxRecord> records;
+    SI.reportIntx([&](const IntxRecord *recs, size_t n, int) {
+      records.insert(records.end(), recs, recs + n);
+    });
+    sort(records.begin(), records.end(),
+         [](const IntxRecord &r1, const IntxRecord &r2) {
+           return r1.id1 < r2.id1;
+         });
+    pass &= records.size() == 3 && records[0].type == IntxType::transverse &&
+            records[0].alfa == 0.5 && records[0].beta == 0.5 &&
+            records[1].type == IntxType::touch && records[1].alfa == 1. &&
+            records[1].beta == 0. && records[2].type == IntxType::overlap &&
+            records[2].alfa == 0.5 && records[2].beta == 0.;
+    cout << "intersection types: " << (pass ? "as expected" : "wrong") << endl;
+  }
+
+  vector<Lineseg> segments;
+  std::mt19937 gen(777);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  std::uniform_int_distribution<> grid(0, 8);
+  for (int k = 0; k < nSegs; ++k) {
+    if (k % 2 == 0) {
+      segments.emplace_back(Pnt2(grid(gen) * 0.125, grid(gen) * 0.125),
+                            Pnt2(grid(gen) * 0.125, grid(gen) * 0.125), k);
+    } else {
+      Pnt2 P(dis(gen), dis(gen));
+      segments.emplace_back(
+          P, Pnt2(P.x + 0.1 * dis(gen) - 0.05, P.y + 0.1 * dis(gen) - 0.05),
+          k);
+    }
+  }
+  vector<IntxRecord> expected;
+  double params[2];
+  for (size_t is = 0; is < segments.size(); ++is) {
+    for (size_t js = is + 1; js < segments.size(); ++js) {
+      int res = Lineseg::intx(segments[is], segments[js], params);
+      if (res > 0)
+        expected.push_back(
+            make_intx_record(segments[is], segments[js], res, params));
+    }
+  }
+  auto byIds = [](const IntxRecord &r1, const IntxRecord &r2) {
+    return r1.id1 != r2.id1 ? r1.id1 < r2.id1 : r1.id2 < r2.id2;
+  };
+  sort(expected.begin(), expected.end(), byIds);
+
+  LsegIntersector SI;
+  for (const auto &seg : segments) {
+    SI.addSeg(seg);
+  }
+  for (auto engine : {EngineType::sweep, EngineType::grid}) {
+    for (int nThreads : {1, 4}) {
+      SI.setEngine(engine);
+      SI.setNumThreads(nThreads);
+      // one output per thread, filled without locking
+      vector<vector<IntxRecord>> perThread(nThreads);
+      int nIntx = SI.reportIntx(
+          [&](const IntxRecord *recs, size_t n, int thread) {
+            perThread[thread].insert(perThread[thread].end(), recs, recs + n);
+          },
+          true, 256);
+      vector<IntxRecord> records;
+      for (const auto &recs : perThread) {
+        records.insert(records.end(), recs.begin(), recs.end());
+      }
+      sort(records.begin(), records.end(), byIds);
+      bool same = (int)records.size() == nIntx &&
+                  records.size() == expected.size();
+      for (size_t k = 0; same && k < records.size(); ++k) {
+        same = records[k].id1 == expected[k].id1 &&
+               records[k].id2 == expected[k].id2 &&
+               records[k].type == expected[k].type &&
+               fabs(records[k].alfa - expected[k].alfa) < 1.e-9 &&
+               fabs(records[k].beta - expected[k].beta) < 1.e-9;
+      }
+      cout << (engine == EngineType::sweep ? "sweep" : "grid") << ", "
+           << nThreads << " threads: " << records.size()
+           << " records, brute force " << expected.size() << endl;
+      pass &= same;
+    }
+  }
+
+  // exact predicates: every pair the kernel counts gets the record of those
+  // predicates, a crossing at the middle of both segments
+  const int nPairs = 30;
+  vector<Lineseg> far = far_crossing_segments(nPairs);
+  LsegIntersector exact;
+  exact.setExactPredicates(true);
+  for (const auto &seg : far) {
+    exact.addSeg(seg);
+  }
+  for (auto engine : {EngineType::sweep, EngineType::grid}) {
+    exact.setEngine(engine);
+    vector<IntxRecord> records;
+    int nIntx = exact.reportIntx([&](const IntxRecord *recs, size_t n, int) {
+      records.insert(records.end(), recs, recs + n);
+    });
+    bool same = nIntx == nPairs && (int)records.size() == nPairs;
+    for (const auto &rec : records) {
+      same &= rec.type == IntxType::transverse && rec.id1 % 2 == 0 &&
+              rec.id2 == rec.id1 + 1 && rec.alfa == 0.5 && rec.beta == 0.5;
+    }
+    cout << (engine == EngineType::sweep ? "sweep" : "grid")
+         << ", exact predicates far from the origin: " << records.size()
+         << " records, " << nPairs << " crossings" << endl;
+    pass &= same;
+  }
+  cout << "test_intx_report() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// bichromatic and 3-group queries: every engine must count exactly the
+// pairs of the groups tested, as brute force does
+int test_intersector_groups(int nSegs) {
+  shared_ptr<vector<Lineseg>> red = random_segment_generator(nSegs, 0.05);
+  shared_ptr<vector<Lineseg>> blue = random_segment_generator(nSegs, 0.05);
+  shared_ptr<vector<Lineseg>> green = random_segment_generator(nSegs, 0.05);
+  double params[2];
+  int nRedBlue = 0;
+  for (const auto &r : *red) {
+    for (const auto &b : *blue) {
+      nRedBlue += Lineseg::intx(r, b, params) > 0;
+    }
+  }
+
+  bool pass = true;
+  for (int nGroups : {2, 3}) {
+    LsegIntersector SI;
+    uint32_t id = 0;
+    for (const auto *layer : {red.get(), blue.get(), green.get()}) {
+      if (layer == green.get() && nGroups < 3)
+        break;
+      for (auto seg : *layer) {
+        seg.id = id++;
+        SI.addSeg(seg, layer == red.get() ? 0 : layer == blue.get() ? 1 : 2);
+      }
+    }
+    int nFilteredAll = -1;
+    SI.numIntx(&nFilteredAll);
+    if (nGroups == 2) {
+      SI.setCrossGroupsOnly();
+    } else {
+      // red against blue, blue against green, and green with itself
+      SI.setGroupPair(0, 0, false);
+      SI.setGroupPair(1, 1, false);
+      SI.setGroupPair(0, 2, false);
+      // out of range groups are rejected and change nothing
+      const int maxGroups = LsegIntersector::maxGroups;
+      pass &= SI.addSeg((*red)[0], maxGroups) == -1 &&
+              SI.addSeg((*red)[0], -1) == -1 &&
+              !SI.setGroupPair(0, maxGroups, false) &&
+              !SI.setGroupPair(-1, 1, true);
+    }
+
+    int nFiltered = -1;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    int nIntx = SI.numIntx(&nFiltered);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    int nIntxBF = SI.numIntx_BF();
+    SI.setNumThreads(4);
+    int nIntxMT = SI.numIntx();
+    int nIntxGrid = SI.numIntx_grid();
+    int nIntxBO = SI.numIntx_BO();
+    cout << nGroups << " groups: Runtime in milliseconds = "
+         << std::chrono::duration<double, std::milli>(end_time - start_time)
+                .count()
+         << ", num filtered pairs = " << nFiltered << " (all groups "
+         << nFilteredAll << "), num intersections = " << nIntx
+         << " (brute force " << nIntxBF << ", 4 threads " << nIntxMT
+         << ", grid " << nIntxGrid << ", Bentley-Ottmann " << nIntxBO
+         << ")\n";
+    pass &= nIntx == nIntxBF && nIntxMT == nIntxBF && nIntxGrid == nIntxBF &&
+            nIntxBO == nIntxBF;
+    if (nGroups == 2)
+      pass &= nIntx == nRedBlue;
+  }
+  cout << "test_intersector_groups() ==> " << (pass ? "Pass" : "Fail")
+       << endl;
+  return pass ? 0 : 1;
+}
+
+int test_intersector_dynamic(int nSegs) {
+  const double maxLen = 0.01;
+  shared_ptr<vector<Lineseg>> segs = random_segment_generator(nSegs, maxLen);
+  LsegIntersector SI;
+  SI.setTol(1.e-9);
+  for (uint32_t is = 0; is < (uint32_t)segs->size(); ++is) {
+    (*segs)[is].id = is;
+    SI.addSeg((*segs)[is]);
+  }
+  int nAdded = nSegs;
+  vector<int> live(nSegs);
+  for (int is = 0; is < nSegs; ++is) {
+    live[is] = is;
+  }
+  SI.numIntx_dynamic();
+
+  bool pass = true;
+  for (int nChanges : {1, 10, 100, 1000}) {
+    double msDynamic = 0., msFull = 0.;
+    const int nRounds = 5;
+    for (int round = 0; round < nRounds; ++round) {
+      // a third of the changes of each kind
+      shared_ptr<vector<Lineseg>> fresh =
+          random_segment_generator(nChanges, maxLen);
+      for (int k = 0; k < nChanges; ++k) {
+        auto seg = (*fresh)[k];
+        size_t il = rand() % live.size();
+        if (k % 3 == 0) {
+          seg.id = nAdded++;
+          SI.addSeg(seg);
+          live.push_back(nAdded - 1);
+        } else if (k % 3 == 1) {
+          SI.removeSeg(live[il]);
+          live[il] = live.back();
+          live.pop_back();
+        } else {
+          seg.id = live[il];
+          SI.updateSeg(live[il], seg);
+        }
+      }
+      auto start_time = std::chrono::high_resolution_clock::now();
+      int nIntx = SI.numIntx_dynamic();
+      auto mid_time = std::chrono::high_resolution_clock::now();
+      int nIntxFull = SI.numIntx();
+      auto end_time = std::chrono::high_resolution_clock::now();
+      msDynamic +=
+          std::chrono::duration<double, std::milli>(mid_time - start_time)
+              .count();
+      msFull +=
+          std::chrono::duration<double, std::milli>(end_time - mid_time)
+              .count();
+      int nIntxGrid = SI.numIntx_grid();
+      int nIntxBO = SI.numIntx_BO();
+      if (nIntx != nIntxFull || nIntxGrid != nIntxFull ||
+          nIntxBO != nIntxFull) {
+        cout << "mismatch after " << nChanges
+             << " changes: dynamic = " << nIntx << ", sweep = " << nIntxFull
+             << ", grid = " << nIntxGrid << ", Bentley-Ottmann = " << nIntxBO
+             << endl;
+        pass = false;
+      }
+    }
+    cout << nChanges << " changes: dynamic update in milliseconds = "
+         << msDynamic / nRounds << ", full count = " << msFull / nRounds
+         << endl;
+  }
+
+  // small set against brute force
+  LsegIntersector small;
+  for (int is = 0; is < 2000; ++is) {
+    small.addSeg((*segs)[is]);
+  }
+  small.numIntx_dynamic();
+  for (int is = 0; is < 2000; is += 7) {
+    small.removeSeg(is);
+    small.updateSeg(is + 1, (*segs)[is + 2000]);
+  }
+  int nIntxSmall = small.numIntx_dynamic();
+  int nIntxBF = small.numIntx_BF();
+  cout << "small set: dynamic = " << nIntxSmall << ", brute force = "
+       << nIntxBF << endl;
+  pass &= nIntxSmall == nIntxBF;
+
+  // both segments of a pair changed in one batch: the pair is counted once,
+  // when it appears and when it goes
+  LsegIntersector pair;
+  pair.addSeg(Lineseg(Pnt2(0, 0), Pnt2(1, 0)));
+  pair.addSeg(Lineseg(Pnt2(0, 1), Pnt2(1, 1)));
+  pair.addSeg(Lineseg(Pnt2(5, 5), Pnt2(6, 6)));
+  int nPair[4];
+  nPair[0] = pair.numIntx_dynamic();
+  pair.updateSeg(0, Lineseg(Pnt2(0, 0), Pnt2(1, 1)));
+  pair.updateSeg(1, Lineseg(Pnt2(0, 1), Pnt2(1, 0)));
+  nPair[1] = pair.numIntx_dynamic();
+  pair.updateSeg(1, Lineseg(Pnt2(0, 1), Pnt2(1, 1)));
+  pair.updateSeg(0, Lineseg(Pnt2(0, 0), Pnt2(1, 0)));
+  nPair[2] = pair.numIntx_dynamic();
+  pair.addSeg(Lineseg(Pnt2(5, 6), Pnt2(6, 5)));
+  pair.addSeg(Lineseg(Pnt2(5.5, 5), Pnt2(5.5, 6)));
+  nPair[3] = pair.numIntx_dynamic();
+  cout << "pair changed together: " << nPair[0] << " " << nPair[1] << " "
+       << nPair[2] << " " << nPair[3] << endl;
+  pass &= nPair[0] == 0 && nPair[1] == 1 && nPair[2] == 0 && nPair[3] == 3;
+
+  // exact predicates on snapped coordinates far from the origin: the count
+  // must follow a full count with the same predicates, also when a change
+  // takes the segments off the grid (round 1) and back
+  std::mt19937 gen(9);
+  std::uniform_int_distribution<int> grid(0, 200), step(-8, 8);
+  const double offset = 0x1p44;
+  auto snapped_seg = [&] {
+    Pnt2 S(offset + grid(gen), offset - grid(gen));
+    return Lineseg(S, Pnt2(S.x + step(gen), S.y + step(gen)));
+  };
+  LsegIntersector exact;
+  exact.setExactPredicates(true);
+  for (int is = 0; is < 3000; ++is) {
+    exact.addSeg(snapped_seg());
+  }
+  exact.numIntx_dynamic();
+  bool exactOk = true;
+  for (int round = 0; round < 4; ++round) {
+    for (int k = 0; k < 50; ++k) {
+      if (k % 3 == 0)
+        exact.addSeg(snapped_seg());
+      else
+        exact.updateSeg(rand() % 3000, snapped_seg());
+    }
+    if (round == 1)
+      exact.updateSeg(0, Lineseg(Pnt2(offset + 0.5, offset),
+                                 Pnt2(offset + 3, offset - 2)));
+    if (round == 2)
+      exact.updateSeg(0, snapped_seg());
+    // off the grid, the double predicates at these coordinates depend on
+    // the order of the tests, so the reference is the grid engine, which
+    // tests the pairs like the dynamic index
+    int nDynamic = exact.numIntx_dynamic();
+    int nFull = round == 1 ? exact.numIntx_grid() : exact.numIntx();
+    cout << "exact predicates, round " << round << ": dynamic = " << nDynamic
+         << ", full count = " << nFull << endl;
+    exactOk &= nDynamic == nFull;
+  }
+  exact.setExactPredicates(false);
+  exactOk &= exact.numIntx_dynamic() == exact.numIntx_grid();
+  pass &= exactOk;
+
+  cout << "test_intersector_dynamic() ==> " << (pass ? "Pass" : "Fail")
+       << endl;
+  return pass ? 0 : 1;
+}
+
+// reference for test_segment_io: the stream-based reader the parser replaced
+static shared_ptr<vector<Lineseg>> read_segments_with_streams(string segfile) {
+  ifstream inSegments(segfile);
+  vector<Lineseg> segments;
+  Pnt2 P1, P2;
+  uint32_t id = 0;
+  string line;
+  while (std::getline(inSegments, line)) {
+    istringstream iss(line);
+    iss >> P1.x >> P1.y >> P2.x >> P2.y;
+    segments.emplace_back(Lineseg(P1, P2, id++));
+  }
+  return make_shared<vector<Lineseg>>(segments);
+}
+
+static bool same_segments(const vector<Lineseg> &a, const vector<Lineseg> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t is = 0; is < a.size(); ++is) {
+    if (a[is].S.x != b[is].S.x || a[is].S.y != b[is].S.y ||
+        a[is].E.x != b[is].E.x || a[is].E.y != b[is].E.y ||
+        a[is].id != b[is].id)
+      return false;
+  }
+  return true;
+}
+
+// text parser against the stream reader, and text -> binary round trip
+int test_segment_io(int nSegs) {
+  bool pass = true;
+  // blanks, CRLF, signs and exponents; malformed lines are rejected
+  string text = "  0.5\t0.25 +1e-1 -2.5E+0\r\n\n1 2 3 4";
+  auto parsed = parse_segments(text.data(), text.size(), 1);
+  pass &= parsed != nullptr && parsed->size() == 2 &&
+          (*parsed)[0].E.x == 0.1 && (*parsed)[0].E.y == -2.5 &&
+          (*parsed)[1].id == 1 && (*parsed)[1].E.y == 4.;
+  for (string bad : {"1 2 3\n", "1 2 3 4x\n", "1 2,5 3 4\n"}) {
+    pass &= parse_segments(bad.data(), bad.size(), 1) == nullptr;
+  }
+
+  shared_ptr<vector<Lineseg>> segments = random_segment_generator(nSegs, 0.01);
+  string textFile = "segment_io_test.txt", binFile = "segment_io_test.lsb";
+  write_segments_to_file(*segments, textFile);
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  auto streamSegs = read_segments_with_streams(textFile);
+  auto mid_time = std::chrono::high_resolution_clock::now();
+  auto fastSegs = read_segments_from_file(textFile);
+  auto end_time = std::chrono::high_resolution_clock::now();
+  cout << nSegs << " segments: stream reader in milliseconds = "
+       << std::chrono::duration<double, std::milli>(mid_time - start_time)
+              .count()
+       << ", parallel parser = "
+       << std::chrono::duration<double, std::milli>(end_time - mid_time)
+              .count()
+       << endl;
+  pass &= fastSegs != nullptr && same_segments(*streamSegs, *fastSegs);
+  mapped_file mapped;
+  if (mapped.open(textFile)) {
+    for (int nThreads : {1, 4}) {
+      auto segs = parse_segments(mapped.data, mapped.size, nThreads);
+      pass &= segs != nullptr && same_segments(*streamSegs, *segs);
+    }
+  } else {
+    pass = false;
+  }
+
+  // binary file, with groups
+  vector<uint8_t> groups(fastSegs->size());
+  for (size_t is = 0; is < groups.size(); ++is) {
+    groups[is] = is % 2;
+  }
+  pass &= write_segments_binary(*fastSegs, binFile, true, &groups);
+  start_time = std::chrono::high_resolution_clock::now();
+  segment_file bin;
+  bool opened = bin.open(binFile);
+  LsegIntersector SI;
+  if (opened)
+    SI.addSegs(bin);
+  end_time = std::chrono::high_resolution_clock::now();
+  cout << "binary file: mapped and added in milliseconds = "
+       << std::chrono::duration<double, std::milli>(end_time - start_time)
+              .count()
+       << endl;
+  pass &= opened && bin.nSegs == fastSegs->size() && bin.groups != nullptr;
+  LsegIntersector SIText;
+  for (const auto &seg : *streamSegs) {
+    SIText.addSeg(seg, seg.id % 2);
+  }
+  SI.setCrossGroupsOnly();
+  SIText.setCrossGroupsOnly();
+  int nIntxBin = SI.numIntx(), nIntxText = SIText.numIntx();
+  cout << "num intersections between groups = " << nIntxBin << " (text "
+       << nIntxText << ")\n";
+  pass &= nIntxBin == nIntxText;
+  auto reread = read_segments_from_file(binFile);
+  pass &= reread != nullptr && same_segments(*reread, *fastSegs);
+
+  // converter, and a truncated file
+  pass &= convert_segments_to_binary(textFile, binFile);
+  reread = read_segments_from_file(binFile);
+  pass &= reread != nullptr && same_segments(*reread, *streamSegs);
+  {
+    ofstream truncated(binFile, ios::binary | ios::trunc);
+    truncated.write(seg_file_magic, sizeof(seg_file_magic));
+  }
+  pass &= read_segments_from_file(binFile) == nullptr;
+
+  // a count whose file size overflows, and a group out of range, are
+  // rejected before anything is read
+  seg_file_header header = {};
+  memcpy(header.magic, seg_file_magic, sizeof(header.magic));
+  header.version = seg_file_version;
+  header.nSegs = (uint64_t)1 << 59; // 2^64 bytes of coordinates
+  header.byteOrder = seg_file_byte_order;
+  {
+    ofstream huge(binFile, ios::binary | ios::trunc);
+    huge.write((const char *)&header, sizeof(header));
+  }
+  segment_file corrupt;
+  LsegIntersector SIBad;
+  pass &= !corrupt.open(binFile) && SIBad.numIntx_stream(binFile) == -1;
+  groups.assign(fastSegs->size(), 0);
+  groups[groups.size() / 2] = 200;
+  write_segments_binary(*fastSegs, binFile, true, &groups);
+  pass &= !corrupt.open(binFile) && SIBad.numIntx_stream(binFile) == -1 &&
+          read_segments_from_file(binFile) == nullptr;
+  remove(textFile.c_str());
+  remove(binFile.c_str());
+
+  cout << "test_segment_io() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// the out-of-core sweep against the in-memory one, with a budget small
+// enough to need several runs and merge passes
+int test_intersector_stream(int nSegs) {
+  shared_ptr<vector<Lineseg>> segments = random_segment_generator(nSegs, 0.01);
+  vector<uint8_t> groups(segments->size());
+  LsegIntersector SI;
+  for (size_t is = 0; is < segments->size(); ++is) {
+    groups[is] = is % 3;
+    SI.addSeg((*segments)[is], groups[is]);
+  }
+  string segfile = "stream_test.lsb";
+  bool pass = write_segments_binary(*segments, segfile, true, &groups);
+
+  for (bool crossGroups : {false, true}) {
+    if (crossGroups)
+      SI.setCrossGroupsOnly();
+    int nFiltered = -1;
+    int nIntx = SI.numIntx(&nFiltered);
+    for (size_t budget : {(size_t)256 << 20, (size_t)1 << 20}) {
+      SI.setStreamBudget(budget);
+      int64_t nFilteredStream = -1;
+      auto start_time = std::chrono::high_resolution_clock::now();
+      int64_t nIntxStream = SI.numIntx_stream(segfile, &nFilteredStream);
+      auto end_time = std::chrono::high_resolution_clock::now();
+      cout << (crossGroups ? "cross groups" : "all pairs") << ", budget "
+           << (budget >> 20) << " MB: Runtime in milliseconds = "
+           << std::chrono::duration<double, std::milli>(end_time - start_time)
+                  .count()
+           << ", num filtered pairs = " << nFilteredStream << " (in memory "
+           << nFiltered << "), num intersections = " << nIntxStream
+           << " (in memory " << nIntx << ")\n";
+      pass &= nIntxStream == nIntx && nFilteredStream == nFiltered;
+    }
+  }
+
+  // exact predicates: the crossings far from the origin that only they find
+  // (see far_crossing_segments), and random segments snapped to the grid;
+  // the same sets without them, where the padding by tol is below the
+  // resolution of the coordinates
+  const int nPairs = 30;
+  vector<Lineseg> far = far_crossing_segments(nPairs);
+  vector<Lineseg> snapped;
+  for (const auto &seg : *segments) {
+    snapped.emplace_back(Pnt2(round(seg.S.x * 1.e6), round(seg.S.y * 1.e6)),
+                         Pnt2(round(seg.E.x * 1.e6), round(seg.E.y * 1.e6)),
+                         seg.id);
+  }
+  for (const auto *segs : {&far, &snapped}) {
+    pass &= write_segments_binary(*segs, segfile);
+    for (bool exactPredicates : {true, false}) {
+      LsegIntersector SIGrid;
+      SIGrid.setExactPredicates(exactPredicates);
+      SIGrid.setSweepAxis(SweepAxis::x);
+      SIGrid.setStreamBudget((size_t)1 << 20);
+      for (const auto &seg : *segs) {
+        SIGrid.addSeg(seg);
+      }
+      int nFiltered = -1;
+      int nIntx = SIGrid.numIntx_sweep(&nFiltered);
+      int64_t nFilteredStream = -1;
+      int64_t nIntxStream = SIGrid.numIntx_stream(segfile, &nFilteredStream);
+      cout << (exactPredicates ? "exact" : "double") << " predicates, "
+           << segs->size()
+           << " segments on the grid: num filtered pairs = "
+           << nFilteredStream << " (in memory " << nFiltered
+           << "), num intersections = " << nIntxStream << " (in memory "
+           << nIntx << ")\n";
+      pass &= nIntxStream == nIntx && nFilteredStream == nFiltered;
+      if (segs == &far && exactPredicates)
+        pass &= nIntx == nPairs;
+    }
+  }
+  remove(segfile.c_str());
+  pass &= SI.numIntx_stream(segfile) == -1;
+
+  cout << "test_intersector_stream() ==> " << (pass ? "Pass" : "Fail")
+       << endl;
+  return pass ? 0 : 1;
+}
+
+// the counters of stats() must agree with the counts of each engine (brute
+// force has no active set); with LSEG_STATS off they must all be zero
+int test_intx_stats(int nSegs) {
+  bool pass = true;
+  auto segs = random_segment_generator(nSegs, 2. / sqrt(nSegs));
+  LsegIntersector SI;
+  for (const auto &seg : *segs) {
+    SI.addSeg(seg);
+  }
+  auto check = [&](const char *engine, int nIntx, int nFiltered) {
+    const intx_stats &st = SI.stats();
+    double totalMs = 0.;
+    for (int s = 0; s < nIntxStages; ++s) {
+      cout << intx_stage_name((IntxStage)s) << " " << st.stageMs[s]
+           << " ms, ";
+      totalMs += st.stageMs[s];
+    }
+    cout << engine << ": candidates = " << st.nCandidates
+         << ", passed = " << st.nPassed << ", touch or overlap = " << st.nByResult[1]
+         << ", transverse = " << st.nByResult[2]
+         << ", max active = " << st.maxActive
+         << ", mean active = " << st.meanActive() << endl;
+    if constexpr (intx_stats::enabled) {
+      pass &= st.nPassed == (uint64_t)nFiltered &&
+              st.nByResult[1] + st.nByResult[2] == (uint64_t)nIntx &&
+              st.nCandidates >= st.nPassed &&
+              (st.maxActive > 0) == (string(engine) != "BF") &&
+              st.meanActive() <= st.maxActive && totalMs > 0.;
+    } else {
+      pass &= st.nCandidates == 0 && st.nPassed == 0 && totalMs == 0.;
+    }
+  };
+  int nFiltered = -1;
+  for (int nThreads : {1, 4}) {
+    SI.setNumThreads(nThreads);
+    int nIntx = SI.numIntx_sweep(&nFiltered);
+    check(nThreads == 1 ? "sweep" : "sweep (4 threads)", nIntx, nFiltered);
+  }
+  int nIntx = SI.numIntx_grid(&nFiltered);
+  check("grid", nIntx, nFiltered);
+  nIntx = SI.numIntx_BO(&nFiltered);
+  check("BO", nIntx, nFiltered);
+  if (nSegs <= 10000) {
+    nIntx = SI.numIntx_BF();
+    check("BF", nIntx, nSegs * (nSegs - 1) / 2);
+  }
+  // counted pairs are the same whatever the engine
+  nIntx = SI.numIntx_sweep();
+  uint64_t nTransverse = SI.stats().nByResult[2];
+  SI.numIntx_grid();
+  pass &= SI.stats().nByResult[2] == nTransverse;
+  SI.numIntx_BO();
+  pass &= SI.stats().nByResult[2] == nTransverse;
+
+  cout << "test_intx_stats() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// every sweep axis must give the counts of the grid, and the automatic choice
+// must follow the dominant orientation: x for uniform segments, y for long
+// near-horizontal ones (roads), diag_neg along x + y and the principal axis
+// for another tilt
+int test_sweep_axis(int nSegs) {
+  bool pass = true;
+  std::mt19937 gen(515);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  struct axis_case {
+    const char *kind;
+    double angle, len; // angle < 0: uniform orientations
+    SweepAxis expected;
+  };
+  for (auto tc : {axis_case{"uniform", -1., 0.01, SweepAxis::x},
+                  axis_case{"roads", 0., 0.2, SweepAxis::y},
+                  axis_case{"diagonal", 0.785398, 0.2, SweepAxis::diag_neg},
+                  axis_case{"tilted", 0.3, 0.2, SweepAxis::principal}}) {
+    LsegIntersector SI;
+    for (int k = 0; k < nSegs; ++k) {
+      Pnt2 P(dis(gen), dis(gen));
+      double angle = tc.angle < 0. ? 6.283185307179586 * dis(gen)
+                                   : tc.angle + 0.02 * (dis(gen) - 0.5);
+      double len = tc.len * (0.5 + 0.5 * dis(gen));
+      SI.addSeg(Lineseg(
+          P, Pnt2(P.x + len * cos(angle), P.y + len * sin(angle)), k));
+    }
+    int nFilteredGrid = -1;
+    int nIntxGrid = SI.numIntx_grid(&nFilteredGrid);
+    cout << tc.kind << ": num intersections = " << nIntxGrid << endl;
+    for (int a = 0; a <= nSweepAxes; ++a) {
+      SI.setSweepAxis((SweepAxis)a);
+      for (int nThreads : {1, 4}) {
+        SI.setNumThreads(nThreads);
+        int nFiltered = -1;
+        int nIntx = SI.numIntx_sweep(&nFiltered);
+        pass &= nIntx == nIntxGrid;
+        // the k-DOP filter passes the same pairs when the axis is one of
+        // its directions
+        if (a < (int)SweepAxis::principal)
+          pass &= nFiltered == nFilteredGrid;
+      }
+      if constexpr (intx_stats::enabled) {
+        const intx_stats &st = SI.stats();
+        if ((SweepAxis)a != SweepAxis::automatic) {
+          pass &= st.sweepAxis == (SweepAxis)a;
+          continue;
+        }
+        cout << "  automatic axis = " << sweep_axis_name(st.sweepAxis)
+             << ", estimated mean active:";
+        for (int e = 0; e < nSweepAxes; ++e) {
+          cout << " " << sweep_axis_name((SweepAxis)e) << " "
+               << st.axisEstimates[e];
+        }
+        cout << ", mean active = " << st.meanActive() << endl;
+        pass &= st.sweepAxis == tc.expected;
+      }
+    }
+  }
+  cout << "test_sweep_axis() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// the exact integer predicates must agree with Lineseg::intx on snapped
+// segments, degenerate ones included (a small grid gives many collinear and
+// touching pairs), be invariant under a translation far beyond the precision
+// of doubles, and give the engines the same counts
+int test_exact_predicates(int nPairs) {
+  bool pass = true;
+  std::mt19937 gen(16);
+  std::uniform_int_distribution<> grid(0, 8);
+  const int64_t shift = (int64_t)1 << 60;
+  int nMismatch = 0, nByRes[3] = {};
+  for (int k = 0; k < nPairs; ++k) {
+    IntLineseg<int32_t> i1, i2;
+    i1.S = {grid(gen), grid(gen)};
+    i1.E = k % 8 == 0 ? i1.S : IntPnt2<int32_t>{grid(gen), grid(gen)};
+    i2.S = k % 3 == 0 ? i1.E : IntPnt2<int32_t>{grid(gen), grid(gen)};
+    i2.E = {grid(gen), grid(gen)};
+    Lineseg l1(Pnt2(i1.S.x, i1.S.y), Pnt2(i1.E.x, i1.E.y));
+    Lineseg l2(Pnt2(i2.S.x, i2.S.y), Pnt2(i2.E.x, i2.E.y));
+    auto shifted = [&](const IntLineseg<int32_t> &l) {
+      return IntLineseg<int64_t>{{l.S.x + shift, l.S.y - shift},
+                                 {l.E.x + shift, l.E.y - shift}};
+    };
+    int res = Lineseg::intx(l1, l2, nullptr);
+    ++nByRes[res];
+    nMismatch += seg_intx(i1, i2) != res ||
+                 seg_intx(shifted(i1), shifted(i2)) != res ||
+                 seg_intx(i2, i1) != res;
+  }
+  cout << "degenerate pairs: none " << nByRes[0] << ", touch " << nByRes[1]
+       << ", transverse " << nByRes[2] << ", mismatches " << nMismatch
+       << endl;
+  pass &= nMismatch == 0;
+
+  // time per pair on nanometre coordinates, pairs of nearby segments
+  std::uniform_int_distribution<int32_t> coord(0, 100000000);
+  std::uniform_int_distribution<int32_t> step(-100000, 100000);
+  vector<Lineseg> segs(2 * nPairs);
+  for (auto &seg : segs) {
+    seg.S = Pnt2(coord(gen), coord(gen));
+    seg.E = Pnt2(seg.S.x + step(gen), seg.S.y + step(gen));
+  }
+  for (size_t k = 1; k < segs.size(); k += 2) {
+    segs[k].S.x = segs[k - 1].S.x + step(gen);
+    segs[k].S.y = segs[k - 1].S.y + step(gen);
+  }
+  auto segs32 = int_segments<int32_t>(segs);
+  auto segs64 = int_segments<int64_t>(segs);
+  auto time_pairs = [&](const auto &v, const char *name) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int sum = 0;
+    for (size_t k = 1; k < v.size(); k += 2) {
+      sum += seg_intx(v[k - 1], v[k]);
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::high_resolution_clock::now() - start)
+                    .count() /
+                nPairs;
+    cout << name << ": " << ns << " ns per pair, sum = " << sum << endl;
+    return sum;
+  };
+  int sumDouble = time_pairs(segs, "double");
+  pass &= time_pairs(segs32, "int32") == sumDouble;
+  pass &= time_pairs(segs64, "int64") == sumDouble;
+
+  // engines, on segments snapped to a coarse grid
+  // engines, on segments snapped to a coarse grid, then moved where the
+  // grid step is below the resolution of tol
+  LsegIntersector SI, SIFar;
+  SIFar.setExactPredicates(true);
+  std::uniform_int_distribution<> snapped(0, 1000);
+  const double far = 1.e12;
+  for (int k = 0; k < 4000; ++k) {
+    Pnt2 P(snapped(gen), snapped(gen));
+    Pnt2 Q(P.x + grid(gen) * 4, P.y + grid(gen) * 4);
+    SI.addSeg(Lineseg(P, Q, k));
+    SIFar.addSeg(
+        Lineseg(Pnt2(P.x + far, P.y - far), Pnt2(Q.x + far, Q.y - far), k));
+  }
+  int nIntx = SI.numIntx_BF();
+  SI.setExactPredicates(true);
+  for (auto *engine : {&SI, &SIFar}) {
+    int nExactBF = engine->numIntx_BF();
+    int nExactSweep = engine->numIntx_sweep();
+    int nExactGrid = engine->numIntx_grid();
+    cout << (engine == &SI ? "snapped" : "far snapped")
+         << " segments: num intersections = " << nIntx << " (exact: BF "
+         << nExactBF << ", sweep " << nExactSweep << ", grid " << nExactGrid
+         << ")" << endl;
+    pass &= nExactBF == nIntx && nExactSweep == nIntx && nExactGrid == nIntx;
+  }
+
+  cout << "test_exact_predicates() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// Lineseg::intx as it was before the policies: all four endpoint distances,
+// then their minimum
+static int reference_intx(const Lineseg &l1, const Lineseg &l2,
+                          double params[2]) {
+  double D = Vec2::CrossZ(Vec2(l1.S, l1.E), Vec2(l2.S, l2.E));
+  if (fabs(D) > eps * l1.len() * l2.len()) {
+    Vec2 PP(l1.S, l2.S);
+    params[0] = Vec2::CrossZ(PP, Vec2(l2.S, l2.E)) / D;
+    params[1] = Vec2::CrossZ(PP, Vec2(l1.S, l1.E)) / D;
+    if (params[0] > 0. && params[0] < 1. && params[1] > 0. && params[1] < 1.)
+      return 2;
+  }
+  double minEnds = min(min(l1.dist(l2.S), l1.dist(l2.E)),
+                       min(l2.dist(l1.S), l2.dist(l1.E)));
+  return minEnds < eps ? 1 : 0;
+}
+
+// every policy of Lineseg::intx must give the classification of the
+// reference, on random pairs and on snapped ones (touching, collinear and
+// zero-length segments); prints the time per pair of each
+int test_intx_policies(int nPairs) {
+  bool pass = true;
+  std::mt19937 gen(17);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  std::uniform_int_distribution<> grid(0, 8);
+  vector<Lineseg> segs(2 * nPairs);
+  for (size_t k = 0; k < segs.size(); ++k) {
+    if (k % 4 < 2) {
+      segs[k] = Lineseg(Pnt2(grid(gen) * 0.125, grid(gen) * 0.125),
+                        Pnt2(grid(gen) * 0.125, grid(gen) * 0.125));
+    } else {
+      Pnt2 P(dis(gen), dis(gen));
+      segs[k] = Lineseg(P, Pnt2(P.x + 0.2 * dis(gen), P.y + 0.2 * dis(gen)));
+    }
+  }
+  int nMismatch = 0;
+  for (size_t k = 1; k < segs.size(); k += 2) {
+    double refParams[2] = {}, params[2] = {};
+    int res = reference_intx(segs[k - 1], segs[k], refParams);
+    nMismatch += Lineseg::intx(segs[k - 1], segs[k], params) != res ||
+                 (res == 2 && (params[0] != refParams[0] ||
+                               params[1] != refParams[1])) ||
+                 Lineseg::intx<intx_type>(segs[k - 1], segs[k], nullptr) !=
+                     res ||
+                 Lineseg::intx<intx_bool>(segs[k - 1], segs[k], nullptr) !=
+                     (res > 0);
+  }
+  cout << "mismatches = " << nMismatch << endl;
+  pass &= nMismatch == 0;
+
+  auto time_policy = [&](const char *name, auto &&test) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int sum = 0;
+    for (size_t k = 1; k < segs.size(); k += 2) {
+      sum += test(segs[k - 1], segs[k]);
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::high_resolution_clock::now() - start)
+                    .count() /
+                nPairs;
+    cout << name << ": " << ns << " ns per pair (sum " << sum << ")" << endl;
+  };
+  double params[2];
+  time_policy("reference", [&](const Lineseg &l1, const Lineseg &l2) {
+    return reference_intx(l1, l2, params);
+  });
+  time_policy("full", [&](const Lineseg &l1, const Lineseg &l2) {
+    return Lineseg::intx(l1, l2, params);
+  });
+  time_policy("type", [&](const Lineseg &l1, const Lineseg &l2) {
+    return Lineseg::intx<intx_type>(l1, l2, nullptr);
+  });
+  time_policy("bool", [&](const Lineseg &l1, const Lineseg &l2) {
+    return Lineseg::intx<intx_bool>(l1, l2, nullptr);
+  });
+
+  cout << "test_intx_policies() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// anyIntersection must agree with numIntx on valid and invalid sets, with
+// one and several threads and with group masks, return an intersecting pair,
+// and answer faster than the full count when the first hit comes early
+int test_any_intersection(int nSegs) {
+  bool pass = true;
+  std::mt19937 gen(18);
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  // disjoint segments: short horizontal pieces on separate rows
+  int nRows = (int)sqrt((double)nSegs);
+  vector<Lineseg> valid;
+  for (int k = 0; k < nSegs; ++k) {
+    double x = (k / nRows) * 1.0 / nRows, y = (k % nRows) * 1.0 / nRows;
+    valid.emplace_back(Pnt2(x, y), Pnt2(x + 0.5 / nRows, y + 0.1 / nRows), k);
+  }
+  auto segs = random_segment_generator(nSegs, 2. / sqrt(nSegs));
+  for (int nThreads : {1, 4}) {
+    for (bool crossGroups : {false, true}) {
+      LsegIntersector SIValid, SIRandom;
+      SIValid.setNumThreads(nThreads);
+      SIRandom.setNumThreads(nThreads);
+      for (const auto &seg : valid) {
+        SIValid.addSeg(seg);
+      }
+      for (const auto &seg : *segs) {
+        SIRandom.addSeg(seg, seg.id % 2);
+      }
+      if (crossGroups)
+        SIRandom.setCrossGroupsOnly();
+      IntxRecord first = {};
+      bool anyValid = SIValid.anyIntersection();
+      bool anyRandom = SIRandom.anyIntersection(&first);
+      int nIntx = SIRandom.numIntx_sweep();
+      const auto &s1 = (*segs)[first.id1], &s2 = (*segs)[first.id2];
+      bool firstOk = Lineseg::intx(s1, s2, nullptr) > 0 &&
+                     (!crossGroups || s1.id % 2 != s2.id % 2);
+      cout << "threads " << nThreads << (crossGroups ? ", cross groups" : "")
+           << ": valid set " << anyValid << " (count "
+           << SIValid.numIntx_sweep() << "), random set " << anyRandom
+           << " (count " << nIntx << "), first pair " << first.id1 << "-"
+           << first.id2 << endl;
+      pass &= !anyValid && anyRandom == (nIntx > 0) && firstOk;
+    }
+  }
+
+  // one crossing at the far left of a valid set, swept along x: the answer
+  // must not wait for the sort and the sweep of the whole set
+  LsegIntersector SI;
+  SI.setSweepAxis(SweepAxis::x);
+  for (const auto &seg : valid) {
+    SI.addSeg(seg);
+  }
+  SI.addSeg(Lineseg(Pnt2(-0.1, -0.1), Pnt2(-0.05, -0.05)));
+  SI.addSeg(Lineseg(Pnt2(-0.1, -0.05), Pnt2(-0.05, -0.1)));
+  auto start = std::chrono::high_resolution_clock::now();
+  bool any = SI.anyIntersection();
+  double anyMs = std::chrono::duration<double, std::milli>(
+                     std::chrono::high_resolution_clock::now() - start)
+                     .count();
+  start = std::chrono::high_resolution_clock::now();
+  int nIntx = SI.numIntx_sweep();
+  double countMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+  cout << "early hit: anyIntersection " << anyMs << " ms, numIntx " << countMs
+       << " ms (" << nIntx << " intersection)" << endl;
+  pass &= any && nIntx == 1 && anyMs < countMs;
+
+  cout << "test_any_intersection() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+int test_segment_index(int nSegs, int nQueries) {
+  bool pass = true;
+  double len = 2. / sqrt(nSegs);
+  auto segs = random_segment_generator(nSegs, len);
+  auto queries = random_segment_generator(nQueries, len);
+  // the same pairs, counted by the sweep: the reference set in group 0, the
+  // queries in group 1, every 10th reference segment removed
+  LsegIntersector SI, SIPairs;
+  SIPairs.setCrossGroupsOnly();
+  for (const auto &seg : *segs) {
+    SI.addSeg(seg);
+    SIPairs.addSeg(seg, 0);
+  }
+  for (const auto &q : *queries) {
+    SIPairs.addSeg(q, 1);
+  }
+  for (int is = 0; is < nSegs; is += 10) {
+    SI.removeSeg(is);
+    SIPairs.removeSeg(is);
+  }
+  int nPairs = SIPairs.numIntx();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  seg_rtree index = SI.buildIndex();
+  double buildMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+  index_hits hits1, hits4, hitsLoaded;
+  start = std::chrono::high_resolution_clock::now();
+  index.query_batch(*queries, hits1, 1);
+  double queryMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+  index.query_batch(*queries, hits4, 4);
+
+  // hits of the first queries, by brute force
+  bool bfOk = true;
+  for (int iq = 0; iq < min(nQueries, 100); ++iq) {
+    const auto &q = (*queries)[iq];
+    vector<uint32_t> expected, found;
+    for (int is = 0; is < nSegs; ++is) {
+      if (is % 10 != 0 && Lineseg::intx((*segs)[is], q, nullptr) > 0)
+        expected.push_back((uint32_t)is);
+    }
+    for (size_t k = 0; k < hits1.count(iq); ++k) {
+      const auto &rec = hits1.first(iq)[k];
+      found.push_back(rec.id1);
+      bfOk &= rec.id2 == q.id;
+    }
+    sort(found.begin(), found.end());
+    bfOk &= found == expected;
+  }
+
+  auto same_hits = [](const index_hits &h1, const index_hits &h2) {
+    if (h1.start != h2.start)
+      return false;
+    for (size_t k = 0; k < h1.records.size(); ++k) {
+      const auto &r1 = h1.records[k], &r2 = h2.records[k];
+      if (r1.id1 != r2.id1 || r1.id2 != r2.id2 || r1.type != r2.type ||
+          r1.alfa != r2.alfa || r1.beta != r2.beta)
+        return false;
+    }
+    return true;
+  };
+
+  string indexFile = "segment_index_test.idx";
+  bool saved = index.save(indexFile);
+  seg_rtree loaded;
+  start = std::chrono::high_resolution_clock::now();
+  bool read = loaded.load(indexFile);
+  double loadMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count();
+  loaded.query_batch(*queries, hitsLoaded, 2);
+  // a truncated file is rejected
+  {
+    ifstream in(indexFile, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    ofstream out(indexFile, ios::binary);
+    out.write(bytes.data(), bytes.size() / 2);
+  }
+  seg_rtree truncated;
+  bool rejected = !truncated.load(indexFile) && truncated.empty();
+  remove(indexFile.c_str());
+
+  cout << index.size() << " segments, " << index.nodes.size()
+       << " nodes: build " << buildMs << " ms, load " << loadMs << " ms; "
+       << nQueries << " queries " << queryMs << " ms, "
+       << hits1.records.size() << " hits (sweep " << nPairs << ")" << endl;
+  cout << "brute force " << bfOk << ", 4 threads " << same_hits(hits1, hits4)
+       << ", saved and loaded " << (saved && read)
+       << same_hits(hits1, hitsLoaded) << ", truncated file rejected "
+       << rejected << endl;
+  pass &= (int)hits1.records.size() == nPairs && bfOk &&
+          same_hits(hits1, hits4) && saved && read &&
+          same_hits(hits1, hitsLoaded) && rejected &&
+          index.size() == (size_t)(nSegs - (nSegs + 9) / 10);
+
+  cout << "test_segment_index() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+int test_event_sort(int nEvents) {
+  bool pass = true;
+  std::mt19937 gen(20);
+  std::uniform_real_distribution<> dis(-1.0, 1.0);
+  // ends with many ties between the end of an interval and the start of
+  // another, negative values and both zeros
+  vector<intvl_end> sides;
+  for (uint32_t is = 0; (int)sides.size() < nEvents; ++is) {
+    double a = is % 3 == 0 ? round(8. * dis(gen)) / 8. : dis(gen);
+    double b = is % 5 == 0 ? a : a + 0.01 * fabs(dis(gen));
+    sides.push_back(intvl_end{is % 7 == 0 ? -0. : a, is, 0});
+    sides.push_back(intvl_end{b, is, 1});
+  }
+  vector<intvl_end> expected = sides;
+  sort(expected.begin(), expected.end(), customComp());
+  for (int m = 0; m < nEventSorts; ++m) {
+    for (int nThreads : {1, 4}) {
+      vector<intvl_end> sorted = sides;
+      auto start = std::chrono::high_resolution_clock::now();
+      sort_events(sorted, (EventSort)m, nThreads);
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count();
+      // same values and sides, in order; the ids of equal ends may differ
+      bool same = sorted.size() == expected.size();
+      vector<uint64_t> ids1, ids2;
+      for (size_t k = 0; same && k < sorted.size(); ++k) {
+        same &= sorted[k].val == expected[k].val &&
+                sorted[k].iend == expected[k].iend;
+        ids1.push_back(2 * (uint64_t)sorted[k].id + sorted[k].iend);
+        ids2.push_back(2 * (uint64_t)expected[k].id + expected[k].iend);
+      }
+      sort(ids1.begin(), ids1.end());
+      sort(ids2.begin(), ids2.end());
+      same &= ids1 == ids2;
+      cout << event_sort_name((EventSort)m) << ", threads " << nThreads
+           << ": " << ms << " ms, " << (same ? "same order" : "WRONG order")
+           << endl;
+      pass &= same;
+    }
+  }
+
+  // the sweep counts on a lattice, where segments touch end to end
+  LsegIntersector SI;
+  int k = 60;
+  for (int i = 0; i <= k; ++i) {
+    for (int j = 0; j < k; ++j) {
+      SI.addSeg(Lineseg(Pnt2((double)j / k, (double)i / k),
+                        Pnt2((double)(j + 1) / k, (double)i / k)));
+      SI.addSeg(Lineseg(Pnt2((double)i / k, (double)j / k),
+                        Pnt2((double)i / k, (double)(j + 1) / k)));
+    }
+  }
+  SI.setSweepAxis(SweepAxis::x);
+  int nRef = -1;
+  for (int m = 0; m < nEventSorts; ++m) {
+    for (int nThreads : {1, 4}) {
+      SI.setEventSort((EventSort)m);
+      SI.setNumThreads(nThreads);
+      int nIntx = SI.numIntx_sweep();
+      nRef = nRef < 0 ? nIntx : nRef;
+      cout << "lattice, " << event_sort_name((EventSort)m) << ", threads "
+           << nThreads << ": " << nIntx << " intersections" << endl;
+      pass &= nIntx == nRef;
+    }
+  }
+
+  cout << "test_event_sort() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+int test_case_batch(int nCases) {
+  bool pass = true;
+  // small random cases, plus a missing file
+  vector<string> patterns, names;
+  vector<int> expected;
+  for (int ic = 0; ic < nCases; ++ic) {
+    string name = "batch_test_" + to_string(ic) + ".txt";
+    auto segs = random_segment_generator(200 + 50 * ic, 0.1);
+    write_segments_to_file(*segs, name);
+    names.push_back(name);
+    // counted as read back, since the file rounds the coordinates
+    auto reread = read_segments_from_file(name);
+    LsegIntersector SI;
+    for (const auto &seg : *reread) {
+      SI.addSeg(seg);
+    }
+    expected.push_back(SI.numIntx());
+  }
+  patterns.push_back("batch_test_*.txt");
+  patterns.push_back("batch_test_missing.txt");
+  vector<string> cases = expand_case_patterns(patterns);
+
+  for (int nThreads : {1, 3}) {
+    ostringstream out;
+    int nFailed = run_case_batch(cases, nThreads, out);
+    // one line per case, in the order of the cases
+    istringstream in(out.str());
+    string line;
+    size_t ic = 0;
+    bool linesOk = true;
+    while (getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+      istringstream fields(line);
+      string name;
+      long nSegs;
+      int nIntx, nFiltered;
+      fields >> name >> nSegs >> nIntx >> nFiltered;
+      auto it = find(names.begin(), names.end(), name);
+      linesOk &= ic < cases.size() && name == cases[ic] &&
+                 (it == names.end()
+                      ? nSegs == -1
+                      : nIntx == expected[it - names.begin()]);
+      ++ic;
+    }
+    cout << "threads " << nThreads << ": " << ic << " lines for "
+         << cases.size() << " cases, " << nFailed << " unreadable, counts "
+         << (linesOk ? "match" : "DIFFER") << endl;
+    pass &= linesOk && ic == cases.size() && nFailed == 1 &&
+            cases.size() == (size_t)nCases + 1;
+  }
+  for (const auto &name : names) {
+    remove(name.c_str());
+  }
+
+  cout << "test_case_batch() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+int test_intersector_tiled(int nSegs) {
+  bool pass = true;
+  auto segs = random_segment_generator(nSegs, 2. / sqrt(nSegs));
+  // a lattice of touching edges, which puts many pairs on tile boundaries
+  vector<Lineseg> lattice;
+  int k = 40;
+  for (int i = 0; i <= k; ++i) {
+    for (int j = 0; j < k; ++j) {
+      lattice.emplace_back(Pnt2(j, i), Pnt2(j + 1, i));
+      lattice.emplace_back(Pnt2(i, j), Pnt2(i, j + 1));
+    }
+  }
+
+  for (int setup = 0; setup < 4; ++setup) {
+    LsegIntersector SI;
+    const auto &input = setup == 3 ? lattice : *segs;
+    for (const auto &seg : input) {
+      SI.addSeg(seg, seg.id % 3);
+    }
+    if (setup == 1) {
+      SI.setCrossGroupsOnly();
+      for (int is = 0; is < (int)input.size(); is += 7) {
+        SI.removeSeg(is);
+      }
+    }
+    if (setup == 2)
+      SI.setEngine(EngineType::grid);
+    if (setup == 3)
+      SI.setExactPredicates(true);
+    auto start = std::chrono::high_resolution_clock::now();
+    int nRef = SI.numIntx();
+    double refMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+    cout << (setup == 0   ? "random"
+             : setup == 1 ? "cross groups, removed"
+             : setup == 2 ? "grid engine"
+                          : "lattice, exact")
+         << ": numIntx " << nRef << " (" << refMs << " ms)";
+    for (auto [nWorkers, nx, ny] : {array<int, 3>{1, 1, 1}, {4, 0, 0},
+                                    {3, 5, 3}, {8, 16, 16}}) {
+      start = std::chrono::high_resolution_clock::now();
+      int nTiled = SI.numIntx_tiled(nWorkers, nx, ny);
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count();
+      cout << ", " << nWorkers << " workers " << nx << "x" << ny << ": "
+           << nTiled << " (" << ms << " ms)";
+      pass &= nTiled == nRef;
+    }
+    cout << endl;
+  }
+
+  cout << "test_intersector_tiled() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// Noding: a lattice of long lines, with overlapping pieces of one of them,
+// must give the (k+1)^2 crossings and 2k(k+1) unit edges, plus one edge for
+// a segment starting within tol of a corner. Endpoints within tol of a
+// segment they touch must split it, and so must crossings far from the
+// origin with exact predicates. On random
+// segments, two edges may only meet at a vertex they share, the edges must
+// add up to the lengths of the segments, and the threads and the grid
+// engine must give the same arrangement.
+int test_noding(int nSegs) {
+  bool pass = true;
+  int k = 40;
+  LsegIntersector lattice;
+  for (int i = 0; i <= k; ++i) {
+    lattice.addSeg(Lineseg(Pnt2(0, i), Pnt2(k, i)));
+    lattice.addSeg(Lineseg(Pnt2(i, 0), Pnt2(i, k)));
+  }
+  lattice.addSeg(Lineseg(Pnt2(0, 0), Pnt2(k / 2 + 3, 0)));
+  lattice.addSeg(Lineseg(Pnt2(k, 0), Pnt2(k / 2 - 3, 0)));
+  lattice.setTol(1.e-3);
+  lattice.addSeg(Lineseg(Pnt2(k + 5.e-4, k), Pnt2(k + 1, k + 1)));
+  arrangement arr = lattice.nodeSegs();
+  bool latticeOk = arr.vertices.size() == (size_t)(k + 1) * (k + 1) + 1 &&
+                   arr.edges.size() == (size_t)2 * k * (k + 1) + 1;
+  cout << "lattice " << k << "x" << k << ": " << arr.vertices.size()
+       << " vertices, " << arr.edges.size() << " edges" << endl;
+  pass &= latticeOk;
+
+  // contacts within tol rather than eps: a segment touching another one at
+  // its start and ending within tol of it splits it at both ends
+  LsegIntersector near;
+  near.setTol(1.e-3);
+  near.addSeg(Lineseg(Pnt2(0, 0), Pnt2(10, 0)));
+  near.addSeg(Lineseg(Pnt2(2, 0), Pnt2(8, 5.e-4)));
+  arr = near.nodeSegs();
+  size_t nSplit = count_if(arr.edges.begin(), arr.edges.end(),
+                           [](const arrangement_edge &e) { return e.is == 0; });
+  cout << "end within tol: " << arr.vertices.size() << " vertices, "
+       << arr.edges.size() << " edges, " << nSplit << " on the first segment"
+       << endl;
+  pass &= arr.vertices.size() == 4 && arr.edges.size() == 3 && nSplit == 3;
+
+  // exact predicates: the pairs of far_crossing_segments split each other
+  // at their middle
+  const int nPairs = 30;
+  LsegIntersector far;
+  far.setExactPredicates(true);
+  for (const auto &seg : far_crossing_segments(nPairs)) {
+    far.addSeg(seg);
+  }
+  for (auto engine : {EngineType::sweep, EngineType::grid}) {
+    far.setEngine(engine);
+    arr = far.nodeSegs();
+    cout << (engine == EngineType::sweep ? "sweep" : "grid")
+         << ", exact predicates far from the origin: " << arr.nIntx
+         << " intersections, " << arr.vertices.size() << " vertices, "
+         << arr.edges.size() << " edges" << endl;
+    pass &= arr.nIntx == nPairs && arr.vertices.size() == (size_t)5 * nPairs &&
+            arr.edges.size() == (size_t)4 * nPairs;
+  }
+
+  auto segs = random_segment_generator(nSegs, 2. / sqrt(nSegs));
+  arrangement ref;
+  for (int setup = 0; setup < 3; ++setup) {
+    LsegIntersector SI;
+    for (const auto &seg : *segs) {
+      SI.addSeg(seg);
+    }
+    if (setup == 1)
+      SI.setNumThreads(4);
+    if (setup == 2)
+      SI.setEngine(EngineType::grid);
+    auto start = std::chrono::high_resolution_clock::now();
+    arr = SI.nodeSegs();
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start)
+                    .count();
+    start = std::chrono::high_resolution_clock::now();
+    int nReported = SI.reportIntx([](const IntxRecord *, size_t, int) {});
+    double reportMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::high_resolution_clock::now() - start)
+                          .count();
+    cout << (setup == 0 ? "sweep" : setup == 1 ? "4 threads" : "grid")
+         << ": " << arr.nIntx << " intersections, " << arr.vertices.size()
+         << " vertices, " << arr.edges.size() << " edges in " << ms
+         << " ms (reportIntx " << reportMs << " ms)";
+    bool ok = arr.nIntx == nReported;
+    if (setup == 0) {
+      // the edges only meet at shared vertices
+      LsegIntersector edges;
+      for (size_t ie = 0; ie < arr.edges.size(); ++ie) {
+        edges.addSeg(arr.edge_seg(ie));
+      }
+      int nBad = 0;
+      edges.reportIntx([&](const IntxRecord *records, size_t n, int) {
+        for (size_t ir = 0; ir < n; ++ir) {
+          const auto &e1 = arr.edges[records[ir].id1];
+          const auto &e2 = arr.edges[records[ir].id2];
+          nBad += e1.v0 != e2.v0 && e1.v0 != e2.v1 && e1.v1 != e2.v0 &&
+                  e1.v1 != e2.v1;
+        }
+      });
+      double segLen = 0., edgeLen = 0.;
+      for (const auto &seg : *segs) {
+        segLen += seg.len();
+      }
+      for (size_t ie = 0; ie < arr.edges.size(); ++ie) {
+        edgeLen += arr.edge_seg(ie).len();
+      }
+      cout << ", " << nBad << " edges crossing, lengths " << segLen << " vs "
+           << edgeLen;
+      ok &= nBad == 0 && fabs(edgeLen - segLen) < 1.e-9 * segLen;
+      ref = arr;
+    } else {
+      bool same = arr.vertices.size() == ref.vertices.size() &&
+                  arr.edges.size() == ref.edges.size();
+      for (size_t iv = 0; same && iv < arr.vertices.size(); ++iv) {
+        same = arr.vertices[iv].x == ref.vertices[iv].x &&
+               arr.vertices[iv].y == ref.vertices[iv].y;
+      }
+      for (size_t ie = 0; same && ie < arr.edges.size(); ++ie) {
+        same = arr.edges[ie].v0 == ref.edges[ie].v0 &&
+               arr.edges[ie].v1 == ref.edges[ie].v1 &&
+               arr.edges[ie].is == ref.edges[ie].is;
+      }
+      cout << (same ? ", same arrangement" : ", arrangement DIFFERS");
+      ok &= same;
+    }
+    cout << endl;
+    pass &= ok;
+  }
+
+  cout << "test_noding() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// Proximity join: Lineseg::dist against a dense sampling of both segments,
+// then the pairs of proximityJoin against all pairs tested by
+// Lineseg::dist, for several clearances, with both engines, 4 threads,
+// 4 and 16 filter directions and cross groups; the records must hold the
+// distance between their closest points.
+int test_proximity_join(int nSegs) {
+  bool pass = true;
+  auto segs = random_segment_generator(nSegs, 2. / sqrt(nSegs));
+
+  // the distance kernel: no sampled pair of points is closer, and the
+  // closest points are as far apart as the distance
+  int nKernelBad = 0;
+  const int nSamples = 200;
+  for (int ip = 0; ip + 1 < nSegs && ip < 2000; ip += 2) {
+    const auto &l1 = (*segs)[ip], &l2 = (*segs)[ip + 1];
+    double params[2];
+    double dist = l1.dist(l2, params);
+    double sampled = l1.dist(l2.S);
+    for (int k = 0; k <= nSamples; ++k) {
+      sampled = min(sampled, l1.dist(l2.at((double)k / nSamples)));
+    }
+    double step = max(l1.len(), l2.len()) / nSamples;
+    nKernelBad += dist > sampled + 1.e-12 || sampled > dist + step ||
+                  fabs(l1.at(params[0]).dist(l2.at(params[1])) - dist) >
+                      1.e-12;
+  }
+  cout << "distance kernel: " << nKernelBad << " bad pairs" << endl;
+  pass &= nKernelBad == 0;
+
+  for (double clearance : {1.e-4, 1.e-3, 1.e-2}) {
+    // pairs closer than clearance, and those of different groups
+    int nRef = 0, nRefCross = 0;
+    for (int is = 0; is < nSegs; ++is) {
+      for (int js = is + 1; js < nSegs; ++js) {
+        if ((*segs)[is].dist((*segs)[js]) < clearance) {
+          ++nRef;
+          nRefCross += is % 2 != js % 2;
+        }
+      }
+    }
+    cout << "clearance " << clearance << ": " << nRef << " pairs";
+    for (int setup = 0; setup < 5; ++setup) {
+      LsegIntersector SI;
+      for (const auto &seg : *segs) {
+        SI.addSeg(seg, seg.id % 2);
+      }
+      if (setup == 1)
+        SI.setEngine(EngineType::grid);
+      if (setup == 2)
+        SI.setNumThreads(4);
+      if (setup == 3)
+        SI.setFilterDirections(4);
+      if (setup == 4) {
+        SI.setFilterDirections(16);
+        SI.setCrossGroupsOnly();
+      }
+      int nBad = 0;
+      size_t nRecords = 0;
+      int nPairs = SI.proximityJoin(
+          clearance, [&](const NearRecord *records, size_t n, int) {
+            for (size_t ir = 0; ir < n; ++ir) {
+              const auto &r = records[ir];
+              const auto &l1 = (*segs)[r.id1], &l2 = (*segs)[r.id2];
+              nBad += r.id1 >= r.id2 || !(r.dist < clearance) ||
+                      fabs(r.dist - l1.dist(l2)) > 0. ||
+                      fabs(l1.at(r.alfa).dist(l2.at(r.beta)) - r.dist) >
+                          1.e-12;
+            }
+            nRecords += n;
+          });
+      int expected = setup == 4 ? nRefCross : nRef;
+      cout << ", " << nPairs;
+      pass &= nPairs == expected && nRecords == (size_t)expected && nBad == 0;
+    }
+    cout << endl;
+  }
+
+  // timing on a larger set, against the count of intersections
+  int nLarge = 50 * nSegs;
+  auto large = random_segment_generator(nLarge, 2. / sqrt(nLarge));
+  LsegIntersector SI;
+  for (const auto &seg : *large) {
+    SI.addSeg(seg);
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  int nIntx = SI.numIntx();
+  double intxMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count();
+  cout << nLarge << " segments: numIntx " << nIntx << " (" << intxMs << " ms)";
+  for (double clearance : {1.e-5, 1.e-4, 1.e-3}) {
+    start = std::chrono::high_resolution_clock::now();
+    int nPairs = SI.proximityJoin(clearance);
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start)
+                    .count();
+    cout << ", within " << clearance << ": " << nPairs << " (" << ms << " ms)";
+    pass &= nPairs >= nIntx;
+  }
+  cout << endl;
+
+  cout << "test_proximity_join() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+#include "lseg.h"
+#include "lseg_intersector.h"
+#include "sweep_workspace.h"
+#include "workloads.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Warm workspace test (lineseg_alloc_test): the global operator new and
+ * delete of this program are replaced by versions that count the
+ * allocations, which is why the test has its own executable rather than
+ * being part of lineseg, whose allocations must not pay for the counter.
+ */
+
+static atomic<size_t> nHeapAllocs(0);
+
+static void *counted_alloc(size_t size, size_t align) {
+  ++nHeapAllocs;
+  if (size == 0)
+    size = 1;
+  if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    return malloc(size);
+  // aligned_alloc wants a multiple of the alignment
+  return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *operator new(size_t size) {
+  if (void *p = counted_alloc(size, 0))
+    return p;
+  throw bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, align_val_t align) {
+  if (void *p = counted_alloc(size, (size_t)align))
+    return p;
+  throw bad_alloc();
+}
+void *operator new[](size_t size, align_val_t align) {
+  return operator new(size, align);
+}
+void *operator new(size_t size, const nothrow_t &) noexcept {
+  return counted_alloc(size, 0);
+}
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+  return counted_alloc(size, 0);
+}
+void *operator new(size_t size, align_val_t align, const nothrow_t &) noexcept {
+  return counted_alloc(size, (size_t)align);
+}
+void *operator new[](size_t size, align_val_t align,
+                     const nothrow_t &) noexcept {
+  return counted_alloc(size, (size_t)align);
+}
+
+// malloc and aligned_alloc both give memory that free releases
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete(void *p, const nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, align_val_t, const nothrow_t &) noexcept {
+  free(p);
+}
+void operator delete[](void *p, align_val_t, const nothrow_t &) noexcept {
+  free(p);
+}
+
+// Steady state of small queries: a set of queries of various sizes is run
+// on one intersector (clear, addSeg, numIntx and anyIntersection), then run
+// again, which must not allocate at all. Each active set, both sorts and
+// the group filter are covered, and a workspace shared by two intersectors;
+// the counts must match those of fresh intersectors.
+static int test_workspace_allocs(int nQueries) {
+  bool pass = true;
+  // sizes on both sides of the thresholds of the radix sort and of the
+  // choice of the axis
+  vector<vector<Lineseg>> queries;
+  for (int iq = 0; iq < nQueries; ++iq) {
+    int nSegs = 20 + (int)((iq * 2654435761u) % 3000);
+    queries.push_back(generate_workload(Workload::uniform, nSegs, iq));
+  }
+
+  for (int setup = 0; setup < 5; ++setup) {
+    auto configure = [&](LsegIntersector &SI) {
+      SI.setActiveSet(setup == 1 || setup == 3 ? ActiveSetType::hash
+                                               : ActiveSetType::ybucket);
+      SI.setEventSort(setup == 2 || setup == 3 ? EventSort::comparison
+                                               : EventSort::radix);
+      if (setup == 3)
+        SI.setCrossGroupsOnly();
+    };
+    auto load = [&](LsegIntersector &SI, const vector<Lineseg> &segs) {
+      for (const auto &seg : segs) {
+        SI.addSeg(seg, seg.id % 2);
+      }
+    };
+    vector<int> refCounts(nQueries), counts(nQueries);
+    vector<uint8_t> refAny(nQueries), found(nQueries);
+    for (int iq = 0; iq < nQueries; ++iq) {
+      LsegIntersector fresh;
+      configure(fresh);
+      load(fresh, queries[iq]);
+      refCounts[iq] = fresh.numIntx();
+      refAny[iq] = fresh.anyIntersection();
+    }
+
+    // setup 4: the queries alternate between two intersectors on one
+    // workspace
+    LsegIntersector SI[2];
+    sweep_workspace shared;
+    for (auto &si : SI) {
+      configure(si);
+      if (setup == 4)
+        si.setWorkspace(&shared);
+    }
+    auto run_all = [&] {
+      for (int iq = 0; iq < nQueries; ++iq) {
+        auto &si = SI[setup == 4 ? iq % 2 : 0];
+        si.clear();
+        load(si, queries[iq]);
+        counts[iq] = si.numIntx();
+        found[iq] = si.anyIntersection();
+      }
+    };
+    size_t before = nHeapAllocs;
+    run_all();
+    size_t nWarmup = nHeapAllocs - before;
+    before = nHeapAllocs;
+    auto start = chrono::high_resolution_clock::now();
+    run_all();
+    double ms = chrono::duration<double, milli>(
+                    chrono::high_resolution_clock::now() - start)
+                    .count();
+    size_t nAllocs = nHeapAllocs - before;
+    bool same = counts == refCounts && found == refAny;
+    cout << (setup == 0   ? "ybucket, radix"
+             : setup == 1 ? "hash, radix"
+             : setup == 2 ? "ybucket, std sort"
+             : setup == 3 ? "hash, std sort, cross groups"
+                          : "shared workspace")
+         << ": " << nWarmup << " allocations warming up, then " << nQueries
+         << " queries in " << ms << " ms, " << nAllocs << " allocations"
+         << (same ? "" : ", counts differ") << endl;
+    pass &= same && nWarmup > 0 && nAllocs == 0;
+  }
+
+  cout << "test_workspace_allocs() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// Steady state of numIntx_dynamic on a stream of small updates: a few
+// segments move back and forth between two places, and once both have been
+// indexed, the updates and counts must not allocate. The counts must match
+// those of numIntx on the same segments.
+static int test_dynamic_allocs(int nRounds) {
+  const int nSegs = 20000, nMoved = 10;
+  vector<Lineseg> segs = generate_workload(Workload::uniform, nSegs, 1);
+  vector<Lineseg> moved;
+  for (int k = 0; k < nMoved; ++k) {
+    const auto &seg = segs[k * (nSegs / nMoved)];
+    moved.emplace_back(Pnt2(seg.S.x + 0.01, seg.S.y - 0.02),
+                       Pnt2(seg.E.x - 0.03, seg.E.y + 0.01), seg.id);
+  }
+  // counts with the segments in place (0) or moved (1)
+  int refCounts[2];
+  for (int state = 0; state < 2; ++state) {
+    LsegIntersector fresh;
+    for (const auto &seg : segs) {
+      fresh.addSeg(seg);
+    }
+    if (state == 1) {
+      for (int k = 0; k < nMoved; ++k) {
+        fresh.updateSeg(k * (nSegs / nMoved), moved[k]);
+      }
+    }
+    refCounts[state] = fresh.numIntx();
+  }
+
+  LsegIntersector SI;
+  for (const auto &seg : segs) {
+    SI.addSeg(seg);
+  }
+  bool same = SI.numIntx_dynamic() == refCounts[0];
+  auto run_rounds = [&](int n) {
+    for (int round = 1; round <= n; ++round) {
+      for (int k = 0; k < nMoved; ++k) {
+        int is = k * (nSegs / nMoved);
+        SI.updateSeg(is, round % 2 ? moved[k] : segs[is]);
+      }
+      same &= SI.numIntx_dynamic() == refCounts[round % 2];
+    }
+  };
+  size_t before = nHeapAllocs;
+  run_rounds(2);
+  size_t nWarmup = nHeapAllocs - before;
+  before = nHeapAllocs;
+  run_rounds(nRounds);
+  size_t nAllocs = nHeapAllocs - before;
+  cout << "dynamic updates: " << nWarmup << " allocations warming up, then "
+       << nRounds << " rounds of " << nMoved << " updates, " << nAllocs
+       << " allocations" << (same ? "" : ", counts differ") << endl;
+  bool pass = same && nAllocs == 0;
+  cout << "test_dynamic_allocs() ==> " << (pass ? "Pass" : "Fail") << endl;
+  return pass ? 0 : 1;
+}
+
+// lineseg_alloc_test [nQueries]
+int main(int argc, char *argv[]) {
+  int nQueries = argc > 1 ? atoi(argv[1]) : 200;
+  int nFailed = test_workspace_allocs(nQueries);
+  nFailed += test_dynamic_allocs(nQueries);
+  return nFailed > 0 ? 1 : 0;
+}
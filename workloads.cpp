@@ -0,0 +1,225 @@
+#include "workloads.h"
+#include "lseg.h"
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+const int nHotspots = 16;
+const double hotspotSigma = 0.03;
+const double longFactor = 10.;
+const int polylineVertices = 64;
+const double polylineTurn = 0.5; // std deviation of the turn at a vertex
+const int bundleSize = 16;
+const double bundleSpread = 1.e-6; // relative to the segment length
+const double roadTilt = 0.05;      // largest angle to the x axis, radians
+
+// mt19937_64 is fully specified, unlike the standard distributions
+struct workload_rng
+{
+  mt19937_64 gen;
+
+  explicit workload_rng(uint64_t seed) : gen(seed) {}
+
+  // in [0, 1)
+  double unit() { return (double)(gen() >> 11) * 0x1.0p-53; }
+  double range(double a, double b) { return a + (b - a) * unit(); }
+  // Box-Muller
+  double normal()
+  {
+    double u1 = 1. - unit(), u2 = unit();
+    return sqrt(-2. * log(u1)) * cos(2. * numbers::pi * u2);
+  }
+  // segment from P with a length in [0.5 * len, len], drawn as getRandomSeg
+  Lineseg seg_from(const Pnt2 &P, double len)
+  {
+    Lineseg L(P, P);
+    while (L.len() < 0.5 * len || L.len() > len)
+    {
+      L.E.x = P.x + (2. * unit() - 1.) * len;
+      L.E.y = P.y + (2. * unit() - 1.) * len;
+    }
+    return L;
+  }
+};
+
+void add_uniform(vector<Lineseg> &segs, int n, workload_rng &rng, double len)
+{
+  while ((int)segs.size() < n)
+  {
+    Pnt2 P(rng.unit(), rng.unit());
+    segs.push_back(rng.seg_from(P, len));
+  }
+}
+
+void add_clustered(vector<Lineseg> &segs, int n, workload_rng &rng,
+                   double len)
+{
+  vector<Pnt2> hotspots;
+  for (int k = 0; k < nHotspots; ++k)
+  {
+    hotspots.emplace_back(rng.range(0.1, 0.9), rng.range(0.1, 0.9));
+  }
+  while ((int)segs.size() < n)
+  {
+    const Pnt2 &C = hotspots[rng.gen() % nHotspots];
+    Pnt2 P(C.x + hotspotSigma * rng.normal(),
+           C.y + hotspotSigma * rng.normal());
+    segs.push_back(rng.seg_from(P, len));
+  }
+}
+
+// edges of a k x k lattice of the unit square, horizontal ones first
+void add_grid(vector<Lineseg> &segs, int n)
+{
+  int k = max((int)ceil(sqrt(n / 2.)), 1);
+  for (int dir = 0; dir < 2; ++dir)
+  {
+    for (int i = 0; i <= k; ++i)
+    {
+      for (int j = 0; j < k; ++j)
+      {
+        if ((int)segs.size() == n)
+          return;
+        double a = (double)i / k;
+        double b0 = (double)j / k, b1 = (double)(j + 1) / k;
+        segs.push_back(dir == 0 ? Lineseg(Pnt2(b0, a), Pnt2(b1, a))
+                                : Lineseg(Pnt2(a, b0), Pnt2(a, b1)));
+      }
+    }
+  }
+}
+
+void add_polylines(vector<Lineseg> &segs, int n, workload_rng &rng,
+                   double len)
+{
+  while ((int)segs.size() < n)
+  {
+    Pnt2 P(rng.unit(), rng.unit());
+    double heading = rng.range(0., 2. * numbers::pi);
+    for (int k = 1; k < polylineVertices && (int)segs.size() < n; ++k)
+    {
+      heading += polylineTurn * rng.normal();
+      double step = rng.range(0.5 * len, len);
+      Pnt2 Q(P.x + step * cos(heading), P.y + step * sin(heading));
+      segs.emplace_back(P, Q);
+      P = Q;
+    }
+  }
+}
+
+void add_bundles(vector<Lineseg> &segs, int n, workload_rng &rng, double len)
+{
+  while ((int)segs.size() < n)
+  {
+    Lineseg base = rng.seg_from(Pnt2(rng.unit(), rng.unit()), len);
+    double spread = bundleSpread * base.len();
+    for (int k = 0; k < bundleSize && (int)segs.size() < n; ++k)
+    {
+      Lineseg L = base;
+      L.S.x += spread * (rng.unit() - 0.5);
+      L.S.y += spread * (rng.unit() - 0.5);
+      L.E.x += spread * (rng.unit() - 0.5);
+      L.E.y += spread * (rng.unit() - 0.5);
+      segs.push_back(L);
+    }
+  }
+}
+
+void add_roads(vector<Lineseg> &segs, int n, workload_rng &rng, double len)
+{
+  while ((int)segs.size() < n)
+  {
+    Pnt2 P(rng.unit(), rng.unit());
+    double angle = rng.range(-roadTilt, roadTilt);
+    double length = rng.range(0.5 * len, len);
+    segs.emplace_back(P, Pnt2(P.x + length * cos(angle),
+                              P.y + length * sin(angle)));
+  }
+}
+
+} // namespace
+
+const char *workload_name(Workload workload)
+{
+  switch (workload)
+  {
+  case Workload::long_segs:
+    return "long";
+  case Workload::clustered:
+    return "clustered";
+  case Workload::grid:
+    return "grid";
+  case Workload::polylines:
+    return "polylines";
+  case Workload::bundles:
+    return "bundles";
+  case Workload::roads:
+    return "roads";
+  case Workload::uniform:
+  default:
+    return "uniform";
+  }
+}
+
+bool workload_from_name(const string &name, Workload &workload)
+{
+  for (auto w : allWorkloads)
+  {
+    if (name == workload_name(w))
+    {
+      workload = w;
+      return true;
+    }
+  }
+  return false;
+}
+
+double workload_default_len(int n) { return 2. / sqrt(max(n, 1)); }
+
+vector<Lineseg> generate_workload(Workload workload, int n, uint64_t seed,
+                                  double len)
+{
+  if (len <= 0.)
+    len = workload_default_len(n);
+  workload_rng rng(seed);
+  vector<Lineseg> segs;
+  segs.reserve(n);
+  switch (workload)
+  {
+  case Workload::long_segs:
+    add_uniform(segs, n, rng, longFactor * len);
+    break;
+  case Workload::clustered:
+    add_clustered(segs, n, rng, len);
+    break;
+  case Workload::grid:
+    add_grid(segs, n);
+    break;
+  case Workload::polylines:
+    add_polylines(segs, n, rng, len);
+    break;
+  case Workload::bundles:
+    add_bundles(segs, n, rng, len);
+    break;
+  case Workload::roads:
+    add_roads(segs, n, rng, longFactor * len);
+    break;
+  case Workload::uniform:
+  default:
+    add_uniform(segs, n, rng, len);
+    break;
+  }
+  for (uint32_t is = 0; is < (uint32_t)segs.size(); ++is)
+  {
+    segs[is].id = is;
+  }
+  return segs;
+}
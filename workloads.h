@@ -0,0 +1,44 @@
+#pragma once
+
+#include "lseg.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Seeded segment generators for the benchmarks (benchmark.cpp). All of them
+// fill about the unit square, and give the same segments for the same
+// (workload, n, seed, len): they draw from the mt19937_64 sequence, which is
+// fully specified, rather than from the standard distributions, which are
+// not. The clustered and polyline workloads also go through the math
+// library, so they may differ in the last bits across platforms.
+
+enum class Workload
+{
+  uniform,   // short segments anywhere, as getRandomSeg
+  long_segs, // the same with 10x the length
+  clustered, // short segments around a few hotspots
+  grid,      // axis-aligned pieces of a lattice, touching end to end
+  polylines, // random walks, consecutive segments sharing an endpoint
+  bundles,   // groups of nearly parallel, nearly coincident segments
+  roads      // long, nearly horizontal segments, as road or pipe layers
+};
+
+const Workload allWorkloads[] = {Workload::uniform,   Workload::long_segs,
+                                 Workload::clustered, Workload::grid,
+                                 Workload::polylines, Workload::bundles,
+                                 Workload::roads};
+
+const char *workload_name(Workload workload);
+
+// false if name is not one of the workload names
+bool workload_from_name(const string &name, Workload &workload);
+
+// default segment length: about 2 / sqrt(n), so that the uniform workload has
+// a few intersections per segment at any n
+double workload_default_len(int n);
+
+// n segments with ids 0..n-1; len <= 0 uses workload_default_len
+vector<Lineseg> generate_workload(Workload workload, int n, uint64_t seed,
+                                  double len = 0.);